@@ -32,6 +32,7 @@
 #include "wdsr-main-helper.h"
 
 #include "ns3/wdsr-helper.h"
+#include "ns3/wdsr-node-directory.h"
 #include "ns3/wdsr-rcache.h"
 #include "ns3/wdsr-routing.h"
 #include "ns3/wdsr-rreq-table.h"
@@ -97,6 +98,7 @@ WDsrMainHelper::Install(Ptr<Node> node)
     //  wdsr->SetRouteCache (routeCache);
     //  wdsr->SetRequestTable (rreqTable);
     wdsr->SetNode(node);
+    ns3::wdsr::WDsrNodeDirectory::Add(node, wdsr);
     //  node->AggregateObject (routeCache);
     //  node->AggregateObject (rreqTable);
 }
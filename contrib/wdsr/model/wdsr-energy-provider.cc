@@ -0,0 +1,218 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "wdsr-energy-provider.h"
+
+#include "ns3/assert.h"
+#include "ns3/double.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("WDsrEnergyProvider");
+
+namespace wdsr
+{
+
+NS_OBJECT_ENSURE_REGISTERED(WDsrEnergyProvider);
+
+TypeId
+WDsrEnergyProvider::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::wdsr::WDsrEnergyProvider")
+            .SetParent<Object>()
+            .SetGroupName("WDsr")
+            .AddConstructor<WDsrEnergyProvider>()
+            .AddAttribute("InitialEnergy",
+                          "Initial energy of the built-in model, in Joules.",
+                          DoubleValue(10.0),
+                          MakeDoubleAccessor(&WDsrEnergyProvider::SetInitialEnergy,
+                                             &WDsrEnergyProvider::GetInitialEnergy),
+                          MakeDoubleChecker<double>(0.0))
+            .AddAttribute("IdlePower",
+                          "Power the built-in model drains all the time, in Watts.",
+                          DoubleValue(0.0),
+                          MakeDoubleAccessor(&WDsrEnergyProvider::SetIdlePower,
+                                             &WDsrEnergyProvider::GetIdlePower),
+                          MakeDoubleChecker<double>(0.0))
+            .AddTraceSource("RemainingEnergy",
+                            "Remaining energy of the built-in model when it changes, in Joules.",
+                            MakeTraceSourceAccessor(&WDsrEnergyProvider::m_remainingEnergyJ),
+                            "ns3::TracedValueCallback::Double")
+            .AddTraceSource("Depleted",
+                            "The battery of the built-in model ran out.",
+                            MakeTraceSourceAccessor(&WDsrEnergyProvider::m_depletedTrace),
+                            "ns3::wdsr::WDsrEnergyProvider::DepletedTracedCallback");
+    return tid;
+}
+
+WDsrEnergyProvider::WDsrEnergyProvider()
+    : m_initialEnergyJ(0.0),
+      m_idlePowerW(0.0),
+      m_remainingEnergyJ(0.0)
+{
+    NS_LOG_FUNCTION(this);
+}
+
+WDsrEnergyProvider::~WDsrEnergyProvider()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+void
+WDsrEnergyProvider::DoDispose()
+{
+    NS_LOG_FUNCTION(this);
+    m_depletionEvent.Cancel();
+    m_source = nullptr;
+    Object::DoDispose();
+}
+
+void
+WDsrEnergyProvider::SetEnergySource(Ptr<EnergySource> source)
+{
+    NS_LOG_FUNCTION(this << source);
+    m_source = source;
+}
+
+Ptr<EnergySource>
+WDsrEnergyProvider::GetEnergySource() const
+{
+    return m_source;
+}
+
+void
+WDsrEnergyProvider::SetInitialEnergy(double initialEnergyJ)
+{
+    NS_LOG_FUNCTION(this << initialEnergyJ);
+    NS_ASSERT(initialEnergyJ >= 0);
+    m_initialEnergyJ = initialEnergyJ;
+    m_remainingEnergyJ = initialEnergyJ;
+    m_lastUpdate = Simulator::Now();
+    ScheduleDepletion();
+}
+
+double
+WDsrEnergyProvider::GetInitialEnergy() const
+{
+    if (m_source)
+    {
+        return m_source->GetInitialEnergy();
+    }
+    return m_initialEnergyJ;
+}
+
+double
+WDsrEnergyProvider::GetRemainingEnergy() const
+{
+    if (m_source)
+    {
+        return m_source->GetRemainingEnergy();
+    }
+    double remainingEnergyJ =
+        m_remainingEnergyJ.Get() - m_idlePowerW * (Simulator::Now() - m_lastUpdate).GetSeconds();
+    return remainingEnergyJ > 0.0 ? remainingEnergyJ : 0.0;
+}
+
+void
+WDsrEnergyProvider::SetIdlePower(double idlePowerW)
+{
+    NS_LOG_FUNCTION(this << idlePowerW);
+    NS_ASSERT(idlePowerW >= 0);
+    UpdateEnergy();
+    m_idlePowerW = idlePowerW;
+    ScheduleDepletion();
+}
+
+double
+WDsrEnergyProvider::GetIdlePower() const
+{
+    return m_idlePowerW;
+}
+
+void
+WDsrEnergyProvider::DecreaseEnergy(double energyJ)
+{
+    NS_LOG_FUNCTION(this << energyJ);
+    NS_ASSERT_MSG(!m_source, "The energy of a source is drained by its device energy models");
+    if (m_remainingEnergyJ <= 0.0)
+    {
+        return;
+    }
+    UpdateEnergy();
+    if (m_remainingEnergyJ <= energyJ)
+    {
+        m_depletionEvent.Cancel();
+        NotifyDepleted();
+        return;
+    }
+    m_remainingEnergyJ = m_remainingEnergyJ.Get() - energyJ;
+    ScheduleDepletion();
+}
+
+bool
+WDsrEnergyProvider::IsDepleted() const
+{
+    return GetRemainingEnergy() <= 0.0;
+}
+
+void
+WDsrEnergyProvider::UpdateEnergy()
+{
+    Time now = Simulator::Now();
+    if (now != m_lastUpdate && m_idlePowerW > 0.0 && m_remainingEnergyJ > 0.0)
+    {
+        double remainingEnergyJ =
+            m_remainingEnergyJ.Get() - m_idlePowerW * (now - m_lastUpdate).GetSeconds();
+        m_remainingEnergyJ = remainingEnergyJ > 0.0 ? remainingEnergyJ : 0.0;
+    }
+    m_lastUpdate = now;
+}
+
+void
+WDsrEnergyProvider::ScheduleDepletion()
+{
+    m_depletionEvent.Cancel();
+    if (m_idlePowerW > 0.0 && m_remainingEnergyJ > 0.0)
+    {
+        m_depletionEvent = Simulator::Schedule(Seconds(m_remainingEnergyJ.Get() / m_idlePowerW),
+                                               &WDsrEnergyProvider::HandleDepletion,
+                                               this);
+    }
+}
+
+void
+WDsrEnergyProvider::HandleDepletion()
+{
+    NS_LOG_FUNCTION(this);
+    m_lastUpdate = Simulator::Now();
+    NotifyDepleted();
+}
+
+void
+WDsrEnergyProvider::NotifyDepleted()
+{
+    NS_LOG_DEBUG("Battery depleted at " << Simulator::Now().As(Time::S));
+    m_remainingEnergyJ = 0.0;
+    m_depletedTrace(Simulator::Now());
+}
+
+} // namespace wdsr
+} // namespace ns3
@@ -0,0 +1,135 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef WDSR_ENERGY_PROVIDER_H
+#define WDSR_ENERGY_PROVIDER_H
+
+#include "ns3/energy-source.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "ns3/object.h"
+#include "ns3/ptr.h"
+#include "ns3/traced-callback.h"
+#include "ns3/traced-value.h"
+
+namespace ns3
+{
+namespace wdsr
+{
+
+/**
+ * \ingroup wdsr
+ * \brief Battery of a node, as seen by the WDSR route selection.
+ *
+ * The provider is aggregated to the node, the route requests and replies then carry the lowest
+ * remaining battery of the nodes they traverse.  It either follows an ns-3 EnergySource, or keeps
+ * the remaining energy itself and lets the simulation drain it with DecreaseEnergy.  A node
+ * without a provider is taken as having a full battery.
+ *
+ * The built-in model also drains the idle power continuously.  The remaining energy is computed
+ * from the time of the last change when it is read, and a single event is scheduled at the time
+ * the battery runs out, so no periodic update is needed.
+ */
+class WDsrEnergyProvider : public Object
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId();
+
+    WDsrEnergyProvider();
+    ~WDsrEnergyProvider() override;
+
+    /**
+     * \brief Follow an energy source instead of keeping the remaining energy here
+     * \param source the energy source, or 0 to use the built-in model again
+     */
+    void SetEnergySource(Ptr<EnergySource> source);
+    /**
+     * \brief Get the energy source followed
+     * \return the energy source, or 0 with the built-in model
+     */
+    Ptr<EnergySource> GetEnergySource() const;
+    /**
+     * \brief Set the initial energy of the built-in model, the battery is full again
+     * \param initialEnergyJ the initial energy in Joules
+     */
+    void SetInitialEnergy(double initialEnergyJ);
+    /**
+     * \brief Get the initial energy
+     * \return the initial energy in Joules
+     */
+    double GetInitialEnergy() const;
+    /**
+     * \brief Get the remaining energy
+     * \return the remaining energy in Joules
+     */
+    double GetRemainingEnergy() const;
+    /**
+     * \brief Set the power the built-in model drains all the time
+     * \param idlePowerW the idle power in Watts
+     */
+    void SetIdlePower(double idlePowerW);
+    /**
+     * \brief Get the idle power
+     * \return the idle power in Watts
+     */
+    double GetIdlePower() const;
+    /**
+     * \brief Drain the battery of the built-in model, it does not go below 0
+     * \param energyJ the energy used in Joules
+     */
+    void DecreaseEnergy(double energyJ);
+    /**
+     * \brief Check if the battery is empty
+     * \return true if no energy is left
+     */
+    bool IsDepleted() const;
+
+    /**
+     * TracedCallback signature for the depletion of a battery.
+     *
+     * \param [in] time the time the battery ran out
+     */
+    typedef void (*DepletedTracedCallback)(Time time);
+
+  private:
+    void DoDispose() override;
+    /// Apply the idle drain since the last change
+    void UpdateEnergy();
+    /// Schedule the depletion event from the remaining energy and the idle power
+    void ScheduleDepletion();
+    /// Empty the battery when the idle drain has used it up
+    void HandleDepletion();
+    /// Notify the depletion, the battery is empty
+    void NotifyDepleted();
+
+    Ptr<EnergySource> m_source;             ///< The energy source followed, if any
+    double m_initialEnergyJ;                ///< Initial energy of the built-in model
+    double m_idlePowerW;                    ///< Idle power of the built-in model
+    TracedValue<double> m_remainingEnergyJ; ///< Remaining energy at the last change
+    Time m_lastUpdate;                      ///< Time of the last change
+    EventId m_depletionEvent;               ///< Event at the time the battery runs out
+    /// The battery of the built-in model ran out
+    TracedCallback<Time> m_depletedTrace;
+};
+
+} // namespace wdsr
+} // namespace ns3
+
+#endif /* WDSR_ENERGY_PROVIDER_H */
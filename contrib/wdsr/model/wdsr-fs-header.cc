@@ -140,8 +140,16 @@ WDsrFsHeader::Print(std::ostream& os) const
 {
     os << "nextHeader: " << (uint32_t)GetNextHeader()
        << " messageType: " << (uint32_t)GetMessageType() << " sourceId: " << (uint32_t)GetSourceId()
-       << " destinationId: " << (uint32_t)GetDestId()
-       << " length: " << (uint32_t)GetPayloadLength();
+       << " destinationId: ";
+    if (GetDestId() == BROADCAST_ID)
+    {
+        os << "broadcast";
+    }
+    else
+    {
+        os << (uint32_t)GetDestId();
+    }
+    os << " length: " << (uint32_t)GetPayloadLength();
 }
 
 uint32_t
@@ -78,10 +78,18 @@ namespace wdsr
    |                            Options                           |
    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
   \endverbatim
+
+  The ids are the 16 bit node ids, the two highest values are reserved so up to 65534 nodes can
+  be addressed.
 */
 class WDsrFsHeader : public Header
 {
   public:
+    /// Destination id of the packets sent to all the nodes, such as the route requests
+    static constexpr uint16_t BROADCAST_ID = 0xffff;
+    /// Id of an address that is not the main address of a node
+    static constexpr uint16_t INVALID_ID = 0xfffe;
+
     /**
      * \brief Get the type identificator.
      * \return type identificator
@@ -61,7 +61,10 @@ WDsrNetworkQueue::GetTypeId()
 }
 
 WDsrNetworkQueue::WDsrNetworkQueue(uint32_t maxLen, Time maxDelay)
-    : m_size(0),
+    : m_headSequence(0),
+      m_credited(false),
+      m_quantum(1500),
+      m_size(0),
       m_maxSize(maxLen),
       m_maxDelay(maxDelay)
 {
@@ -69,7 +72,10 @@ WDsrNetworkQueue::WDsrNetworkQueue(uint32_t maxLen, Time maxDelay)
 }
 
 WDsrNetworkQueue::WDsrNetworkQueue()
-    : m_size(0)
+    : m_headSequence(0),
+      m_credited(false),
+      m_quantum(1500),
+      m_size(0)
 {
     NS_LOG_FUNCTION(this);
 }
@@ -104,38 +110,36 @@ WDsrNetworkQueue::GetMaxNetworkDelay() const
     return m_maxDelay;
 }
 
+void
+WDsrNetworkQueue::SetQuantum(uint32_t quantum)
+{
+    NS_ASSERT(quantum > 0);
+    m_quantum = quantum;
+}
+
+uint32_t
+WDsrNetworkQueue::GetQuantum() const
+{
+    return m_quantum;
+}
+
 bool
 WDsrNetworkQueue::FindPacketWithNexthop(Ipv4Address nextHop, WDsrNetworkQueueEntry& entry)
 {
     Cleanup();
-    for (std::vector<WDsrNetworkQueueEntry>::iterator i = m_wdsrNetworkQueue.begin();
-         i != m_wdsrNetworkQueue.end();
-         ++i)
+    if (m_nextHops.find(nextHop) == m_nextHops.end())
     {
-        if (i->GetNextHopAddress() == nextHop)
-        {
-            entry = *i;
-            i = m_wdsrNetworkQueue.erase(i);
-            return true;
-        }
+        return false;
     }
-    return false;
+    TakeNextHop(nextHop, entry);
+    return true;
 }
 
 bool
 WDsrNetworkQueue::Find(Ipv4Address nextHop)
 {
     Cleanup();
-    for (std::vector<WDsrNetworkQueueEntry>::iterator i = m_wdsrNetworkQueue.begin();
-         i != m_wdsrNetworkQueue.end();
-         ++i)
-    {
-        if (i->GetNextHopAddress() == nextHop)
-        {
-            return true;
-        }
-    }
-    return false;
+    return m_nextHops.find(nextHop) != m_nextHops.end();
 }
 
 bool
@@ -148,7 +152,17 @@ WDsrNetworkQueue::Enqueue(WDsrNetworkQueueEntry& entry)
     }
     Time now = Simulator::Now();
     entry.SetInsertedTimeStamp(now);
-    m_wdsrNetworkQueue.push_back(entry);
+    Slot slot = {entry, false};
+    NextHops::iterator i = m_nextHops.find(entry.GetNextHopAddress());
+    if (i == m_nextHops.end())
+    {
+        NextHop nextHop;
+        nextHop.m_deficit = 0;
+        nextHop.m_round = m_round.insert(m_round.end(), entry.GetNextHopAddress());
+        i = m_nextHops.insert(std::make_pair(entry.GetNextHopAddress(), nextHop)).first;
+    }
+    i->second.m_sequences.push_back(m_headSequence + m_wdsrNetworkQueue.size());
+    m_wdsrNetworkQueue.push_back(slot);
     m_size++;
     NS_LOG_LOGIC("The network queue size is " << m_size);
     return true;
@@ -159,45 +173,91 @@ WDsrNetworkQueue::Dequeue(WDsrNetworkQueueEntry& entry)
 {
     NS_LOG_FUNCTION(this);
     Cleanup();
-    std::vector<WDsrNetworkQueueEntry>::iterator i = m_wdsrNetworkQueue.begin();
-    if (i == m_wdsrNetworkQueue.end())
+    while (!m_round.empty())
     {
-        // no elements in array
-        NS_LOG_LOGIC("No queued packet in the network queue");
-        return false;
+        Ipv4Address nextHop = m_round.front();
+        NextHops::iterator i = m_nextHops.find(nextHop);
+        NS_ASSERT(i != m_nextHops.end());
+        if (!m_credited)
+        {
+            i->second.m_deficit += m_quantum;
+            m_credited = true;
+        }
+        const Slot& slot = m_wdsrNetworkQueue[i->second.m_sequences.front() - m_headSequence];
+        uint32_t size = slot.m_entry.GetPacket() ? slot.m_entry.GetPacket()->GetSize() : 0;
+        if (size <= i->second.m_deficit)
+        {
+            i->second.m_deficit -= size;
+            TakeNextHop(nextHop, entry);
+            return true;
+        }
+        // The next hop has used its quantum, its turn is over until the next round
+        m_round.splice(m_round.end(), m_round, m_round.begin());
+        m_credited = false;
     }
-    entry = *i;
-    m_wdsrNetworkQueue.erase(i);
-    m_size--;
-    return true;
+    // no elements in array
+    NS_LOG_LOGIC("No queued packet in the network queue");
+    return false;
 }
 
 void
-WDsrNetworkQueue::Cleanup()
+WDsrNetworkQueue::TakeNextHop(Ipv4Address nextHop, WDsrNetworkQueueEntry& entry)
 {
-    NS_LOG_FUNCTION(this);
-    if (m_wdsrNetworkQueue.empty())
+    NextHops::iterator i = m_nextHops.find(nextHop);
+    NS_ASSERT(i != m_nextHops.end());
+    Slot& slot = m_wdsrNetworkQueue[i->second.m_sequences.front() - m_headSequence];
+    entry = slot.m_entry;
+    slot.m_entry = WDsrNetworkQueueEntry();
+    slot.m_removed = true;
+    PopNextHop(nextHop);
+    m_size--;
+    // Drop the entries taken out from the head right away
+    while (!m_wdsrNetworkQueue.empty() && m_wdsrNetworkQueue.front().m_removed)
     {
-        return;
+        m_wdsrNetworkQueue.pop_front();
+        m_headSequence++;
     }
+}
 
-    Time now = Simulator::Now();
-    uint32_t n = 0;
-    for (std::vector<WDsrNetworkQueueEntry>::iterator i = m_wdsrNetworkQueue.begin();
-         i != m_wdsrNetworkQueue.end();)
+void
+WDsrNetworkQueue::PopNextHop(Ipv4Address nextHop)
+{
+    NextHops::iterator i = m_nextHops.find(nextHop);
+    NS_ASSERT(i != m_nextHops.end());
+    i->second.m_sequences.pop_front();
+    if (i->second.m_sequences.empty())
     {
-        if (i->GetInsertedTimeStamp() + m_maxDelay > now)
+        if (i->second.m_round == m_round.begin())
         {
-            i++;
+            m_credited = false;
         }
-        else
+        m_round.erase(i->second.m_round);
+        m_nextHops.erase(i);
+    }
+}
+
+void
+WDsrNetworkQueue::Cleanup()
+{
+    NS_LOG_FUNCTION(this);
+    // The time stamps only grow along the queue, the expired entries are at its head
+    Time now = Simulator::Now();
+    while (!m_wdsrNetworkQueue.empty())
+    {
+        Slot& slot = m_wdsrNetworkQueue.front();
+        if (!slot.m_removed)
         {
+            if (slot.m_entry.GetInsertedTimeStamp() + m_maxDelay > now)
+            {
+                break;
+            }
             NS_LOG_LOGIC("Outdated packet");
-            i = m_wdsrNetworkQueue.erase(i);
-            n++;
+            PopNextHop(slot.m_entry.GetNextHopAddress());
+            m_size--;
         }
+        m_wdsrNetworkQueue.pop_front();
+        m_headSequence++;
     }
-    m_size -= n;
 }
 
 uint32_t
@@ -211,7 +271,11 @@ void
 WDsrNetworkQueue::Flush()
 {
     NS_LOG_FUNCTION(this);
-    m_wdsrNetworkQueue.erase(m_wdsrNetworkQueue.begin(), m_wdsrNetworkQueue.end());
+    m_headSequence += m_wdsrNetworkQueue.size();
+    m_wdsrNetworkQueue.clear();
+    m_nextHops.clear();
+    m_round.clear();
+    m_credited = false;
     m_size = 0;
 }
 
@@ -38,7 +38,10 @@
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/simulator.h"
 
-#include <vector>
+#include <deque>
+#include <list>
+#include <stdint.h>
+#include <unordered_map>
 
 namespace ns3
 {
@@ -193,9 +196,33 @@ class WDsrNetworkQueueEntry
     Ptr<Ipv4Route> m_ipv4Route;
 };
 
+/**
+ * \ingroup wdsr
+ * \brief WDSR Network Queue
+ *
+ * The entries are kept in insertion order, which is also the order of their time stamps, so the
+ * expired entries are always at the head of the queue.  The entries of each next hop are indexed
+ * by their sequence number; an entry taken out for its next hop is only marked as removed and
+ * dropped once it reaches the head.
+ *
+ * The entries are dequeued with deficit round robin over their next hops, so a slow or broken
+ * next hop does not hold back the entries of the others.  Each next hop is allowed to send the
+ * quantum in bytes every round.
+ */
 class WDsrNetworkQueue : public Object
 {
   public:
+    /// The queued entries of a next hop
+    struct NextHop
+    {
+        std::deque<uint64_t> m_sequences;         //!< Sequence numbers of the entries, oldest first
+        uint32_t m_deficit;                       //!< Bytes left to send in this round
+        std::list<Ipv4Address>::iterator m_round; //!< Position of the next hop in the round
+    };
+
+    /// The queued entries of each next hop
+    typedef std::unordered_map<Ipv4Address, NextHop, Ipv4AddressHash> NextHops;
+
     /**
      * \brief Get the type ID.
      * \return the object TypeId
@@ -236,7 +263,7 @@ class WDsrNetworkQueue : public Object
      */
     bool Enqueue(WDsrNetworkQueueEntry& entry);
     /**
-     * Return first found (the earliest) entry for given destination
+     * Return the earliest entry of the next hop whose turn it is in the round
      *
      * \param entry pointer to the return entry
      * \return true if an entry is returned,
@@ -274,30 +301,66 @@ class WDsrNetworkQueue : public Object
      * \return the maximum entry lifetime for this queue
      */
     Time GetMaxNetworkDelay() const;
+    /**
+     * Set the number of bytes each next hop may send every round
+     *
+     * \param quantum the quantum in bytes
+     */
+    void SetQuantum(uint32_t quantum);
+    /**
+     * Return the number of bytes each next hop may send every round
+     *
+     * \return the quantum in bytes
+     */
+    uint32_t GetQuantum() const;
     /**
      * Clear the queue
      */
     void Flush();
 
     /**
-     * Return the current queue entry
+     * Return the next hops of the queued entries, the expired entries not removed yet included
      *
-     * \return the current queue entry
+     * \return the sequence numbers of the entries of each next hop
      */
-    std::vector<WDsrNetworkQueueEntry>& GetQueue()
+    const NextHops& GetNextHops() const
     {
-        return m_wdsrNetworkQueue;
+        return m_nextHops;
     }
 
   private:
+    /// A queued entry
+    struct Slot
+    {
+        WDsrNetworkQueueEntry m_entry; //!< the entry
+        bool m_removed;                //!< whether the entry has been taken out for its next hop
+    };
+
     /**
      * Clean the queue by removing entries that exceeded lifetime.
      */
     void Cleanup();
-    std::vector<WDsrNetworkQueueEntry> m_wdsrNetworkQueue; //!< Queue (vector) of entries
-    uint32_t m_size;                                     //!< Current queue size
-    uint32_t m_maxSize;                                  //!< Maximum queue size
-    Time m_maxDelay;                                     //!< Maximum entry lifetime
+    /**
+     * Remove the oldest entry of a next hop from the next hop index, and the next hop from the
+     * round once it has no entry left
+     * \param nextHop the next hop of the entry
+     */
+    void PopNextHop(Ipv4Address nextHop);
+    /**
+     * Take the oldest entry of a next hop out of the queue
+     * \param nextHop the next hop
+     * \param entry the entry taken out
+     */
+    void TakeNextHop(Ipv4Address nextHop, WDsrNetworkQueueEntry& entry);
+    std::deque<Slot> m_wdsrNetworkQueue; //!< Queue (deque) of entries
+    uint64_t m_headSequence;           //!< Sequence number of the entry at the head of the queue
+    NextHops m_nextHops;               //!< Sequence numbers of the entries by next hop
+    std::list<Ipv4Address> m_round;    //!< Next hops with queued entries, in round robin order
+    bool m_credited;                   //!< Whether the front of the round got its quantum
+    uint32_t m_quantum;                //!< Bytes each next hop may send every round
+    uint32_t m_size;                   //!< Current queue size
+    uint32_t m_maxSize;                //!< Maximum queue size
+    Time m_maxDelay;                   //!< Maximum entry lifetime
 };
 
 } // namespace wdsr
@@ -0,0 +1,353 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "wdsr-node-directory.h"
+
+#include "wdsr-routing.h"
+
+#include "ns3/ipv4-list-routing.h"
+#include "ns3/ipv4.h"
+#include "ns3/log.h"
+#include "ns3/net-device.h"
+#include "ns3/simulator.h"
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("WDsrNodeDirectory");
+
+namespace wdsr
+{
+
+NS_OBJECT_ENSURE_REGISTERED(WDsrAddressWatcher);
+
+size_t
+WDsrNodeDirectory::Mac48AddressHash::operator()(const Mac48Address& address) const
+{
+    uint8_t buffer[6];
+    address.CopyTo(buffer);
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        value = (value << 8) | buffer[i];
+    }
+    return std::hash<uint64_t>()(value);
+}
+
+WDsrNodeDirectory::Tables&
+WDsrNodeDirectory::GetTables()
+{
+    static Tables tables = {};
+    return tables;
+}
+
+WDsrNodeDirectory::Entry&
+WDsrNodeDirectory::GetEntry(uint32_t id)
+{
+    Tables& tables = GetTables();
+    if (id >= tables.m_entries.size())
+    {
+        tables.m_entries.resize(id + 1);
+    }
+    if (!tables.m_destroyScheduled)
+    {
+        Simulator::ScheduleDestroy(&WDsrNodeDirectory::Clear);
+        tables.m_destroyScheduled = true;
+    }
+    return tables.m_entries[id];
+}
+
+void
+WDsrNodeDirectory::Add(Ptr<Node> node, Ptr<WDsrRouting> wdsr)
+{
+    NS_LOG_FUNCTION(node << wdsr);
+    Entry& entry = GetEntry(node->GetId());
+    entry.m_node = node;
+    entry.m_wdsr = wdsr;
+    Update(node);
+
+    Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+    Ptr<Ipv4ListRouting> list =
+        ipv4 ? DynamicCast<Ipv4ListRouting>(ipv4->GetRoutingProtocol()) : nullptr;
+    if (!list)
+    {
+        NS_LOG_WARN("Node " << node->GetId() << " has no routing list to watch its addresses");
+        return;
+    }
+    // Both the helper and WDSR add the node, the watcher is put in the list once
+    for (uint32_t i = 0; i < list->GetNRoutingProtocols(); ++i)
+    {
+        int16_t priority;
+        if (DynamicCast<WDsrAddressWatcher>(list->GetRoutingProtocol(i, priority)))
+        {
+            return;
+        }
+    }
+    // The lowest priority, the other protocols are asked for routes first
+    list->AddRoutingProtocol(CreateObject<WDsrAddressWatcher>(),
+                             std::numeric_limits<int16_t>::min());
+}
+
+void
+WDsrNodeDirectory::Update(Ptr<Node> node)
+{
+    NS_LOG_FUNCTION(node);
+    Tables& tables = GetTables();
+    uint32_t id = node->GetId();
+    Entry& entry = GetEntry(id);
+    entry.m_node = node;
+    // Forget the addresses indexed before, unless another node has taken them since
+    for (std::vector<Ipv4Address>::const_iterator i = entry.m_addresses.begin();
+         i != entry.m_addresses.end();
+         ++i)
+    {
+        std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::iterator j =
+            tables.m_addressIds.find(*i);
+        if (j != tables.m_addressIds.end() && j->second == id)
+        {
+            tables.m_addressIds.erase(j);
+        }
+    }
+    entry.m_addresses.clear();
+    std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::iterator main =
+        tables.m_mainIds.find(entry.m_mainAddress);
+    if (main != tables.m_mainIds.end() && main->second == id)
+    {
+        tables.m_mainIds.erase(main);
+    }
+    std::unordered_map<Mac48Address, uint32_t, Mac48AddressHash>::iterator mac =
+        tables.m_macIds.find(entry.m_macAddress);
+    if (mac != tables.m_macIds.end() && mac->second == id)
+    {
+        tables.m_macIds.erase(mac);
+    }
+    entry.m_mainAddress = Ipv4Address::GetAny();
+    entry.m_macAddress = Mac48Address();
+
+    Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+    if (!ipv4)
+    {
+        NS_LOG_LOGIC("Node " << id << " has no IPv4 stack yet");
+        return;
+    }
+    // The interface 0 is the loopback, every node has its address
+    for (uint32_t i = 1; i < ipv4->GetNInterfaces(); ++i)
+    {
+        for (uint32_t j = 0; j < ipv4->GetNAddresses(i); ++j)
+        {
+            Ipv4Address address = ipv4->GetAddress(i, j).GetLocal();
+            tables.m_addressIds[address] = id;
+            entry.m_addresses.push_back(address);
+        }
+    }
+    if (ipv4->GetNInterfaces() > 1 && ipv4->GetNAddresses(1) > 0)
+    {
+        entry.m_mainAddress = ipv4->GetAddress(1, 0).GetLocal();
+        tables.m_mainIds[entry.m_mainAddress] = id;
+        Address address = ipv4->GetNetDevice(1)->GetAddress();
+        if (Mac48Address::IsMatchingType(address))
+        {
+            entry.m_macAddress = Mac48Address::ConvertFrom(address);
+            tables.m_macIds[entry.m_macAddress] = id;
+        }
+    }
+    NS_LOG_LOGIC("Node " << id << " indexed with main address " << entry.m_mainAddress << " and "
+                         << entry.m_addresses.size() << " addresses");
+}
+
+uint32_t
+WDsrNodeDirectory::GetId(Ipv4Address address)
+{
+    const Tables& tables = GetTables();
+    std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator i =
+        tables.m_mainIds.find(address);
+    if (i == tables.m_mainIds.end())
+    {
+        return INVALID_ID;
+    }
+    return i->second;
+}
+
+Ipv4Address
+WDsrNodeDirectory::GetAddress(uint32_t id)
+{
+    const Tables& tables = GetTables();
+    if (id >= tables.m_entries.size())
+    {
+        return Ipv4Address::GetAny();
+    }
+    return tables.m_entries[id].m_mainAddress;
+}
+
+Ipv4Address
+WDsrNodeDirectory::GetAddress(Mac48Address address)
+{
+    const Tables& tables = GetTables();
+    std::unordered_map<Mac48Address, uint32_t, Mac48AddressHash>::const_iterator i =
+        tables.m_macIds.find(address);
+    if (i == tables.m_macIds.end())
+    {
+        return Ipv4Address::GetAny();
+    }
+    return tables.m_entries[i->second].m_mainAddress;
+}
+
+Ptr<Node>
+WDsrNodeDirectory::GetNode(Ipv4Address address)
+{
+    const Tables& tables = GetTables();
+    std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator i =
+        tables.m_addressIds.find(address);
+    if (i == tables.m_addressIds.end())
+    {
+        return nullptr;
+    }
+    return tables.m_entries[i->second].m_node;
+}
+
+Ptr<WDsrRouting>
+WDsrNodeDirectory::GetRouting(Ipv4Address address)
+{
+    const Tables& tables = GetTables();
+    std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator i =
+        tables.m_addressIds.find(address);
+    if (i == tables.m_addressIds.end())
+    {
+        return nullptr;
+    }
+    return tables.m_entries[i->second].m_wdsr;
+}
+
+Ptr<WDsrRouting>
+WDsrNodeDirectory::GetRouting(uint32_t id)
+{
+    const Tables& tables = GetTables();
+    if (id >= tables.m_entries.size())
+    {
+        return nullptr;
+    }
+    return tables.m_entries[id].m_wdsr;
+}
+
+uint32_t
+WDsrNodeDirectory::GetNIds()
+{
+    return GetTables().m_entries.size();
+}
+
+void
+WDsrNodeDirectory::Clear()
+{
+    NS_LOG_FUNCTION_NOARGS();
+    Tables& tables = GetTables();
+    tables.m_entries.clear();
+    tables.m_mainIds.clear();
+    tables.m_addressIds.clear();
+    tables.m_macIds.clear();
+    tables.m_destroyScheduled = false;
+}
+
+TypeId
+WDsrAddressWatcher::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::wdsr::WDsrAddressWatcher")
+                            .SetParent<Ipv4RoutingProtocol>()
+                            .SetGroupName("Wdsr")
+                            .AddConstructor<WDsrAddressWatcher>();
+    return tid;
+}
+
+Ptr<Ipv4Route>
+WDsrAddressWatcher::RouteOutput(Ptr<Packet> p,
+                                const Ipv4Header& header,
+                                Ptr<NetDevice> oif,
+                                Socket::SocketErrno& sockerr)
+{
+    sockerr = Socket::ERROR_NOROUTETOHOST;
+    return nullptr;
+}
+
+bool
+WDsrAddressWatcher::RouteInput(Ptr<const Packet> p,
+                               const Ipv4Header& header,
+                               Ptr<const NetDevice> idev,
+                               const UnicastForwardCallback& ucb,
+                               const MulticastForwardCallback& mcb,
+                               const LocalDeliverCallback& lcb,
+                               const ErrorCallback& ecb)
+{
+    return false;
+}
+
+void
+WDsrAddressWatcher::NotifyInterfaceUp(uint32_t interface)
+{
+    NS_LOG_FUNCTION(this << interface);
+    Update();
+}
+
+void
+WDsrAddressWatcher::NotifyInterfaceDown(uint32_t interface)
+{
+    NS_LOG_FUNCTION(this << interface);
+    Update();
+}
+
+void
+WDsrAddressWatcher::NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address)
+{
+    NS_LOG_FUNCTION(this << interface << address);
+    Update();
+}
+
+void
+WDsrAddressWatcher::NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address)
+{
+    NS_LOG_FUNCTION(this << interface << address);
+    Update();
+}
+
+void
+WDsrAddressWatcher::SetIpv4(Ptr<Ipv4> ipv4)
+{
+    NS_LOG_FUNCTION(this << ipv4);
+    m_ipv4 = ipv4;
+}
+
+void
+WDsrAddressWatcher::PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit) const
+{
+}
+
+void
+WDsrAddressWatcher::DoDispose()
+{
+    m_ipv4 = nullptr;
+    Ipv4RoutingProtocol::DoDispose();
+}
+
+void
+WDsrAddressWatcher::Update()
+{
+    Ptr<Node> node = m_ipv4 ? m_ipv4->GetObject<Node>() : nullptr;
+    if (node)
+    {
+        WDsrNodeDirectory::Update(node);
+    }
+}
+
+} // namespace wdsr
+} // namespace ns3
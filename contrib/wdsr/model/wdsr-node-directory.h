@@ -0,0 +1,205 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef WDSR_NODE_DIRECTORY_H
+#define WDSR_NODE_DIRECTORY_H
+
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv4-routing-protocol.h"
+#include "ns3/mac48-address.h"
+#include "ns3/node.h"
+#include "ns3/ptr.h"
+
+#include <limits>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+namespace wdsr
+{
+
+class WDsrRouting;
+
+/**
+ * \ingroup wdsr
+ * \brief Directory of the nodes of the simulation, it maps the IPv4 addresses, the node ids,
+ * the MAC addresses and the WDSR protocols of the nodes to each other with hash lookups.
+ *
+ * The nodes are added by WDsrMainHelper::Install and when WDSR is started on them.  Adding a node
+ * puts a WDsrAddressWatcher in its routing list, so the node is indexed again whenever an address
+ * or an interface of the node changes.  The directory is emptied by Simulator::Destroy.
+ */
+class WDsrNodeDirectory
+{
+  public:
+    /// Node id returned for an unknown address
+    static constexpr uint32_t INVALID_ID = std::numeric_limits<uint32_t>::max();
+
+    /**
+     * \brief Add a node running WDSR, index its current addresses and watch their changes
+     *
+     * The changes are only watched on a node whose routing protocol is an Ipv4ListRouting,
+     * Update has to be called for the other ones.
+     * \param node the node
+     * \param wdsr the WDSR protocol of the node
+     */
+    static void Add(Ptr<Node> node, Ptr<WDsrRouting> wdsr);
+    /**
+     * \brief Index the addresses of a node again, after they have changed
+     * \param node the node
+     */
+    static void Update(Ptr<Node> node);
+    /**
+     * \brief Get the id of the node whose main address is address
+     * \param address the IPv4 address
+     * \return the node id, INVALID_ID if no node has this main address
+     */
+    static uint32_t GetId(Ipv4Address address);
+    /**
+     * \brief Get the main address of a node, the first address of its interface 1
+     * \param id the node id
+     * \return the main address, 0.0.0.0 if the node is unknown
+     */
+    static Ipv4Address GetAddress(uint32_t id);
+    /**
+     * \brief Get the main address of the node owning a MAC address on its interface 1
+     * \param address the MAC address
+     * \return the main address, 0.0.0.0 if no node has this MAC address
+     */
+    static Ipv4Address GetAddress(Mac48Address address);
+    /**
+     * \brief Get the node owning an address on any of its interfaces but the loopback
+     * \param address the IPv4 address
+     * \return the node, null if no node has this address
+     */
+    static Ptr<Node> GetNode(Ipv4Address address);
+    /**
+     * \brief Get the WDSR protocol of the node owning an address
+     * \param address the IPv4 address
+     * \return the WDSR protocol, null if no WDSR node has this address
+     */
+    static Ptr<WDsrRouting> GetRouting(Ipv4Address address);
+    /**
+     * \brief Get the WDSR protocol of a node
+     * \param id the node id
+     * \return the WDSR protocol, null if the node is unknown or does not run WDSR
+     */
+    static Ptr<WDsrRouting> GetRouting(uint32_t id);
+    /**
+     * \brief Get the number of node ids, the nodes are numbered from 0 to this number excluded
+     * \return the number of node ids
+     */
+    static uint32_t GetNIds();
+    /// Remove all the nodes
+    static void Clear();
+
+  private:
+    /// Hash of a MAC address
+    struct Mac48AddressHash
+    {
+        /**
+         * \param address the MAC address
+         * \return the hash of the address
+         */
+        size_t operator()(const Mac48Address& address) const;
+    };
+
+    /// What is known of a node
+    struct Entry
+    {
+        Ptr<Node> m_node;                     ///< the node
+        Ptr<WDsrRouting> m_wdsr;              ///< the WDSR protocol of the node
+        Ipv4Address m_mainAddress;            ///< the first address of interface 1
+        Mac48Address m_macAddress;            ///< the MAC address of interface 1
+        std::vector<Ipv4Address> m_addresses; ///< the addresses indexed for the node
+    };
+
+    /// The tables of the directory
+    struct Tables
+    {
+        std::vector<Entry> m_entries; ///< the nodes, by node id
+        /// main address to node id
+        std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> m_mainIds;
+        /// any address to node id
+        std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> m_addressIds;
+        /// MAC address to node id
+        std::unordered_map<Mac48Address, uint32_t, Mac48AddressHash> m_macIds;
+        bool m_destroyScheduled; ///< whether Clear is scheduled for Simulator::Destroy
+    };
+
+    /**
+     * \brief Get the tables of the directory
+     * \return the tables
+     */
+    static Tables& GetTables();
+    /**
+     * \brief Get the entry of a node, it is created if needed
+     * \param id the node id
+     * \return the entry
+     */
+    static Entry& GetEntry(uint32_t id);
+};
+
+/**
+ * \ingroup wdsr
+ * \brief Routing protocol that routes nothing, put in the routing list of a node to index the
+ * node again in the WDsrNodeDirectory whenever its addresses or interfaces change.
+ */
+class WDsrAddressWatcher : public Ipv4RoutingProtocol
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId();
+
+    // Inherited from Ipv4RoutingProtocol
+    Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p,
+                               const Ipv4Header& header,
+                               Ptr<NetDevice> oif,
+                               Socket::SocketErrno& sockerr) override;
+    bool RouteInput(Ptr<const Packet> p,
+                    const Ipv4Header& header,
+                    Ptr<const NetDevice> idev,
+                    const UnicastForwardCallback& ucb,
+                    const MulticastForwardCallback& mcb,
+                    const LocalDeliverCallback& lcb,
+                    const ErrorCallback& ecb) override;
+    void NotifyInterfaceUp(uint32_t interface) override;
+    void NotifyInterfaceDown(uint32_t interface) override;
+    void NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) override;
+    void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) override;
+    void SetIpv4(Ptr<Ipv4> ipv4) override;
+    void PrintRoutingTable(Ptr<OutputStreamWrapper> stream,
+                           Time::Unit unit = Time::S) const override;
+
+  protected:
+    void DoDispose() override;
+
+  private:
+    /// Index the node again in the directory
+    void Update();
+
+    Ptr<Ipv4> m_ipv4; ///< the IPv4 stack of the node
+};
+
+} // namespace wdsr
+} // namespace ns3
+
+#endif /* WDSR_NODE_DIRECTORY_H */
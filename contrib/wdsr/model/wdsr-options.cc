@@ -37,10 +37,13 @@
 
 #include "wdsr-options.h"
 
+#include "wdsr-energy-provider.h"
+#include "wdsr-node-directory.h"
 #include "wdsr-option-header.h"
 #include "wdsr-rcache.h"
 #include "wdsr-test.h"
 
+#include "ns3/abort.h"
 #include "ns3/assert.h"
 #include "ns3/fatal-error.h"
 #include "ns3/icmpv4-l4-protocol.h"
@@ -51,7 +54,6 @@
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/ipv4-route.h"
 #include "ns3/log.h"
-#include "ns3/node-list.h"
 #include "ns3/node.h"
 #include "ns3/object-vector.h"
 #include "ns3/pointer.h"
@@ -63,6 +65,7 @@
 #include "ns3/basic-energy-source.h"
 #include "ns3/simple-device-energy-model.h"
 
+#include <algorithm>
 #include <ctime>
 #include <list>
 #include <map>
@@ -220,6 +223,32 @@ WDsrOptions::SearchNextHop(Ipv4Address ipv4Address, std::vector<Ipv4Address>& ve
     return none;
 }
 
+Ipv4Address
+WDsrOptions::SearchNextHop(Ipv4Address ipv4Address, const uint8_t* addresses, uint8_t number)
+{
+    NS_LOG_FUNCTION(this << ipv4Address << (uint32_t)number);
+    if (number == 2)
+    {
+        NS_LOG_DEBUG("The two nodes are neighbors");
+        return Ipv4Address::Deserialize(addresses + 4);
+    }
+    if (number && ipv4Address == Ipv4Address::Deserialize(addresses + 4 * (number - 1)))
+    {
+        NS_LOG_DEBUG("We have reached to the final destination " << ipv4Address);
+        return ipv4Address;
+    }
+    for (uint8_t i = 0; i + 1 < number; ++i)
+    {
+        if (ipv4Address == Ipv4Address::Deserialize(addresses + 4 * i))
+        {
+            return Ipv4Address::Deserialize(addresses + 4 * (i + 1));
+        }
+    }
+    NS_LOG_DEBUG("next hop address not found, route corrupted");
+    Ipv4Address none = "0.0.0.0";
+    return none;
+}
+
 Ipv4Address
 WDsrOptions::ReverseSearchNextHop(Ipv4Address ipv4Address, std::vector<Ipv4Address>& vec)
 {
@@ -373,39 +402,25 @@ WDsrOptions::RemoveDuplicates(std::vector<Ipv4Address>& vec)
     }
 }
 
-uint32_t
+uint16_t
 WDsrOptions::GetIDfromIP(Ipv4Address address)
 {
     NS_LOG_FUNCTION(this << address);
-    int32_t nNodes = NodeList::GetNNodes();
-    for (int32_t i = 0; i < nNodes; ++i)
+    uint32_t id = WDsrNodeDirectory::GetId(address);
+    if (id == WDsrNodeDirectory::INVALID_ID)
     {
-        Ptr<Node> node = NodeList::GetNode(i);
-        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-        if (ipv4->GetAddress(1, 0).GetLocal() == address)
-        {
-            return i;
-        }
+        return WDsrFsHeader::INVALID_ID;
     }
-    return 255;
+    NS_ABORT_MSG_IF(id >= WDsrFsHeader::INVALID_ID,
+                    "Node " << id << " can not be addressed in the WDSR header");
+    return uint16_t(id);
 }
 
 Ptr<Node>
 WDsrOptions::GetNodeWithAddress(Ipv4Address ipv4Address)
 {
     NS_LOG_FUNCTION(this << ipv4Address);
-    int32_t nNodes = NodeList::GetNNodes();
-    for (int32_t i = 0; i < nNodes; ++i)
-    {
-        Ptr<Node> node = NodeList::GetNode(i);
-        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-        int32_t ifIndex = ipv4->GetInterfaceForAddress(ipv4Address);
-        if (ifIndex != -1)
-        {
-            return node;
-        }
-    }
-    return nullptr;
+    return WDsrNodeDirectory::GetNode(ipv4Address);
 }
 
 NS_OBJECT_ENSURE_REGISTERED(WDsrOptionPad1);
@@ -546,6 +561,57 @@ WDsrOptionRreq::GetOptionNumber() const
     return OPT_NUMBER;
 }
 
+void
+WDsrOptionRreq::MarkPath(const uint8_t* addresses, uint8_t number)
+{
+    for (uint32_t id : m_pathIds)
+    {
+        m_pathNodes[id / 64] &= ~(uint64_t(1) << (id % 64));
+    }
+    m_pathIds.clear();
+    m_pathOthers.clear();
+    for (uint8_t i = 0; i < number; ++i)
+    {
+        Ipv4Address address = Ipv4Address::Deserialize(addresses + 4 * i);
+        uint32_t id = WDsrNodeDirectory::GetId(address);
+        if (id == WDsrNodeDirectory::INVALID_ID)
+        {
+            m_pathOthers.push_back(address);
+            continue;
+        }
+        if (id / 64 >= m_pathNodes.size())
+        {
+            m_pathNodes.resize(id / 64 + 1, 0);
+        }
+        m_pathNodes[id / 64] |= uint64_t(1) << (id % 64);
+        m_pathIds.push_back(id);
+    }
+}
+
+bool
+WDsrOptionRreq::IsInPath(Ipv4Address address) const
+{
+    uint32_t id = WDsrNodeDirectory::GetId(address);
+    if (id == WDsrNodeDirectory::INVALID_ID)
+    {
+        return std::find(m_pathOthers.begin(), m_pathOthers.end(), address) != m_pathOthers.end();
+    }
+    return id / 64 < m_pathNodes.size() && ((m_pathNodes[id / 64] >> (id % 64)) & 1);
+}
+
+bool
+WDsrOptionRreq::IsAnyInPath(const std::vector<Ipv4Address>& route) const
+{
+    for (const Ipv4Address& address : route)
+    {
+        if (IsInPath(address))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 uint8_t
 WDsrOptionRreq::Process(Ptr<Packet> packet,
                        Ptr<Packet> wdsrP,
@@ -589,26 +655,19 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
     p->CopyData(buf, sizeof(buf));
     uint8_t numberAddress = (buf[1] - 6) / 4;
     NS_LOG_DEBUG("The number of Ip addresses " << (uint32_t)numberAddress);
-    if (numberAddress >= 255)
+    if (numberAddress == 0 || numberAddress >= 255)
     {
-        NS_LOG_DEBUG("Discard the packet, malformed header since two many ip addresses in route");
+        NS_LOG_DEBUG("Discard the packet, malformed header since no or two many ip addresses in route");
         m_dropTrace(packet); // call the drop trace to show in the tracing
         return 0;
     }
 
     /*
-     * Create the wdsr rreq header
+     * Peek the rreq header without its addresses, they are only deserialized when a reply is
+     * sent or an error header is carried along
      */
     WDsrOptionRreqHeader rreq;
-    /*
-     * Set the number of addresses with the value from peek data and remove the rreq header
-     */
-    rreq.SetNumberAddress(numberAddress);
-    // Remove the route request header
-    NS_LOG_DEBUG("****************************************************************************");
-    NS_LOG_DEBUG("\[Node "<<node->GetId()<<"\] Deserialization of RREQ");                                
-    p->RemoveHeader(rreq);  // space for deserialize header
-    NS_LOG_DEBUG("****************************************************************************");
+    p->PeekHeader(rreq);
     // Verify the option length
     uint8_t length = rreq.GetLength();
     if (length % 2 != 0)
@@ -617,17 +676,24 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
         m_dropTrace(packet); // call drop trace
         return 0;
     }
+    // Copy the request as received and mark the nodes of its path
+    uint32_t fixedSize = rreq.GetSerializedSize();
+    uint32_t rreqSize = fixedSize + numberAddress * 4;
+    m_rreqData.resize(rreqSize + 4);
+    if (p->CopyData(m_rreqData.data(), rreqSize) != rreqSize)
+    {
+        NS_LOG_LOGIC("Malformed header. Drop!");
+        m_dropTrace(packet); // call drop trace
+        return 0;
+    }
+    MarkPath(m_rreqData.data() + fixedSize, numberAddress);
     // Check the rreq id for verifying the request id
     uint16_t requestId = rreq.GetId();
     // The target address is where we want to send the data packets
     Ipv4Address targetAddress = rreq.GetTarget();
-    // Get the node list and source address from the route request header
-    std::vector<Ipv4Address> mainVector = rreq.GetNodesAddresses();
-    std::vector<Ipv4Address> nodeList(mainVector);
     // Get the real source address of this request, it will be used when checking if we have
     // received the save route request before or not
-    Ipv4Address sourceAddress = nodeList.front();
-    PrintVector(nodeList);
+    Ipv4Address sourceAddress = Ipv4Address::Deserialize(m_rreqData.data() + fixedSize);
     /*
      * Construct the wdsr routing header for later use
      */
@@ -635,7 +701,7 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
     wdsrRoutingHeader.SetNextHeader(protocol);
     wdsrRoutingHeader.SetMessageType(1);
     wdsrRoutingHeader.SetSourceId(GetIDfromIP(source));
-    wdsrRoutingHeader.SetDestId(255);
+    wdsrRoutingHeader.SetDestId(WDsrFsHeader::BROADCAST_ID);
 
     // check whether we have received this request or not, if not, it will save the request in the
     // table for later use, if not found, return false, and push the newly received source request
@@ -667,7 +733,7 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
         return 0;
     }*/
 
-    if (CheckDuplicates(ipv4Address, nodeList))
+    if (IsInPath(ipv4Address))
     {
         /*
          * if the route contains the node address already, drop the request packet
@@ -689,9 +755,54 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
         }
         toPrev.SetTxCost(rreq.GetTxCost());        
         PrintVector(ip);
+        bool areThereDuplicates = IsAnyInPath(ip);
+        /*
+         * (iii) without an error header: forward the request as received with our address
+         * appended, only the fixed part of the rreq header is written again
+         */
+        if (targetAddress != ipv4Address && (!isRouteInCache || areThereDuplicates) &&
+            p->GetSize() == rreqSize)
+        {
+            NS_LOG_DEBUG("This is not the target, forward the request");
+            NS_ASSERT(sourceAddress == source);
+            Ptr<WDsrEnergyProvider> energy = node->GetObject<WDsrEnergyProvider>();
+            if (energy)
+            {
+                rreq.CalcLowestBat(energy->GetRemainingEnergy(), energy->GetInitialEnergy());
+            }
+            rreq.SetTxCost(rreq.GetTxCost() + 1);
+            rreq.SetLength(length + 4);
+            NS_LOG_DEBUG("The ttl value here " << (uint32_t)ttl);
+            if (ttl)
+            {
+                ipv4Address.Serialize(m_rreqData.data() + rreqSize);
+                Ptr<Packet> interP =
+                    Create<Packet>(m_rreqData.data() + fixedSize, rreqSize - fixedSize + 4);
+                interP->AddHeader(rreq);
+                wdsrRoutingHeader.SetPayloadLength(length + 6);
+                interP->AddHeader(wdsrRoutingHeader);
+                SocketIpTtlTag tag;
+                tag.SetTtl(ttl - 1);
+                interP->AddPacketTag(tag);
+                wdsr->ScheduleInterRequest(interP);
+                isPromisc = false;
+            }
+            return rreqSize + 4;
+        }
+
+        /*
+         * Set the number of addresses with the value from peek data and remove the rreq header
+         */
+        rreq.SetNumberAddress(numberAddress);
+        NS_LOG_DEBUG("****************************************************************************");
+        NS_LOG_DEBUG("\[Node "<<node->GetId()<<"\] Deserialization of RREQ");
+        p->RemoveHeader(rreq);
+        NS_LOG_DEBUG("****************************************************************************");
+        // Get the node list from the route request header
+        std::vector<Ipv4Address> mainVector = rreq.GetNodesAddresses();
+        std::vector<Ipv4Address> nodeList(mainVector);
+        PrintVector(nodeList);
         std::vector<Ipv4Address> saveRoute(nodeList);
-        PrintVector(saveRoute);
-        bool areThereDuplicates = IfDuplicates(ip, saveRoute);
         NS_LOG_DEBUG("Are there duplicates: "<<(bool) areThereDuplicates);
         /*
          *  When the reverse route is created or updated, the following actions on the route are
@@ -807,7 +918,10 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
                     {
                         NS_LOG_DEBUG("Added route link with lowestBat: "<<(int) rrep.GetLowestBat());
                         NS_LOG_DEBUG("Added route link with txCost: "<<(int) rrep.GetTxCost());          
-                        addRoute = wdsr->AddRoute_Link(m_finalRoute, ipv4Address);
+                        addRoute = wdsr->AddRoute_Link(m_finalRoute,
+                                                       ipv4Address,
+                                                       rrep.GetLowestBat(),
+                                                       rrep.GetTxCost());
                     }
                     else
                     {
@@ -934,7 +1048,10 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
                 {
                     NS_LOG_DEBUG("Added route link with lowestBat: "<<(int) rreq.GetLowestBat());
                     NS_LOG_DEBUG("Added route link with txCost: "<<(int) rreq.GetTxCost());          
-                    addRoute = wdsr->AddRoute_Link(saveRoute, ipv4Address);
+                    addRoute = wdsr->AddRoute_Link(saveRoute,
+                                                   ipv4Address,
+                                                   rreq.GetLowestBat(),
+                                                   rreq.GetTxCost());
                 }
                 else
                 {
@@ -1091,8 +1208,8 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
                     uint8_t length =
                         rreq.GetLength(); // Get the length of the rreq header excluding the type header
                    
-                    uint32_t nodeID =
-                        node->GetId();
+                    Ptr<WDsrEnergyProvider> energy =
+                        node->GetObject<WDsrEnergyProvider>();
                     uint8_t txCost = 
                         rreq.GetTxCost();
                     uint8_t placeholder =
@@ -1103,9 +1220,8 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
                     NS_LOG_DEBUG("**************************************");
                     NS_LOG_DEBUG("\[Node "<<node->GetId()<<"\]");
                     NS_LOG_FUNCTION(this<<" Calculating lowestBat:");
-                    if (source != ipv4Address){
-                        rreq.CalcLowestBat(/*remainingEnergy=*/remainingEnergy[nodeID],
-                                           /*initialEnergy=*/initialEnergy[nodeID]);
+                    if (source != ipv4Address && energy){
+                        rreq.CalcLowestBat(energy->GetRemainingEnergy(), energy->GetInitialEnergy());
                     }
                     rreq.SetTxCost(txCost+placeholder);
                         
@@ -1132,8 +1248,8 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
                     uint8_t length =
                         rreq.GetLength(); // Get the length of the rreq header excluding the type header
                    
-                    uint32_t nodeID =
-                        node->GetId();
+                    Ptr<WDsrEnergyProvider> energy =
+                        node->GetObject<WDsrEnergyProvider>();
                     uint8_t txCost = 
                         rreq.GetTxCost();
                     uint8_t placeholder =
@@ -1144,9 +1260,8 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
                     NS_LOG_DEBUG("**************************************");
                     NS_LOG_DEBUG("\[Node "<<node->GetId()<<"\]");
                     NS_LOG_FUNCTION(this<<" Calculating lowestBat:");
-                    if (source != ipv4Address){
-                        rreq.CalcLowestBat(/*remainingEnergy=*/remainingEnergy[nodeID],
-                                           /*initialEnergy=*/initialEnergy[nodeID]);
+                    if (source != ipv4Address && energy){
+                        rreq.CalcLowestBat(energy->GetRemainingEnergy(), energy->GetInitialEnergy());
                     }
                     rreq.SetTxCost(txCost+placeholder);
                     
@@ -1165,8 +1280,8 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
             
                 uint8_t length =
                     rreq.GetLength(); // Get the length of the rreq header excluding the type header
-                uint32_t nodeID =
-                    node->GetId();
+                Ptr<WDsrEnergyProvider> energy =
+                    node->GetObject<WDsrEnergyProvider>();
                 uint8_t txCost = 
                     rreq.GetTxCost();
                 uint8_t placeholder =
@@ -1177,9 +1292,8 @@ WDsrOptionRreq::Process(Ptr<Packet> packet,
                 NS_LOG_DEBUG("**************************************");
                 NS_LOG_DEBUG("\[Node "<<node->GetId()<<"\]");
                 NS_LOG_FUNCTION(this<<" Calculating lowestBat:");
-                if (source != ipv4Address){
-                    rreq.CalcLowestBat(/*remainingEnergy=*/remainingEnergy[nodeID],
-                                       /*initialEnergy=*/initialEnergy[nodeID]);
+                if (source != ipv4Address && energy){
+                    rreq.CalcLowestBat(energy->GetRemainingEnergy(), energy->GetInitialEnergy());
                 }
                 rreq.SetTxCost(txCost+placeholder);
                 NS_LOG_DEBUG("**************************************");
@@ -1320,7 +1434,10 @@ WDsrOptionRrep::Process(Ptr<Packet> packet,
             NS_LOG_DEBUG("Added route link with lowestBat: "<<(int) rrep.GetLowestBat());
             NS_LOG_DEBUG("Added route link with txCost: "<<(int) rrep.GetTxCost());
             NS_LOG_DEBUG("Added route link with ActiveRouteTimeout: "<<ActiveRouteTimeout);         
-            addRoute = wdsr->AddRoute_Link(nodeList, ipv4Address);
+            addRoute = wdsr->AddRoute_Link(nodeList,
+                                           ipv4Address,
+                                           rrep.GetLowestBat(),
+                                           rrep.GetTxCost());
         }
         else
         {
@@ -1403,7 +1520,10 @@ WDsrOptionRrep::Process(Ptr<Packet> packet,
             {
                 NS_LOG_DEBUG("Added route link with lowestBat: "<<(int) rrep.GetLowestBat());
                 NS_LOG_DEBUG("Added route link with txCost: "<<(int) rrep.GetTxCost());          
-                addRoute = wdsr->AddRoute_Link(nodeList, ipv4Address);
+                addRoute = wdsr->AddRoute_Link(nodeList,
+                                               ipv4Address,
+                                               rrep.GetLowestBat(),
+                                               rrep.GetTxCost());
             }
             else
             {
@@ -1515,19 +1635,24 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
     uint8_t buf[2];
     p->CopyData(buf, sizeof(buf));
     uint8_t numberAddress = (buf[1] - 2) / 4;
-    WDsrOptionSRHeader sourceRoute;
-    sourceRoute.SetNumberAddress(numberAddress);
-    p->RemoveHeader(sourceRoute);
-
-    // The route size saved in the source route
-    std::vector<Ipv4Address> nodeList = sourceRoute.GetNodesAddress();
-    uint8_t segsLeft = sourceRoute.GetSegmentsLeft();
-    uint8_t salvage = sourceRoute.GetSalvage();
     /*
-     * Get the node from IP address and get the WDSR extension object
+     * Copy the source route option as received, the addresses are read from it where they are
+     * and only deserialized for a promiscuously received packet
      */
-    Ptr<Node> node = GetNodeWithAddress(ipv4Address);
-    Ptr<wdsr::WDsrRouting> wdsr = node->GetObject<wdsr::WDsrRouting>();
+    uint32_t optionSize = 4 + numberAddress * 4;
+    m_sourceRouteData.resize(optionSize);
+    if (numberAddress == 0 || p->CopyData(m_sourceRouteData.data(), optionSize) != optionSize)
+    {
+        NS_LOG_LOGIC("Malformed header. Drop!");
+        m_dropTrace(packet);
+        return 0;
+    }
+    const uint8_t* addresses = m_sourceRouteData.data() + 4;
+    uint8_t segsLeft = m_sourceRouteData[3];
+    /*
+     * Get the WDSR extension object of our node
+     */
+    Ptr<wdsr::WDsrRouting> wdsr = WDsrNodeDirectory::GetRouting(ipv4Address);
     /*
      * Get the source and destination address from ipv4 header
      */
@@ -1535,7 +1660,7 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
     Ipv4Address destAddress = ipv4Header.GetDestination();
 
     // Get the node list destination
-    Ipv4Address destination = nodeList.back();
+    Ipv4Address destination = Ipv4Address::Deserialize(addresses + 4 * (numberAddress - 1));
     /*
      * If it's a promiscuous receive data packet,
      * 1. see if automatic route shortening possible or not
@@ -1544,6 +1669,10 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
     if (isPromisc)
     {
         NS_LOG_LOGIC("We process promiscuous receipt data packet");
+        WDsrOptionSRHeader sourceRoute;
+        sourceRoute.SetNumberAddress(numberAddress);
+        p->RemoveHeader(sourceRoute);
+        std::vector<Ipv4Address> nodeList = sourceRoute.GetNodesAddress();
         if (ContainAddressAfter(ipv4Address, destAddress, nodeList))
         {
             NS_LOG_LOGIC("Send back the gratuitous reply");
@@ -1557,13 +1686,16 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
         {
             NS_LOG_DEBUG("Process the promiscuously received packet");
             bool findPassive = false;
-            int32_t nNodes = NodeList::GetNNodes();
-            for (int32_t i = 0; i < nNodes; ++i)
+            uint32_t nNodes = WDsrNodeDirectory::GetNIds();
+            for (uint32_t i = 0; i < nNodes; ++i)
             {
                 NS_LOG_DEBUG("Working with node " << i);
 
-                Ptr<Node> node = NodeList::GetNode(i);
-                Ptr<wdsr::WDsrRouting> wdsrNode = node->GetObject<wdsr::WDsrRouting>();
+                Ptr<wdsr::WDsrRouting> wdsrNode = WDsrNodeDirectory::GetRouting(i);
+                if (!wdsrNode)
+                {
+                    continue;
+                }
                 // The source and destination addresses here are the real source and destination for
                 // the packet
                 findPassive = wdsrNode->PassiveEntryCheck(packet,
@@ -1589,8 +1721,7 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
                 PrintVector(nodeList);
 
                 NS_LOG_DEBUG("promisc source " << promiscSource);
-                Ptr<Node> node = GetNodeWithAddress(promiscSource);
-                Ptr<wdsr::WDsrRouting> wdsrSrc = node->GetObject<wdsr::WDsrRouting>();
+                Ptr<wdsr::WDsrRouting> wdsrSrc = WDsrNodeDirectory::GetRouting(promiscSource);
                 wdsrSrc->CancelPassiveTimer(packet, source, destination, segsLeft);
             }
             else
@@ -1613,14 +1744,14 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
         /*
          * Get the number of address from the source route header
          */
-        uint8_t length = sourceRoute.GetLength();
+        uint8_t length = m_sourceRouteData[1];
         uint8_t nextAddressIndex;
+        p->RemoveAtStart(optionSize);
         Ipv4Address nextAddress;
 
         // Get the option type value
-        uint32_t size = p->GetSize();
-        uint8_t* data = new uint8_t[size];
-        p->CopyData(data, size);
+        uint8_t data[4] = {0};
+        p->CopyData(data, sizeof(data));
         uint8_t optionType = 0;
         optionType = *(data);
         /// When the option type is 160, means there is ACK request header after the source route,
@@ -1633,29 +1764,24 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
             p->RemoveHeader(ackReq);
             uint16_t ackId = ackReq.GetAckId();
             /*
-             * Send back acknowledgment packet to the earlier hop
-             * If the node list is not empty, find the previous hop from the node list,
-             * otherwise, use srcAddress
+             * Send back acknowledgment packet to the earlier hop, found in the node list
              */
-            Ipv4Address ackAddress = srcAddress;
-            if (!nodeList.empty())
+            if (segsLeft > numberAddress) // The segmentsLeft field should not be larger than
+                                          // the total number of ip addresses
             {
-                if (segsLeft > numberAddress) // The segmentsLeft field should not be larger than
-                                              // the total number of ip addresses
-                {
-                    NS_LOG_LOGIC("Malformed header. Drop!");
-                    m_dropTrace(packet);
-                    return 0;
-                }
-                // -fstrict-overflow sensitive, see bug 1868
-                if (numberAddress - segsLeft < 2) // The index is invalid
-                {
-                    NS_LOG_LOGIC("Malformed header. Drop!");
-                    m_dropTrace(packet);
-                    return 0;
-                }
-                ackAddress = nodeList[numberAddress - segsLeft - 2];
+                NS_LOG_LOGIC("Malformed header. Drop!");
+                m_dropTrace(packet);
+                return 0;
             }
+            // -fstrict-overflow sensitive, see bug 1868
+            if (numberAddress - segsLeft < 2) // The index is invalid
+            {
+                NS_LOG_LOGIC("Malformed header. Drop!");
+                m_dropTrace(packet);
+                return 0;
+            }
+            Ipv4Address ackAddress =
+                Ipv4Address::Deserialize(addresses + 4 * (numberAddress - segsLeft - 2));
             m_ipv4Route = SetRoute(ackAddress, ipv4Address);
             NS_LOG_DEBUG("Send back ACK to the earlier hop " << ackAddress << " from us "
                                                              << ipv4Address);
@@ -1669,7 +1795,7 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
         {
             NS_LOG_DEBUG("This is the final destination");
             isPromisc = false;
-            return sourceRoute.GetSerializedSize();
+            return optionSize;
         }
 
         if (length % 2 != 0)
@@ -1687,26 +1813,21 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
             return 0;
         }
 
-        WDsrOptionSRHeader newSourceRoute;
-        newSourceRoute.SetSegmentsLeft(segsLeft - 1);
-        newSourceRoute.SetSalvage(salvage);
-        newSourceRoute.SetNodesAddress(nodeList);
         nextAddressIndex = numberAddress - segsLeft;
-        nextAddress = newSourceRoute.GetNodeAddress(nextAddressIndex);
+        nextAddress = Ipv4Address::Deserialize(addresses + 4 * nextAddressIndex);
         NS_LOG_DEBUG("The next address of source route option "
                      << nextAddress << " and the nextAddressIndex: " << (uint32_t)nextAddressIndex
                      << " and the segments left : " << (uint32_t)segsLeft);
         /*
          * Get the target Address in the node list
          */
-        Ipv4Address targetAddress = nodeList.back();
-        Ipv4Address realSource = nodeList.front();
+        Ipv4Address targetAddress = destination;
+        Ipv4Address realSource = Ipv4Address::Deserialize(addresses);
         /*
-         * Search the vector for next hop address
+         * Search the route for next hop address
          */
-        Ipv4Address nextHop = SearchNextHop(ipv4Address, nodeList);
+        Ipv4Address nextHop = SearchNextHop(ipv4Address, addresses, numberAddress);
         NS_LOG_DEBUG(">>7 nextHop " << nextHop);
-        PrintVector(nodeList);
 
         if (nextHop == "0.0.0.0")
         {
@@ -1718,8 +1839,7 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
         if (ipv4Address == nextHop)
         {
             NS_LOG_DEBUG("We have reached the destination");
-            newSourceRoute.SetSegmentsLeft(0);
-            return newSourceRoute.GetSerializedSize();
+            return optionSize;
         }
         // Verify the multicast address, leave it here for now
         if (nextAddress.IsMulticast() || destAddress.IsMulticast())
@@ -1730,16 +1850,22 @@ WDsrOptionSR::Process(Ptr<Packet> packet,
         // Set the route and forward the data packet
         SetRoute(nextAddress, ipv4Address);
         NS_LOG_DEBUG("wdsr packet size " << wdsrP->GetSize());
-        wdsr->ForwardPacket(wdsrP,
-                           newSourceRoute,
-                           ipv4Header,
+        /*
+         * Forward the source route option as received with the segments left decremented, the
+         * addresses are not serialized again
+         */
+        m_sourceRouteData[3] = segsLeft - 1;
+        Ptr<Packet> forwardP = Create<Packet>(m_sourceRouteData.data(), optionSize);
+        forwardP->AddAtEnd(wdsrP);
+        wdsr->ForwardPacket(forwardP,
+                           length,
+                           segsLeft - 1,
                            realSource,
                            nextAddress,
                            targetAddress,
-                           protocol,
-                           m_ipv4Route);
+                           protocol);
     }
-    return sourceRoute.GetSerializedSize();
+    return optionSize;
 }
 
 NS_OBJECT_ENSURE_REGISTERED(WDsrOptionRerr);
@@ -1790,9 +1916,8 @@ WDsrOptionRerr::Process(Ptr<Packet> packet,
     NS_LOG_FUNCTION(this << packet << wdsrP << ipv4Address << source << ipv4Header
                          << (uint32_t)protocol << isPromisc);
     Ptr<Packet> p = packet->Copy();
-    uint32_t size = p->GetSize();
-    uint8_t* data = new uint8_t[size];
-    p->CopyData(data, size);
+    uint8_t data[4] = {0};
+    p->CopyData(data, sizeof(data));
     uint8_t errorType = *(data + 2);
     /*
      * Get the node from Ip address and get the wdsr extension object
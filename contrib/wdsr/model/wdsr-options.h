@@ -57,6 +57,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 
 namespace ns3
 {
@@ -147,6 +148,15 @@ class WDsrOptions : public Object
      * \return the next hop address if found
      */
     Ipv4Address SearchNextHop(Ipv4Address ipv4Address, std::vector<Ipv4Address>& vec);
+    /**
+     * \brief Search for the next hop in a serialized route
+     *
+     * \param ipv4Address the IPv4 address of the node we are looking for its next hop address
+     * \param addresses the serialized IPv4 addresses
+     * \param number the number of addresses
+     * \return the next hop address if found
+     */
+    Ipv4Address SearchNextHop(Ipv4Address ipv4Address, const uint8_t* addresses, uint8_t number);
     /**
      * \brief Reverse search for the next hop in the route
      *
@@ -207,7 +217,7 @@ class WDsrOptions : public Object
      * \param address IPv4 address to look for ID
      * \return the id of the node
      */
-    uint32_t GetIDfromIP(Ipv4Address address);
+    uint16_t GetIDfromIP(Ipv4Address address);
     /**
      * \brief Get the node object with Ipv4Address
      *
@@ -390,6 +400,25 @@ class WDsrOptionRreq : public WDsrOptions
                     Ipv4Address promiscSource) override;
 
   private:
+    /**
+     * \brief Mark the nodes of the path of a request, clearing the path marked before
+     * \param addresses the serialized addresses of the path
+     * \param number the number of addresses
+     */
+    void MarkPath(const uint8_t* addresses, uint8_t number);
+    /**
+     * \brief Check if a node is in the path marked last
+     * \param address the address of the node
+     * \return true if the node is in the path
+     */
+    bool IsInPath(Ipv4Address address) const;
+    /**
+     * \brief Check if a node of a route is in the path marked last
+     * \param route the route
+     * \return true if any node of the route is in the path
+     */
+    bool IsAnyInPath(const std::vector<Ipv4Address>& route) const;
+
     /**
      * \brief The route cache.
      */
@@ -398,6 +427,22 @@ class WDsrOptionRreq : public WDsrOptions
      * \brief The ipv4.
      */
     Ptr<Ipv4> m_ipv4;
+    /**
+     * \brief The request being processed as received, with room for our address.
+     */
+    std::vector<uint8_t> m_rreqData;
+    /**
+     * \brief Bitset of the node ids in the path of the request.
+     */
+    std::vector<uint64_t> m_pathNodes;
+    /**
+     * \brief The node ids set in m_pathNodes.
+     */
+    std::vector<uint32_t> m_pathIds;
+    /**
+     * \brief The addresses in the path without a node id.
+     */
+    std::vector<Ipv4Address> m_pathOthers;
 };
 
 /**
@@ -488,6 +533,10 @@ class WDsrOptionSR : public WDsrOptions
      * \brief The ip layer 3.
      */
     Ptr<Ipv4> m_ipv4;
+    /**
+     * \brief The source route option being processed as received.
+     */
+    std::vector<uint8_t> m_sourceRouteData;
 };
 
 /**
@@ -34,21 +34,27 @@
 #include "wdsr-rcache.h"
 #include "wdsr-test.h"
 
+#include "ns3/abort.h"
 #include "ns3/address-utils.h"
 #include "ns3/ipv4-route.h"
 #include "ns3/log.h"
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
 #include "ns3/socket.h"
+#include "ns3/trace-source-accessor.h"
 #include "ns3/wifi-mac-header.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <list>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 namespace ns3
@@ -63,36 +69,92 @@ bool
 CompareRoutesBoth(const WDsrRouteCacheEntry& a, const WDsrRouteCacheEntry& b)
 {
     // compare based on both with hop count considered priority
-    return (a.GetVector().size() < b.GetVector().size()) ||
-           ((a.GetVector().size() == b.GetVector().size()) &&
-            (a.GetExpireTime() > b.GetExpireTime()));
+    return (a.GetVectorSize() < b.GetVectorSize()) ||
+           ((a.GetVectorSize() == b.GetVectorSize()) && (a.GetExpireTime() > b.GetExpireTime()));
 }
 
-bool
-CompareRoutesHops(const WDsrRouteCacheEntry& a, const WDsrRouteCacheEntry& b)
+WDsrCcmbcrPolicy::Context
+WDsrCcmbcrPolicy::MakeContext(const std::list<WDsrRouteCacheEntry>& routes)
 {
-    NS_LOG_DEBUG("-- Comparing based on hops");
-    NS_LOG_DEBUG("a.GetVector().size(): "<<a.GetVector().size()<<" < b.GetVector().size(): "<<b.GetVector().size());
-    // compare based on hops
-    return a.GetVector().size() < b.GetVector().size();
+    Context context;
+    context.m_threshold = γ;
+    context.m_mtpr = false;
+    for (std::list<WDsrRouteCacheEntry>::const_iterator i = routes.begin(); i != routes.end(); ++i)
+    {
+        if (i->GetLowestBat() > context.m_threshold)
+        {
+            context.m_mtpr = true;
+            break;
+        }
+    }
+    return context;
 }
 
-bool
-CompareLowestBat(const WDsrRouteCacheEntry& a, const WDsrRouteCacheEntry& b)
+void
+WDsrCcmbcrPolicy::Count(const Context& context,
+                        const std::list<WDsrRouteCacheEntry>& routes,
+                        WDsrRouteCacheStats& stats)
 {
-    NS_LOG_DEBUG("-- Comparing based on lowestBat");
-    // compare based on hops
-    NS_LOG_DEBUG("a.GetLowestBat(): "<<(int) a.GetLowestBat()<<" <= b.GetLowestBat(): "<<(int) b.GetLowestBat());
-    return a.GetLowestBat() >= b.GetLowestBat();
+    if (!context.m_mtpr)
+    {
+        ++stats.m_mmbcrSelections;
+        return;
+    }
+    ++stats.m_mtprSelections;
+    for (std::list<WDsrRouteCacheEntry>::const_iterator i = routes.begin(); i != routes.end(); ++i)
+    {
+        if (i->GetLowestBat() < context.m_threshold)
+        {
+            ++stats.m_filteredRoutes;
+        }
+    }
 }
 
-bool
-CompareTxCost(const WDsrRouteCacheEntry& a, const WDsrRouteCacheEntry& b)
+WDsrRouteCacheStats::WDsrRouteCacheStats()
+    : m_lookups(0),
+      m_hits(0),
+      m_misses(0),
+      m_subRouteHits(0),
+      m_mtprSelections(0),
+      m_mmbcrSelections(0),
+      m_filteredRoutes(0),
+      m_purgedRoutes(0),
+      m_droppedRoutes(0),
+      m_purgedLinks(0),
+      m_rebuilds(0),
+      m_repairs(0),
+      m_rebuildTime(Seconds(0))
 {
-    NS_LOG_DEBUG("-- Comparing based on txCost");
-    // compare based on hops
-    NS_LOG_DEBUG("a.GetTxCost(): "<<(int) a.GetTxCost()<<" <= b.GetTxCost(): "<<(int) b.GetTxCost());
-    return a.GetTxCost() <= b.GetTxCost();
+}
+
+WDsrRouteCacheStats&
+WDsrRouteCacheStats::operator+=(const WDsrRouteCacheStats& o)
+{
+    m_lookups += o.m_lookups;
+    m_hits += o.m_hits;
+    m_misses += o.m_misses;
+    m_subRouteHits += o.m_subRouteHits;
+    m_mtprSelections += o.m_mtprSelections;
+    m_mmbcrSelections += o.m_mmbcrSelections;
+    m_filteredRoutes += o.m_filteredRoutes;
+    m_purgedRoutes += o.m_purgedRoutes;
+    m_droppedRoutes += o.m_droppedRoutes;
+    m_purgedLinks += o.m_purgedLinks;
+    m_rebuilds += o.m_rebuilds;
+    m_repairs += o.m_repairs;
+    m_rebuildTime += o.m_rebuildTime;
+    return *this;
+}
+
+void
+WDsrRouteCacheStats::Print(std::ostream& os) const
+{
+    os << "lookups " << m_lookups << " hits " << m_hits << " misses " << m_misses
+       << " subRouteHits " << m_subRouteHits << " mtpr " << m_mtprSelections << " mmbcr "
+       << m_mmbcrSelections << " filtered " << m_filteredRoutes << " purged " << m_purgedRoutes
+       << " dropped " << m_droppedRoutes << " purgedLinks " << m_purgedLinks << " rebuilds "
+       << m_rebuilds << " rebuildTime " << m_rebuildTime.As(Time::US) << " repairs "
+       << m_repairs;
 }
 
 bool
@@ -109,7 +171,8 @@ Link::Print() const
 }
 
 WDsrNodeStab::WDsrNodeStab(Time nodeStab)
-    : m_nodeStability(nodeStab + Simulator::Now())
+    : m_nodeStability(nodeStab + Simulator::Now()),
+      m_battery(0x3f)
 {
 }
 
@@ -118,7 +181,8 @@ WDsrNodeStab::~WDsrNodeStab()
 }
 
 WDsrLinkStab::WDsrLinkStab(Time linkStab)
-    : m_linkStability(linkStab + Simulator::Now())
+    : m_linkStability(linkStab + Simulator::Now()),
+      m_txCost(1)
 {
 }
 
@@ -129,20 +193,172 @@ WDsrLinkStab::~WDsrLinkStab()
 void
 WDsrLinkStab::Print() const
 {
-    NS_LOG_LOGIC("LifeTime: " << GetLinkStability().As(Time::S));
+    NS_LOG_LOGIC("LifeTime: " << GetLinkStability().As(Time::S) << " txCost: " << (int)m_txCost);
+}
+
+WDsrPath::WDsrPath(Ptr<WDsrPath> parent, uint16_t node)
+    : m_parent(parent),
+      m_node(node),
+      m_size(parent ? parent->m_size + 1 : 1)
+{
+}
+
+WDsrPath::~WDsrPath()
+{
+    NS_ASSERT(m_children.empty());
+    Children& siblings = GetSiblings();
+    Children::iterator i = FindChild(siblings, m_node);
+    NS_ASSERT(i != siblings.end() && i->second == this);
+    siblings.erase(i);
+}
+
+WDsrPath::Children::iterator
+WDsrPath::FindChild(Children& children, uint16_t node)
+{
+    return std::lower_bound(children.begin(),
+                            children.end(),
+                            node,
+                            [](const std::pair<uint16_t, WDsrPath*>& child, uint16_t n) {
+                                return child.first < n;
+                            });
+}
+
+WDsrPath::Children&
+WDsrPath::GetRoots()
+{
+    // Never destroyed, the paths still held by other static objects are released after it
+    static Children* roots = new Children();
+    return *roots;
+}
+
+WDsrPath::Children&
+WDsrPath::GetSiblings() const
+{
+    return m_parent ? m_parent->m_children : GetRoots();
+}
+
+WDsrPath::NodeIds&
+WDsrPath::GetNodeIds()
+{
+    static NodeIds nodeIds = {};
+    return nodeIds;
+}
+
+void
+WDsrPath::ClearNodeIds()
+{
+    NodeIds& nodeIds = GetNodeIds();
+    nodeIds.m_destroyScheduled = false;
+    // The ids of a path still interned must keep their address
+    if (!GetRoots().empty())
+    {
+        NS_LOG_WARN("Paths are still interned, the node ids are kept");
+        return;
+    }
+    nodeIds.m_ids.clear();
+    nodeIds.m_addresses.clear();
+}
+
+uint16_t
+WDsrPath::GetNodeId(Ipv4Address address)
+{
+    NodeIds& nodeIds = GetNodeIds();
+    if (!nodeIds.m_destroyScheduled)
+    {
+        Simulator::ScheduleDestroy(&WDsrPath::ClearNodeIds);
+        nodeIds.m_destroyScheduled = true;
+    }
+    std::map<Ipv4Address, uint16_t>::const_iterator i = nodeIds.m_ids.find(address);
+    if (i != nodeIds.m_ids.end())
+    {
+        return i->second;
+    }
+    NS_ABORT_MSG_IF(nodeIds.m_addresses.size() >= std::numeric_limits<uint16_t>::max(),
+                    "Too many nodes for 16-bit path ids");
+    uint16_t id = nodeIds.m_addresses.size();
+    nodeIds.m_ids.insert(std::make_pair(address, id));
+    nodeIds.m_addresses.push_back(address);
+    return id;
+}
+
+Ipv4Address
+WDsrPath::GetNodeAddress(uint16_t id)
+{
+    return GetNodeIds().m_addresses[id];
+}
+
+Ptr<WDsrPath>
+WDsrPath::Extend(Ptr<WDsrPath> parent, Ipv4Address address)
+{
+    uint16_t node = GetNodeId(address);
+    Children& children = parent ? parent->m_children : GetRoots();
+    Children::iterator i = FindChild(children, node);
+    if (i != children.end() && i->first == node)
+    {
+        return Ptr<WDsrPath>(i->second);
+    }
+    Ptr<WDsrPath> path = Create<WDsrPath>(parent, node);
+    children.insert(i, std::make_pair(node, PeekPointer(path)));
+    return path;
+}
+
+Ptr<WDsrPath>
+WDsrPath::Intern(const std::vector<Ipv4Address>& ip)
+{
+    Ptr<WDsrPath> path;
+    for (std::vector<Ipv4Address>::const_iterator i = ip.begin(); i != ip.end(); ++i)
+    {
+        path = Extend(path, *i);
+    }
+    return path;
+}
+
+std::vector<Ipv4Address>
+WDsrPath::GetVector() const
+{
+    std::vector<Ipv4Address> ip(m_size);
+    const WDsrPath* path = this;
+    for (uint32_t i = m_size; i > 0; --i)
+    {
+        ip[i - 1] = GetNodeAddress(path->m_node);
+        path = PeekPointer(path->m_parent);
+    }
+    return ip;
+}
+
+const WDsrHeaderTemplate*
+WDsrPath::GetHeaderTemplate(uint8_t protocol) const
+{
+    for (std::list<WDsrHeaderTemplate>::const_iterator i = m_headerTemplates.begin();
+         i != m_headerTemplates.end();
+         ++i)
+    {
+        if (i->protocol == protocol)
+        {
+            return &(*i);
+        }
+    }
+    return nullptr;
+}
+
+const WDsrHeaderTemplate&
+WDsrPath::SetHeaderTemplate(const WDsrHeaderTemplate& headerTemplate)
+{
+    NS_ASSERT(!GetHeaderTemplate(headerTemplate.protocol));
+    m_headerTemplates.push_back(headerTemplate);
+    return m_headerTemplates.back();
 }
 
 typedef std::list<WDsrRouteCacheEntry>::value_type route_pair;
 
 WDsrRouteCacheEntry::WDsrRouteCacheEntry(IP_VECTOR const& ip, Ipv4Address dst, Time exp, uint8_t lowestBat, uint8_t txCost)
-    : m_ackTimer(Timer::CANCEL_ON_DESTROY),
-      m_dst(dst),
-      m_path(ip),
-      m_expire(exp + Simulator::Now()),
+    : m_dst(dst),
+      m_path(WDsrPath::Intern(ip)),
       m_lowestBat(lowestBat),
       m_txCost(txCost),
       m_reqCount(0),
       m_blackListState(false),
+      m_expire(exp + Simulator::Now()),
       m_blackListTimeout(Simulator::Now())
 {
 }
@@ -196,23 +412,39 @@ WDsrRouteCache::GetTypeId()
     static TypeId tid = TypeId("ns3::wdsr::WDsrRouteCache")
                             .SetParent<Object>()
                             .SetGroupName("WDsr")
-                            .AddConstructor<WDsrRouteCache>();
+                            .AddConstructor<WDsrRouteCache>()
+                            .AddTraceSource("Lookup",
+                                            "A route lookup, tells if a route was found.",
+                                            MakeTraceSourceAccessor(&WDsrRouteCache::m_lookupTrace),
+                                            "ns3::wdsr::WDsrRouteCache::LookupTracedCallback")
+                            .AddTraceSource("Evict",
+                                            "A route removed from the path cache.",
+                                            MakeTraceSourceAccessor(&WDsrRouteCache::m_evictTrace),
+                                            "ns3::wdsr::WDsrRouteCache::EvictTracedCallback")
+                            .AddTraceSource(
+                                "Rebuild",
+                                "A full rebuild of the link cache best route tree.",
+                                MakeTraceSourceAccessor(&WDsrRouteCache::m_rebuildTrace),
+                                "ns3::wdsr::WDsrRouteCache::RebuildTracedCallback");
     return tid;
 }
 
 WDsrRouteCache::WDsrRouteCache()
     : m_vector(0),
+      m_selectedThreshold(0),
       m_maxEntriesEachDst(5),
       m_isLinkCache(false),
-      m_ntimer(Timer::CANCEL_ON_DESTROY),
-      m_delay(MilliSeconds(100))
+      m_treeValid(false),
+      m_incrementalUpdate(true),
+      m_widestValid(false),
+      m_ntimer(Timer::CANCEL_ON_DESTROY)
 {
     /*
      * The timer to set layer 2 notification, not fully supported by ns3 yet
      */
-    m_ntimer.SetDelay(m_delay);
     m_ntimer.SetFunction(&WDsrRouteCache::PurgeMac, this);
     m_txErrorCallback = MakeCallback(&WDsrRouteCache::ProcessTxError, this);
+    SetRoutePolicy("CCMBCR");
 }
 
 WDsrRouteCache::~WDsrRouteCache()
@@ -220,6 +452,9 @@ WDsrRouteCache::~WDsrRouteCache()
     NS_LOG_FUNCTION_NOARGS();
     // clear the route cache when done
     m_sortedRoutes.clear();
+    m_nodeIndex.clear();
+    m_linkIndex.clear();
+    m_selectedRoutes.clear();
 }
 
 void
@@ -234,128 +469,145 @@ bool
 WDsrRouteCache::UpdateRouteEntry(Ipv4Address dst)
 {
     NS_LOG_FUNCTION(this << dst);
-    NS_LOG_DEBUG("Bruger jeg det her?");
-    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator i =
-        m_sortedRoutes.find(dst);
+    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator i = m_sortedRoutes.find(dst);
     if (i == m_sortedRoutes.end())
     {
         NS_LOG_LOGIC("Failed to find the route entry for the destination " << dst);
         return false;
     }
+    std::list<WDsrRouteCacheEntry>& rtVector = i->second;
+    // The refreshed entry is the one handed out by the lookup, the selection does not change
+    WDsrRouteCacheEntry& successEntry = *SelectRoute(dst, rtVector);
+    successEntry.SetExpireTime(RouteCacheTimeout);
+    ScheduleExpiry(dst, successEntry.GetExpireAt());
+    PrintRouteVector(rtVector);
+    return true;
+}
+
+bool
+WDsrRouteCache::LookupRoute(Ipv4Address id, WDsrRouteCacheEntry& rt)
+{
+    NS_LOG_FUNCTION(this << id);
+    bool subRoute = false;
+    bool found = IsLinkCache() ? LookupRoute_Link(id, rt) : LookupRoute_Path(id, rt, subRoute);
+    ++m_stats.m_lookups;
+    if (found)
+    {
+        ++m_stats.m_hits;
+        if (subRoute)
+        {
+            ++m_stats.m_subRouteHits;
+        }
+    }
     else
     {
-        std::list<WDsrRouteCacheEntry> rtVector = i->second;
-        WDsrRouteCacheEntry successEntry = rtVector.front();
-        successEntry.SetExpireTime(RouteCacheTimeout);
-        rtVector.pop_front();
-        rtVector.push_back(successEntry);
-        NS_LOG_DEBUG("Bliver der compared? >> 1");
-        rtVector.sort(CompareRoutesHops); // sort the route vector first
-        m_sortedRoutes.erase(dst);          // erase the entry first
-        /*
-         * Save the new route cache along with the destination address in map
-         */
-        NS_LOG_DEBUG("Jepsen "<<dst);
-        PrintRouteVector(rtVector);
-        std::pair<std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator, bool> result =
-            m_sortedRoutes.insert(std::make_pair(dst, rtVector));
-        return result.second;
+        ++m_stats.m_misses;
     }
-    return false;
+    m_lookupTrace(id, found, subRoute);
+    return found;
 }
 
 bool
-WDsrRouteCache::LookupRoute(Ipv4Address id, WDsrRouteCacheEntry& rt)
+WDsrRouteCache::LookupRoute_Path(Ipv4Address id, WDsrRouteCacheEntry& rt, bool& subRoute)
 {
     NS_LOG_FUNCTION(this << id);
-    if (IsLinkCache())
+    Purge(); // Purge first to remove expired entries
+    if (m_sortedRoutes.empty())
     {
-        return LookupRoute_Link(id, rt);
+        NS_LOG_LOGIC("Route to " << id << " not found; m_sortedRoutes is empty");
+        return false;
     }
-    else
+    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator i =
+        m_sortedRoutes.find(id);
+    if (i == m_sortedRoutes.end())
     {
-        Purge(); // Purge first to remove expired entries
-        if (m_sortedRoutes.empty())
+        NS_LOG_LOGIC("No Direct Route to " << id << " found");
+        /*
+         * Only the destinations whose routes pass through id are visited, the node index
+         * tells which ones they are
+         */
+        std::map<Ipv4Address, std::map<Ipv4Address, uint32_t>>::const_iterator n =
+            m_nodeIndex.find(id);
+        if (n == m_nodeIndex.end())
         {
-            NS_LOG_LOGIC("Route to " << id << " not found; m_sortedRoutes is empty");
+            NS_LOG_LOGIC("No cached route goes through " << id);
             return false;
         }
-        std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator i =
-            m_sortedRoutes.find(id);
-        if (i == m_sortedRoutes.end())
+        WDsrRouteCacheEntry changeEntry; // Create the route entry
+        bool foundSubRoute = false;
+        for (std::map<Ipv4Address, uint32_t>::const_iterator j = n->second.begin();
+             j != n->second.end();
+             ++j)
         {
-            NS_LOG_LOGIC("No Direct Route to " << id << " found");
-            for (std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator j =
-                     m_sortedRoutes.begin();
-                 j != m_sortedRoutes.end();
-                 ++j)
+            std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator m =
+                m_sortedRoutes.find(j->first);
+            NS_ASSERT_MSG(m != m_sortedRoutes.end(), "Node index out of sync for " << id);
+            const std::list<WDsrRouteCacheEntry>& rtVector = m->second;
+            /*
+             * Loop through the possibly multiple routes within the route vector
+             */
+            for (std::list<WDsrRouteCacheEntry>::const_iterator k = rtVector.begin();
+                 k != rtVector.end();
+                 ++k)
             {
-                std::list<WDsrRouteCacheEntry> rtVector =
-                    j->second; // The route cache vector linked with destination address
+                if (k->GetVectorSize() < 3)
+                {
+                    continue;
+                }
                 /*
-                 * Loop through the possibly multiple routes within the route vector
+                 * The sub route is the prefix of the route ending at id, it is found by
+                 * walking up the path from the hop before the last one
                  */
-                for (std::list<WDsrRouteCacheEntry>::const_iterator k = rtVector.begin();
-                     k != rtVector.end();
-                     ++k)
+                Ptr<WDsrPath> prefix = k->GetPath()->GetParent();
+                while (prefix->GetSize() > 1 && prefix->GetAddress() != id)
                 {
-                    // return the first route in the route vector
-                    WDsrRouteCacheEntry::IP_VECTOR routeVector = k->GetVector();
-                    WDsrRouteCacheEntry::IP_VECTOR changeVector;
-
-                    for (WDsrRouteCacheEntry::IP_VECTOR::iterator l = routeVector.begin();
-                         l != routeVector.end();
-                         ++l)
-                    {
-                        if (*l != id)
-                        {
-                            changeVector.push_back(*l);
-                        }
-                        else
-                        {
-                            changeVector.push_back(*l);
-                            break;
-                        }
-                    }
-                    /*
-                     * When the changed vector is smaller in size and larger than 1, which means we
-                     * have found a route with the destination address we are looking for
-                     */
-                    if ((changeVector.size() < routeVector.size()) && (changeVector.size() > 1))
+                    prefix = prefix->GetParent();
+                }
+                /*
+                 * The route reaches id before its end, which means we have found a route with
+                 * the destination address we are looking for
+                 */
+                if (prefix->GetSize() > 1)
+                {
+                    WDsrRouteCacheEntry subEntry;
+                    subEntry.SetPath(prefix);
+                    subEntry.SetDestination(id);
+                    // Use the expire time from original route entry
+                    subEntry.SetExpireTime(k->GetExpireTime());
+                    // Keep the shortest sub route, the longest lived one among equals
+                    if (!foundSubRoute || CompareRoutesBoth(subEntry, changeEntry))
                     {
-                        WDsrRouteCacheEntry changeEntry; // Create the route entry
-                        changeEntry.SetVector(changeVector);
-                        changeEntry.SetDestination(id);
-                        // Use the expire time from original route entry
-                        changeEntry.SetExpireTime(k->GetExpireTime());
-                        // We need to add new route entry here
-                        std::list<WDsrRouteCacheEntry> newVector;
-                        newVector.push_back(changeEntry);
-                        NS_LOG_DEBUG("Bliver der compared? >> 2");
-                        newVector.sort(CompareRoutesHops); // sort the route vector first
-                        m_sortedRoutes[id] =
-                            newVector; // Only get the first sub route and add it in route cache
-                        NS_LOG_INFO("We have a sub-route to " << id << " add it in route cache");
+                        changeEntry = subEntry;
+                        foundSubRoute = true;
                     }
                 }
             }
         }
-        NS_LOG_INFO("Here we check the route cache again after updated the sub routes");
-        std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator m =
-            m_sortedRoutes.find(id);
-        if (m == m_sortedRoutes.end())
+        if (foundSubRoute)
         {
-            NS_LOG_LOGIC("No updated route till last time");
-            return false;
+            // We need to add new route entry here
+            m_sortedRoutes[id].push_back(changeEntry);
+            IndexRoute(id, changeEntry);
+            ScheduleExpiry(id, changeEntry.GetExpireAt());
+            subRoute = true;
+            NS_LOG_INFO("We have a sub-route to " << id << " add it in route cache");
         }
-        /*
-         * We have a direct route to the destination address
-         */
-        std::list<WDsrRouteCacheEntry> rtVector = m->second;
-        rt = rtVector.front(); // use the first entry in the route vector
-        NS_LOG_LOGIC("Route to " << id << " with route size " << rtVector.size());
-        return true;
     }
+    NS_LOG_INFO("Here we check the route cache again after updated the sub routes");
+    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator m =
+        m_sortedRoutes.find(id);
+    if (m == m_sortedRoutes.end())
+    {
+        NS_LOG_LOGIC("No updated route till last time");
+        return false;
+    }
+    /*
+     * We have a direct route to the destination address
+     */
+    std::list<WDsrRouteCacheEntry>& rtVector = m->second;
+    rt = *SelectRoute(id, rtVector); // use the route selected by the CCMBCR policy
+    NS_LOG_LOGIC("Route to " << id << " with route size " << rtVector.size());
+    return true;
 }
 
 void
@@ -377,6 +629,36 @@ WDsrRouteCache::SetCacheType(std::string type)
     }
 }
 
+void
+WDsrRouteCache::SetRoutePolicy(std::string policy)
+{
+    NS_LOG_FUNCTION(this << policy);
+    if (policy == std::string("HopCount"))
+    {
+        m_policy = HOP_COUNT;
+    }
+    else if (policy == std::string("MMBCR"))
+    {
+        m_policy = MMBCR;
+    }
+    else if (policy == std::string("MTPR"))
+    {
+        m_policy = MTPR;
+    }
+    else
+    {
+        if (policy != std::string("CCMBCR"))
+        {
+            NS_FATAL_ERROR("Unknown route policy " << policy
+                                                   << ", use HopCount, MMBCR, MTPR or CCMBCR");
+        }
+        m_policy = CCMBCR;
+    }
+    m_routePolicy = policy;
+    // The memoized routes were selected with the previous policy
+    m_selectedRoutes.clear();
+}
+
 bool
 WDsrRouteCache::IsLinkCache()
 {
@@ -388,250 +670,544 @@ void
 WDsrRouteCache::RebuildBestRouteTable(Ipv4Address source)
 {
     NS_LOG_FUNCTION(this << source);
-    NS_LOG_DEBUG("**************************************************");
-    NS_LOG_DEBUG("Rebuilding best route table for:  "<<source);
+    NS_LOG_DEBUG("Rebuilding best route table for:  " << source);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     /**
      * \brief The following are initialize-single-source
      */
-    // @d shortest-path estimate
-    std::map<Ipv4Address, uint32_t> d;
-    // @pre preceding node
-    std::map<Ipv4Address, Ipv4Address> pre;
-    NS_LOG_DEBUG("------------------- 1");
-    for (std::map<Ipv4Address, std::map<Ipv4Address, uint32_t>>::iterator i = m_netGraph.begin();
-         i != m_netGraph.end();
-         ++i)
+    m_treeSource = source;
+    m_widestValid = false;
+    m_treeDist.assign(m_graphAddresses.size(), std::numeric_limits<uint32_t>::max());
+    m_treePre.assign(m_graphAddresses.size(), std::numeric_limits<uint32_t>::max());
+    std::map<Ipv4Address, uint32_t>::const_iterator src = m_graphIds.find(source);
+    if (src == m_graphIds.end())
     {
-        if (i->second.find(source) != i->second.end())
-        {
-            NS_LOG_DEBUG("d[i->first] = "<<i->second[source]);   
-            d[i->first] = i->second[source];
-            NS_LOG_DEBUG("pre[i->first] = "<<source);
-            pre[i->first] = source;
-        }
-        else
-        {
-            NS_LOG_DEBUG("d[i->first] = "<<0xFFFF);
-            d[i->first] = MAXWEIGHT;
-            NS_LOG_DEBUG("pre[i->first] = "<<Ipv4Address("255.255.255.255"));
-            pre[i->first] = Ipv4Address("255.255.255.255");
-        }
+        NS_LOG_LOGIC("The source " << source << " has no link in the link cache");
+        m_treeValid = false;
+        return;
     }
-    d[source] = 0;
+    m_treeValid = true;
     /**
      * \brief The following is the core of Dijkstra algorithm
      */
-    // the node set which shortest distance has been calculated, if true calculated
-    std::map<Ipv4Address, bool> s;
-    double temp = MAXWEIGHT;
-    Ipv4Address tempip = Ipv4Address("255.255.255.255");
-    
-    for (uint32_t i = 0; i < m_netGraph.size(); i++)
-    {
-        NS_LOG_DEBUG("------------------- 2");
-        NS_LOG_DEBUG("i = "<<(int)i);
-        temp = MAXWEIGHT;
-        NS_LOG_DEBUG("-- 2.1");
-
-        for (std::map<Ipv4Address, uint32_t>::const_iterator j = d.begin(); j != d.end(); ++j)
-        {
-            
-            NS_LOG_DEBUG("ip = "<<j->first);
-            Ipv4Address ip = j->first;
-            if (s.find(ip) == s.end())
-            {
-                NS_LOG_DEBUG("-- 2.2");
-                /*
-                 * \brief The followings are for comparison
-                 */
-                if (j->second <= temp)
-                {
-                    NS_LOG_DEBUG("-- 2.3");
-                    NS_LOG_DEBUG("temp = "<<j->second);
-                    temp = j->second;
-                    NS_LOG_DEBUG("tempip = "<<ip);
-                    tempip = ip;
-                }
-            }
-        }
-        if (!tempip.IsBroadcast())
-        {
-            NS_LOG_DEBUG("------------------- 3");
-            s[tempip] = true;
-            for (std::map<Ipv4Address, uint32_t>::const_iterator k = m_netGraph[tempip].begin();
-                 k != m_netGraph[tempip].end();
-                 ++k)
-            {
+    TreeHeap heap;
+    m_treeDist[src->second] = 0;
+    heap.push(std::make_pair(0, src->second));
+    PropagateTree(heap);
+    std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    Time duration = NanoSeconds(elapsed.count());
+    ++m_stats.m_rebuilds;
+    m_stats.m_rebuildTime += duration;
+    m_rebuildTrace(source, duration);
+}
 
-                if (s.find(k->first) == s.end() && d[k->first] > d[tempip] + k->second)
-                {
-                    NS_LOG_DEBUG("-- 3.1");
-                    NS_LOG_DEBUG("d[k->first] = "<<d[tempip] + k->second);
-                    d[k->first] = d[tempip] + k->second;
-                    NS_LOG_DEBUG("pre[k->first] = "<<tempip);
-                    pre[k->first] = tempip;
-                }
-                /*
-                 *  Selects the shortest-length route that has the longest expected lifetime
-                 *  (highest minimum timeout of any link in the route)
-                 *  For the computation overhead and complexity
-                 *  Here I just implement kind of greedy strategy to select link with the longest
-                 * expected lifetime when there is two options
-                 */
-                else if (d[k->first] == d[tempip] + k->second)
-                {
-                    NS_LOG_DEBUG("-- 3.2");
-                    std::map<Link, WDsrLinkStab>::iterator oldlink =
-                        m_linkCache.find(Link(k->first, pre[k->first]));
-                    std::map<Link, WDsrLinkStab>::iterator newlink =
-                        m_linkCache.find(Link(k->first, tempip));
-                    if (oldlink != m_linkCache.end() && newlink != m_linkCache.end())
-                    {
-                        NS_LOG_DEBUG("-- 3.3");
-                        if (oldlink->second.GetLinkStability() < newlink->second.GetLinkStability())
-                        {
-                            NS_LOG_DEBUG("-- 3.4");
-                            NS_LOG_INFO("Select the link with longest expected lifetime");
-                            d[k->first] = d[tempip] + k->second;
-                            pre[k->first] = tempip;
-                        }
-                    }
-                    else
-                    {
-                        NS_LOG_INFO("Link Stability Info Corrupt");
-                    }
-                }
-            }
-        }
-    }
-    // clean the best route table
-    m_bestRoutesTable_link.clear();
-    NS_LOG_DEBUG("------------------- 4");
-    for (std::map<Ipv4Address, Ipv4Address>::iterator i = pre.begin(); i != pre.end(); ++i)
+void
+WDsrRouteCache::PropagateTree(TreeHeap& heap)
+{
+    NS_LOG_FUNCTION(this);
+    while (!heap.empty())
     {
-        // loop for all vertices
-        WDsrRouteCacheEntry::IP_VECTOR route;
-        Ipv4Address iptemp = i->first;
-
-        if (!i->second.IsBroadcast() && iptemp != source)
+        uint32_t dist = heap.top().first;
+        uint32_t u = heap.top().second;
+        heap.pop();
+        // Skip the outdated heap entries, the node has been reached with a shorter distance
+        if (dist != m_treeDist[u])
         {
-            NS_LOG_DEBUG("-- 4.1");
-            while (iptemp != source)
-            {
-                route.push_back(iptemp);
-                iptemp = pre[iptemp];
-            }
-            route.push_back(source);
-            // Reverse the route
-            WDsrRouteCacheEntry::IP_VECTOR reverseroute;
-            NS_LOG_DEBUG("-- 4.2");
-            for (WDsrRouteCacheEntry::IP_VECTOR::reverse_iterator j = route.rbegin();
-                 j != route.rend();
-                 ++j)
+            continue;
+        }
+        for (std::vector<GraphEdge>::const_iterator k = m_netGraph[u].begin();
+             k != m_netGraph[u].end();
+             ++k)
+        {
+            if (RelaxLink(u, k->m_to, k->m_weight))
             {
-                reverseroute.push_back(*j);
+                heap.push(std::make_pair(m_treeDist[k->m_to], k->m_to));
             }
-            NS_LOG_LOGIC("Add newly calculated best routes");
-            NS_LOG_DEBUG("-- 4.3");
-            NS_LOG_DEBUG("Add newly calculated best routes");
-            PrintVector(reverseroute);
-            m_bestRoutesTable_link[i->first] = reverseroute;
         }
     }
 }
 
 bool
-WDsrRouteCache::LookupRoute_Link(Ipv4Address id, WDsrRouteCacheEntry& rt)
+WDsrRouteCache::RelaxLink(uint32_t from, uint32_t to, uint32_t weight)
 {
-    NS_LOG_FUNCTION(this << id);
-    /// We need to purge the link node cache
-    PurgeLinkNode();
-    std::map<Ipv4Address, WDsrRouteCacheEntry::IP_VECTOR>::const_iterator i =
-        m_bestRoutesTable_link.find(id);
-    if (i == m_bestRoutesTable_link.end())
+    if (m_treeDist[from] == std::numeric_limits<uint32_t>::max())
     {
-        NS_LOG_INFO("No route find to " << id);
         return false;
     }
-    else
+    // ! WDSR-M Routing protocol (CCMBCR), only the nodes above the threshold forward (MTPR)
+    if (m_graphAddresses[from] != m_treeSource && !IsRelay(from))
     {
-        if (i->second.size() < 2)
-        {
-            NS_LOG_LOGIC("Route to " << id << " error");
-            return false;
-        }
-
-        WDsrRouteCacheEntry newEntry; // Create the route entry
-        newEntry.SetVector(i->second);
-        newEntry.SetDestination(id);
-        newEntry.SetExpireTime(RouteCacheTimeout);
-        NS_LOG_INFO("Route to " << id << " found with the length " << i->second.size());
-        rt = newEntry;
-        std::vector<Ipv4Address> path = rt.GetVector();
-        PrintVector(path);
+        return false;
+    }
+    uint32_t dist = m_treeDist[from] + weight;
+    if (m_treeDist[to] > dist)
+    {
+        m_treeDist[to] = dist;
+        m_treePre[to] = from;
         return true;
     }
+    /*
+     *  Selects the shortest-length route that has the longest expected lifetime
+     *  (highest minimum timeout of any link in the route)
+     *  For the computation overhead and complexity
+     *  Here I just implement kind of greedy strategy to select link with the longest
+     * expected lifetime when there is two options
+     */
+    else if (m_treeDist[to] == dist && m_treePre[to] != from && PreferLink(to, m_treePre[to], from))
+    {
+        m_treePre[to] = from;
+    }
+    return false;
 }
 
-void
-WDsrRouteCache::PurgeLinkNode()
+bool
+WDsrRouteCache::PreferLink(uint32_t node, uint32_t oldPre, uint32_t newPre)
 {
-    NS_LOG_FUNCTION(this);
-    for (std::map<Link, WDsrLinkStab>::iterator i = m_linkCache.begin(); i != m_linkCache.end();)
+    std::map<Link, WDsrLinkStab>::iterator oldlink =
+        m_linkCache.find(Link(m_graphAddresses[node], m_graphAddresses[oldPre]));
+    std::map<Link, WDsrLinkStab>::iterator newlink =
+        m_linkCache.find(Link(m_graphAddresses[node], m_graphAddresses[newPre]));
+    if (oldlink != m_linkCache.end() && newlink != m_linkCache.end())
     {
-        NS_LOG_DEBUG("The link stability " << i->second.GetLinkStability().As(Time::S));
-        std::map<Link, WDsrLinkStab>::iterator itmp = i;
-        if (i->second.GetLinkStability() <= Seconds(0))
-        {
-            ++i;
-            m_linkCache.erase(itmp);
-        }
-        else
+        if (oldlink->second.GetLinkStability() < newlink->second.GetLinkStability())
         {
-            ++i;
+            NS_LOG_INFO("Select the link with longest expected lifetime");
+            return true;
         }
     }
-    /// may need to remove them after verify
-    for (std::map<Ipv4Address, WDsrNodeStab>::iterator i = m_nodeCache.begin();
-         i != m_nodeCache.end();)
+    else
     {
-        NS_LOG_DEBUG("The node stability " << i->second.GetNodeStability().As(Time::S));
-        std::map<Ipv4Address, WDsrNodeStab>::iterator itmp = i;
-        if (i->second.GetNodeStability() <= Seconds(0))
-        {
-            ++i;
-            m_nodeCache.erase(itmp);
-        }
-        else
-        {
-            ++i;
-        }
+        NS_LOG_INFO("Link Stability Info Corrupt");
     }
+    return false;
 }
 
 void
-WDsrRouteCache::UpdateNetGraph()
+WDsrRouteCache::RepairLinkUp(uint32_t u, uint32_t v, uint32_t weight)
 {
-    NS_LOG_FUNCTION(this);
-    m_netGraph.clear();
-    for (std::map<Link, WDsrLinkStab>::iterator i = m_linkCache.begin(); i != m_linkCache.end(); ++i)
+    NS_LOG_FUNCTION(this << m_graphAddresses[u] << m_graphAddresses[v] << weight);
+    ++m_stats.m_repairs;
+    TreeHeap heap;
+    if (RelaxLink(u, v, weight))
     {
-        // Here the weight is set as 1
-        /// \todo May need to set different weight for different link here later
-        uint32_t weight = 1;
-        m_netGraph[i->first.m_low][i->first.m_high] = weight;
-        m_netGraph[i->first.m_high][i->first.m_low] = weight;
+        heap.push(std::make_pair(m_treeDist[v], v));
     }
+    if (RelaxLink(v, u, weight))
+    {
+        heap.push(std::make_pair(m_treeDist[u], u));
+    }
+    PropagateTree(heap);
 }
 
-bool
-WDsrRouteCache::IncStability(Ipv4Address node)
+void
+WDsrRouteCache::RepairLinkDown(uint32_t u, uint32_t v)
 {
-    NS_LOG_FUNCTION(this << node);
-    std::map<Ipv4Address, WDsrNodeStab>::const_iterator i = m_nodeCache.find(node);
-    if (i == m_nodeCache.end())
+    NS_LOG_FUNCTION(this << m_graphAddresses[u] << m_graphAddresses[v]);
+    const uint32_t none = std::numeric_limits<uint32_t>::max();
+    uint32_t child = none;
+    if (m_treePre[v] == u)
     {
-        NS_LOG_INFO("The initial stability " << m_initStability.As(Time::S));
+        child = v;
+    }
+    else if (m_treePre[u] == v)
+    {
+        child = u;
+    }
+    else
+    {
+        NS_LOG_LOGIC("The link is not used by any best route");
+        return;
+    }
+    /*
+     * Find the subtree hanging below the link, every node is marked once by walking up its
+     * preceding nodes until a node of known side is reached
+     */
+    const uint32_t nodes = m_graphAddresses.size();
+    enum Side
+    {
+        UNKNOWN,
+        INSIDE,
+        OUTSIDE
+    };
+    std::vector<uint8_t> side(nodes, UNKNOWN);
+    side[child] = INSIDE;
+    std::vector<uint32_t> subtree(1, child);
+    std::vector<uint32_t> walk;
+    for (uint32_t i = 0; i < nodes; ++i)
+    {
+        uint32_t j = i;
+        while (side[j] == UNKNOWN && m_treePre[j] != none)
+        {
+            walk.push_back(j);
+            j = m_treePre[j];
+        }
+        if (side[j] == UNKNOWN)
+        {
+            // The root of the tree, or a node not reached by the tree
+            side[j] = OUTSIDE;
+        }
+        uint8_t result = side[j];
+        for (std::vector<uint32_t>::const_iterator k = walk.begin(); k != walk.end(); ++k)
+        {
+            side[*k] = result;
+            if (result == INSIDE)
+            {
+                subtree.push_back(*k);
+            }
+        }
+        walk.clear();
+    }
+    if (subtree.size() * 2 > nodes)
+    {
+        NS_LOG_LOGIC("Most of the tree is affected, rebuild the best route table");
+        RebuildBestRouteTable(m_treeSource);
+        return;
+    }
+    NS_LOG_LOGIC("Repair " << subtree.size() << " nodes below " << m_graphAddresses[child]);
+    ++m_stats.m_repairs;
+    for (std::vector<uint32_t>::const_iterator i = subtree.begin(); i != subtree.end(); ++i)
+    {
+        m_treeDist[*i] = none;
+        m_treePre[*i] = none;
+    }
+    // Reattach the subtree to the best neighbor outside of it, then spread inside the subtree
+    TreeHeap heap;
+    for (std::vector<uint32_t>::const_iterator i = subtree.begin(); i != subtree.end(); ++i)
+    {
+        for (std::vector<GraphEdge>::const_iterator k = m_netGraph[*i].begin();
+             k != m_netGraph[*i].end();
+             ++k)
+        {
+            if (side[k->m_to] == OUTSIDE)
+            {
+                RelaxLink(k->m_to, *i, k->m_weight);
+            }
+        }
+        if (m_treeDist[*i] != none)
+        {
+            heap.push(std::make_pair(m_treeDist[*i], *i));
+        }
+    }
+    PropagateTree(heap);
+}
+
+bool
+WDsrRouteCache::LookupRoute_Link(Ipv4Address id, WDsrRouteCacheEntry& rt)
+{
+    NS_LOG_FUNCTION(this << id);
+    /// We need to purge the link node cache
+    PurgeLinkNode();
+    const uint32_t none = std::numeric_limits<uint32_t>::max();
+    std::map<Ipv4Address, uint32_t>::const_iterator i = m_graphIds.find(id);
+    if (!m_treeValid || i == m_graphIds.end())
+    {
+        NS_LOG_INFO("No route find to " << id);
+        return false;
+    }
+    const std::vector<uint32_t>* pre = &m_treePre;
+    if (m_treePre[i->second] == none)
+    {
+        /*
+         * No route above the threshold, fall back to the route with the maximum bottleneck
+         * battery (MMBCR)
+         */
+        if (!m_widestValid)
+        {
+            RebuildWidestTree();
+        }
+        if (m_widestPre[i->second] == none)
+        {
+            NS_LOG_INFO("No route find to " << id);
+            return false;
+        }
+        NS_LOG_DEBUG("No route above the threshold, running MMBCR");
+        pre = &m_widestPre;
+        ++m_stats.m_mmbcrSelections;
+    }
+    else
+    {
+        NS_LOG_DEBUG("Route above the threshold, running MTPR");
+        ++m_stats.m_mtprSelections;
+    }
+    std::vector<uint32_t> path;
+    for (uint32_t j = i->second; j != none; j = (*pre)[j])
+    {
+        path.push_back(j);
+    }
+    // Reverse the route
+    std::reverse(path.begin(), path.end());
+    WDsrRouteCacheEntry::IP_VECTOR route;
+    for (std::vector<uint32_t>::const_iterator j = path.begin(); j != path.end(); ++j)
+    {
+        route.push_back(m_graphAddresses[*j]);
+    }
+    if (route.size() < 2 || route.front() != m_treeSource)
+    {
+        NS_LOG_LOGIC("Route to " << id << " error");
+        return false;
+    }
+    uint8_t lowestBat = 0x3f;
+    uint32_t txCost = 0;
+    for (uint32_t j = 0; j + 1 < route.size(); ++j)
+    {
+        if (j > 0 && m_graphBattery[path[j]] < lowestBat)
+        {
+            lowestBat = m_graphBattery[path[j]];
+        }
+        std::map<Link, WDsrLinkStab>::const_iterator link =
+            m_linkCache.find(Link(route[j], route[j + 1]));
+        txCost += (link == m_linkCache.end()) ? 1 : link->second.GetTxCost();
+    }
+
+    WDsrRouteCacheEntry newEntry; // Create the route entry
+    newEntry.SetVector(route);
+    newEntry.SetDestination(id);
+    newEntry.SetExpireTime(RouteCacheTimeout);
+    newEntry.SetLowestBat(lowestBat);
+    // The transmission cost field of the headers is 5 bits wide
+    newEntry.SetTxCost(std::min<uint32_t>(txCost, 0x1f));
+    NS_LOG_INFO("Route to " << id << " found with the length " << route.size());
+    rt = newEntry;
+    PrintVector(route);
+    return true;
+}
+
+void
+WDsrRouteCache::RebuildWidestTree()
+{
+    NS_LOG_FUNCTION(this << m_treeSource);
+    m_widestValid = true;
+    const uint32_t nodes = m_graphAddresses.size();
+    const uint32_t none = std::numeric_limits<uint32_t>::max();
+    m_widestPre.assign(nodes, none);
+    std::map<Ipv4Address, uint32_t>::const_iterator src = m_graphIds.find(m_treeSource);
+    if (src == m_graphIds.end())
+    {
+        return;
+    }
+    /*
+     * Dijkstra on (battery shortfall, transmission cost), the shortfall is 0xff minus the lowest
+     * battery of the intermediate nodes so that the smallest key is the maximum bottleneck
+     * battery, and the ties are broken with the lower transmission cost
+     */
+    typedef std::pair<uint32_t, uint32_t> Key;
+    std::vector<Key> key(nodes, Key(none, none));
+    std::priority_queue<std::pair<Key, uint32_t>,
+                        std::vector<std::pair<Key, uint32_t>>,
+                        std::greater<std::pair<Key, uint32_t>>>
+        heap;
+    key[src->second] = Key(0, 0);
+    heap.push(std::make_pair(key[src->second], src->second));
+    while (!heap.empty())
+    {
+        Key k = heap.top().first;
+        uint32_t u = heap.top().second;
+        heap.pop();
+        if (k != key[u])
+        {
+            continue;
+        }
+        // The source does not forward on its own battery
+        uint32_t shortfall =
+            (u == src->second) ? 0 : std::max<uint32_t>(k.first, 0xff - m_graphBattery[u]);
+        for (std::vector<GraphEdge>::const_iterator e = m_netGraph[u].begin();
+             e != m_netGraph[u].end();
+             ++e)
+        {
+            Key candidate(shortfall, k.second + e->m_weight);
+            if (candidate < key[e->m_to])
+            {
+                key[e->m_to] = candidate;
+                m_widestPre[e->m_to] = u;
+                heap.push(std::make_pair(candidate, e->m_to));
+            }
+            else if (candidate == key[e->m_to] && m_widestPre[e->m_to] != u &&
+                     PreferLink(e->m_to, m_widestPre[e->m_to], u))
+            {
+                m_widestPre[e->m_to] = u;
+            }
+        }
+    }
+    m_widestPre[src->second] = none;
+}
+
+bool
+WDsrRouteCache::IsRelay(uint32_t u) const
+{
+    return m_graphBattery[u] > γ;
+}
+
+void
+WDsrRouteCache::PurgeLinkNode()
+{
+    NS_LOG_FUNCTION(this);
+    std::vector<Link> expired;
+    for (std::map<Link, WDsrLinkStab>::iterator i = m_linkCache.begin(); i != m_linkCache.end();)
+    {
+        NS_LOG_DEBUG("The link stability " << i->second.GetLinkStability().As(Time::S));
+        std::map<Link, WDsrLinkStab>::iterator itmp = i;
+        if (i->second.GetLinkStability() <= Seconds(0))
+        {
+            ++i;
+            expired.push_back(itmp->first);
+            m_linkCache.erase(itmp);
+            ++m_stats.m_purgedLinks;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    /// may need to remove them after verify
+    bool relayChanged = false;
+    for (std::map<Ipv4Address, WDsrNodeStab>::iterator i = m_nodeCache.begin();
+         i != m_nodeCache.end();)
+    {
+        NS_LOG_DEBUG("The node stability " << i->second.GetNodeStability().As(Time::S));
+        std::map<Ipv4Address, WDsrNodeStab>::iterator itmp = i;
+        if (i->second.GetNodeStability() <= Seconds(0))
+        {
+            ++i;
+            // The battery of the node is not known any more
+            std::map<Ipv4Address, uint32_t>::const_iterator id = m_graphIds.find(itmp->first);
+            if (id != m_graphIds.end() && m_graphBattery[id->second] != 0x3f)
+            {
+                bool wasRelay = IsRelay(id->second);
+                m_graphBattery[id->second] = 0x3f;
+                m_widestValid = false;
+                relayChanged = relayChanged || (wasRelay != IsRelay(id->second));
+            }
+            m_nodeCache.erase(itmp);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    /*
+     * Take the expired links out of the best routes as well, a single link is repaired in place
+     * and several links at once are cheaper to handle with a rebuild
+     */
+    if ((!expired.empty() || relayChanged) && CanRepairTree(m_treeSource))
+    {
+        for (std::vector<Link>::const_iterator i = expired.begin(); i != expired.end(); ++i)
+        {
+            uint32_t low = GetGraphId(i->m_low);
+            uint32_t high = GetGraphId(i->m_high);
+            if (RemoveGraphLink(low, high) && expired.size() == 1 && !relayChanged)
+            {
+                RepairLinkDown(low, high);
+            }
+        }
+        if (expired.size() > 1 || relayChanged)
+        {
+            RebuildBestRouteTable(m_treeSource);
+        }
+    }
+}
+
+void
+WDsrRouteCache::UpdateNetGraph()
+{
+    NS_LOG_FUNCTION(this);
+    m_netGraph.clear();
+    m_graphIds.clear();
+    m_graphAddresses.clear();
+    m_graphBattery.clear();
+    m_widestValid = false;
+    // The node ids are given again, the best route tree has to be rebuilt on the new graph
+    m_treeDist.clear();
+    m_treePre.clear();
+    m_treeValid = false;
+    for (std::map<Link, WDsrLinkStab>::iterator i = m_linkCache.begin(); i != m_linkCache.end(); ++i)
+    {
+        // The weight is the transmission cost of the link
+        uint32_t weight = i->second.GetTxCost();
+        uint32_t low = GetGraphId(i->first.m_low);
+        uint32_t high = GetGraphId(i->first.m_high);
+        m_netGraph[low].push_back({high, weight});
+        m_netGraph[high].push_back({low, weight});
+    }
+}
+
+uint32_t
+WDsrRouteCache::GetGraphId(Ipv4Address address)
+{
+    std::pair<std::map<Ipv4Address, uint32_t>::iterator, bool> result =
+        m_graphIds.insert(std::make_pair(address, m_graphAddresses.size()));
+    if (result.second)
+    {
+        m_graphAddresses.push_back(address);
+        m_netGraph.emplace_back();
+        std::map<Ipv4Address, WDsrNodeStab>::const_iterator node = m_nodeCache.find(address);
+        m_graphBattery.push_back(node == m_nodeCache.end() ? 0x3f : node->second.GetBattery());
+        m_widestValid = false;
+        // A new node is not reached by the tree until a link to it is repaired in
+        m_treeDist.push_back(std::numeric_limits<uint32_t>::max());
+        m_treePre.push_back(std::numeric_limits<uint32_t>::max());
+    }
+    return result.first->second;
+}
+
+uint32_t
+WDsrRouteCache::SetGraphLink(uint32_t u, uint32_t v, uint32_t weight)
+{
+    m_widestValid = false;
+    uint32_t previous = 0;
+    for (uint32_t k = 0; k < 2; ++k)
+    {
+        std::vector<GraphEdge>& edges = m_netGraph[k ? v : u];
+        uint32_t to = k ? u : v;
+        std::vector<GraphEdge>::iterator i = edges.begin();
+        while (i != edges.end() && i->m_to != to)
+        {
+            ++i;
+        }
+        if (i == edges.end())
+        {
+            edges.push_back({to, weight});
+        }
+        else
+        {
+            previous = i->m_weight;
+            i->m_weight = weight;
+        }
+    }
+    return previous;
+}
+
+bool
+WDsrRouteCache::RemoveGraphLink(uint32_t u, uint32_t v)
+{
+    m_widestValid = false;
+    bool removed = false;
+    for (uint32_t k = 0; k < 2; ++k)
+    {
+        std::vector<GraphEdge>& edges = m_netGraph[k ? v : u];
+        uint32_t to = k ? u : v;
+        for (std::vector<GraphEdge>::iterator i = edges.begin(); i != edges.end(); ++i)
+        {
+            if (i->m_to == to)
+            {
+                *i = edges.back();
+                edges.pop_back();
+                removed = true;
+                break;
+            }
+        }
+    }
+    return removed;
+}
+
+bool
+WDsrRouteCache::IncStability(Ipv4Address node)
+{
+    NS_LOG_FUNCTION(this << node);
+    std::map<Ipv4Address, WDsrNodeStab>::iterator i = m_nodeCache.find(node);
+    if (i == m_nodeCache.end())
+    {
+        NS_LOG_INFO("The initial stability " << m_initStability.As(Time::S));
         WDsrNodeStab ns(m_initStability);
         m_nodeCache[node] = ns;
         return false;
@@ -642,8 +1218,8 @@ WDsrRouteCache::IncStability(Ipv4Address node)
         NS_LOG_INFO("The node stability " << i->second.GetNodeStability().As(Time::S));
         NS_LOG_INFO("The stability here "
                     << Time(i->second.GetNodeStability() * m_stabilityIncrFactor).As(Time::S));
-        WDsrNodeStab ns(Time(i->second.GetNodeStability() * m_stabilityIncrFactor));
-        m_nodeCache[node] = ns;
+        // Keep the battery known for the node
+        i->second.SetNodeStability(Time(i->second.GetNodeStability() * m_stabilityIncrFactor));
         return true;
     }
     return false;
@@ -653,7 +1229,7 @@ bool
 WDsrRouteCache::DecStability(Ipv4Address node)
 {
     NS_LOG_FUNCTION(this << node);
-    std::map<Ipv4Address, WDsrNodeStab>::const_iterator i = m_nodeCache.find(node);
+    std::map<Ipv4Address, WDsrNodeStab>::iterator i = m_nodeCache.find(node);
     if (i == m_nodeCache.end())
     {
         WDsrNodeStab ns(m_initStability);
@@ -666,26 +1242,52 @@ WDsrRouteCache::DecStability(Ipv4Address node)
         NS_LOG_INFO("The stability here " << i->second.GetNodeStability().As(Time::S));
         NS_LOG_INFO("The stability here "
                     << Time(i->second.GetNodeStability() / m_stabilityDecrFactor).As(Time::S));
-        WDsrNodeStab ns(Time(i->second.GetNodeStability() / m_stabilityDecrFactor));
-        m_nodeCache[node] = ns;
+        i->second.SetNodeStability(Time(i->second.GetNodeStability() / m_stabilityDecrFactor));
         return true;
     }
     return false;
 }
 
 bool
-WDsrRouteCache::AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist, Ipv4Address source)
+WDsrRouteCache::AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist,
+                              Ipv4Address source,
+                              uint8_t lowestBat,
+                              uint8_t txCost)
 {
-    NS_LOG_FUNCTION(this << source);
+    NS_LOG_FUNCTION(this << source << (int)lowestBat << (int)txCost);
     NS_LOG_DEBUG("Am i doing this again?");
     NS_LOG_LOGIC("Use Link Cache");
     /// Purge the link node cache first
     PurgeLinkNode();
+    WDsrNodeStab ns; /// This is the node stability
+    ns.SetNodeStability(m_initStability);
+    /*
+     * The route only carries the lowest battery of its intermediate nodes, which is the best
+     * known bound for each of them since the batteries only drain, the latest bound is kept
+     */
+    bool rebuild = !CanRepairTree(source);
+    for (uint32_t i = 1; i + 1 < nodelist.size(); i++)
+    {
+        std::map<Ipv4Address, WDsrNodeStab>::iterator node =
+            m_nodeCache.insert(std::make_pair(nodelist[i], ns)).first;
+        node->second.SetBattery(lowestBat);
+        std::map<Ipv4Address, uint32_t>::const_iterator id = m_graphIds.find(nodelist[i]);
+        if (id != m_graphIds.end() && m_graphBattery[id->second] != lowestBat)
+        {
+            bool wasRelay = IsRelay(id->second);
+            m_graphBattery[id->second] = lowestBat;
+            m_widestValid = false;
+            rebuild = rebuild || (wasRelay != IsRelay(id->second));
+        }
+    }
+    /*
+     * The transmission cost of the route is shared by its links, rounded and at least 1 so that
+     * every hop counts
+     */
+    uint32_t hops = nodelist.size() - 1;
+    uint8_t linkCost = (txCost == 0) ? 1 : std::max<uint32_t>(1, (txCost + hops / 2) / hops);
     for (uint32_t i = 0; i < nodelist.size() - 1; i++)
     {
-        WDsrNodeStab ns; /// This is the node stability
-        ns.SetNodeStability(m_initStability);
-
         if (m_nodeCache.find(nodelist[i]) == m_nodeCache.end())
         {
             m_nodeCache[nodelist[i]] = ns;
@@ -697,6 +1299,7 @@ WDsrRouteCache::AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist, Ipv4Addre
         Link link(nodelist[i], nodelist[i + 1]); /// Link represent the one link for the route
         WDsrLinkStab stab;                        /// Link stability
         stab.SetLinkStability(m_initStability);
+        stab.SetTxCost(linkCost);
         /// Set the link stability as the smallest node stability
         if (m_nodeCache[nodelist[i]].GetNodeStability() <
             m_nodeCache[nodelist[i + 1]].GetNodeStability())
@@ -718,14 +1321,32 @@ WDsrRouteCache::AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist, Ipv4Addre
         link.Print();
         NS_LOG_DEBUG("Link Info");
         stab.Print();
+        if (!rebuild)
+        {
+            // Only the part of the best route tree affected by the link is updated
+            uint32_t low = GetGraphId(link.m_low);
+            uint32_t high = GetGraphId(link.m_high);
+            uint32_t previous = SetGraphLink(low, high, linkCost);
+            if (previous == 0 || previous >= linkCost)
+            {
+                RepairLinkUp(low, high, linkCost);
+            }
+            else
+            {
+                RepairLinkDown(low, high);
+            }
+        }
+    }
+    if (rebuild)
+    {
+        UpdateNetGraph();
+        RebuildBestRouteTable(source);
     }
-    UpdateNetGraph();
-    RebuildBestRouteTable(source);
     return true;
 }
 
 void
-WDsrRouteCache::UseExtends(WDsrRouteCacheEntry::IP_VECTOR rt)
+WDsrRouteCache::UseExtends(WDsrRouteCacheEntry::IP_VECTOR const& rt)
 {
     NS_LOG_FUNCTION(this);
     /// Purge the link node cache first
@@ -735,7 +1356,7 @@ WDsrRouteCache::UseExtends(WDsrRouteCacheEntry::IP_VECTOR rt)
         NS_LOG_INFO("The route is too short");
         return;
     }
-    for (WDsrRouteCacheEntry::IP_VECTOR::iterator i = rt.begin(); i != rt.end() - 1; ++i)
+    for (WDsrRouteCacheEntry::IP_VECTOR::const_iterator i = rt.begin(); i != rt.end() - 1; ++i)
     {
         Link link(*i, *(i + 1));
         if (m_linkCache.find(link) != m_linkCache.end())
@@ -754,7 +1375,7 @@ WDsrRouteCache::UseExtends(WDsrRouteCacheEntry::IP_VECTOR rt)
         }
     }
     /// Increase the stability of the node cache
-    for (WDsrRouteCacheEntry::IP_VECTOR::iterator i = rt.begin(); i != rt.end(); ++i)
+    for (WDsrRouteCacheEntry::IP_VECTOR::const_iterator i = rt.begin(); i != rt.end(); ++i)
     {
         if (m_nodeCache.find(*i) != m_nodeCache.end())
         {
@@ -774,52 +1395,41 @@ WDsrRouteCache::UseExtends(WDsrRouteCacheEntry::IP_VECTOR rt)
 bool
 WDsrRouteCache::AddRoute(WDsrRouteCacheEntry& rt)
 {
-    
     NS_LOG_FUNCTION(this);
     Purge();
-    std::list<WDsrRouteCacheEntry> rtVector; // Declare the route cache entry vector
     Ipv4Address dst = rt.GetDestination();
-    std::vector<Ipv4Address> route = rt.GetVector();
-    PrintVector(route);
+    PrintVector(rt.GetVector());
     NS_LOG_DEBUG("  " << dst);
-    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator i =
-        m_sortedRoutes.find(dst);
-    for (std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator j = m_sortedRoutes.begin(); j != m_sortedRoutes.end(); ++j){
-        NS_LOG_DEBUG("j.first: "<<j->first);
-        PrintRouteVector(j->second);
-    }
-    
-    NS_LOG_DEBUG("Length of routeVector: "<<i->second.size());
-    PrintRouteVector(i->second);
+    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator i = m_sortedRoutes.find(dst);
     if (i == m_sortedRoutes.end())
     {
         NS_LOG_DEBUG("------------------ 1");
-        rtVector.push_back(rt);
-        m_sortedRoutes.erase(dst); // Erase the route entries for dst first
         /**
          * Save the new route cache along with the destination address in map
          */
+        m_sortedRoutes[dst].push_back(rt);
+        IndexRoute(dst, rt);
+        ScheduleExpiry(dst, rt.GetExpireAt());
         NS_LOG_DEBUG("Add route with route vector:");
-        PrintRouteVector(rtVector);
-        std::pair<std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator, bool> result =
-            m_sortedRoutes.insert(std::make_pair(dst, rtVector));
-         NS_LOG_DEBUG("result.second: "<<(bool)result.second);
-        return result.second;
+        PrintRouteVector(m_sortedRoutes[dst]);
+        return true;
     }
     else
     {
         NS_LOG_DEBUG("------------------ 2");
-        rtVector = i->second;
+        std::list<WDsrRouteCacheEntry>& rtVector = i->second;
         NS_LOG_DEBUG("The existing route size " << rtVector.size() << " for destination address "
                                                 << dst);
+        PrintRouteVector(rtVector);
         /**
-         * \brief Drop the most aged packet when buffer reaches to max
+         * \brief Drop the least preferred route when buffer reaches to max, the entry is kept
+         * aside and put back if the new route is rejected
          */
+        std::list<WDsrRouteCacheEntry> lastEntry;
         if (rtVector.size() >= m_maxEntriesEachDst)
         {
             NS_LOG_DEBUG("-------- 2.1");
-            RemoveLastEntry(rtVector); // Drop the last entry for the sorted route cache, the route
-                                       // has already been sorted
+            lastEntry.splice(lastEntry.end(), rtVector, FindPolicyRoute<true>(rtVector));
         }
 
         if (FindSameRoute(rt, rtVector))
@@ -827,6 +1437,10 @@ WDsrRouteCache::AddRoute(WDsrRouteCacheEntry& rt)
             NS_LOG_DEBUG("-------- 2.2");
             NS_LOG_DEBUG(
                 "Find same vector, the FindSameRoute function will update the route expire time");
+            if (!lastEntry.empty())
+            {
+                DropRoute(dst, lastEntry.front());
+            }
             return true;
         }
         else
@@ -836,79 +1450,26 @@ WDsrRouteCache::AddRoute(WDsrRouteCacheEntry& rt)
             if (rt.GetExpireTime() > Time(0))
             {
                 rtVector.push_back(rt);
-                // This sort function will sort the route cache entries based on the size of route
-                // in each of the route entries
-                
-
-                // ! WDSR-M Routing protocol (CCMBCR)
-                
-                uint8_t threshold = γ;
-                bool aboveThreshold = 0;
-                NS_LOG_DEBUG("Testing if lowestBat > threshold");
-                for (std::list<WDsrRouteCacheEntry>::iterator j = rtVector.begin(); j != rtVector.end(); ++j)
-                {
-                    NS_LOG_DEBUG("lowestBat: "<<(int) j->GetLowestBat());
-                    if (j->GetLowestBat() > threshold)
-                    {
-                        NS_LOG_DEBUG("-- Above threshold");
-                        aboveThreshold = 1;
-                    }
-                }
-                if (aboveThreshold)
-                {
-                    NS_LOG_DEBUG("A table is not empty, running MTPR");
-                    NS_LOG_DEBUG("Removing all lowestBat < "<<(int) threshold);
-                    NS_LOG_DEBUG("Number of vectors at start is: "<<rtVector.size());
-                    for (std::list<WDsrRouteCacheEntry>::iterator j = rtVector.begin(); j != rtVector.end();)
-                    {
-                        NS_LOG_DEBUG("lowestBat: "<<(int) j->GetLowestBat());
-                        if (j->GetLowestBat() < threshold)
-                        {
-                            NS_LOG_DEBUG("-- Removed");
-                            j = rtVector.erase(j);
-                            NS_LOG_DEBUG("Updated number of vectors: "<<rtVector.size());
-                        } else 
-                        {
-                             ++j;
-                        }
-                    }
-                    rtVector.sort(CompareTxCost);
-                } else 
+                IndexRoute(dst, rt);
+                ScheduleExpiry(dst, rt.GetExpireAt());
+                if (!lastEntry.empty())
                 {
-                    NS_LOG_DEBUG("A table is empty, running MMBCR");
-                    rtVector.sort(CompareLowestBat); 
+                    DropRoute(dst, lastEntry.front());
                 }
 
-                
-                
-                
-                /**
-                 * Save the new route cache along with the destination address in map
-                 */
-                NS_LOG_DEBUG("Added new link:");
-    
-                NS_LOG_DEBUG("The first vector time " << rtVector.front().GetExpireTime().As(Time::S)
-                                          << " The second vector time "
-                                          << rtVector.back().GetExpireTime().As(Time::S));
-                NS_LOG_DEBUG("The first vector hop " << rtVector.front().GetVector().size()
-                                             << " The second vector hop "
-                                             << rtVector.back().GetVector().size());
-                NS_LOG_DEBUG("The first vector lowestBat " << (int) rtVector.front().GetLowestBat()
-                                             << " The second vector lowestBat "
-                                             << (int) rtVector.back().GetLowestBat());
-                NS_LOG_DEBUG("The first vector txCost " << (int) rtVector.front().GetTxCost()
-                                             << " The second vector txCost "
-                                             << (int) rtVector.back().GetTxCost());
-                m_sortedRoutes.erase(dst); // erase the route entries for dst first
-                std::pair<std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator, bool> 
-                result = m_sortedRoutes.insert(std::make_pair(dst, rtVector));
-
-                return result.second;
+                // ! WDSR-M Routing protocol (CCMBCR), the route is selected on the next lookup
+                NS_LOG_DEBUG("Added new route with lowestBat "
+                             << (int)rt.GetLowestBat() << " txCost " << (int)rt.GetTxCost()
+                             << " hops " << rt.GetVectorSize() << ", " << rtVector.size()
+                             << " routes for " << dst);
+                return true;
             }
             else
             {
                 NS_LOG_INFO("The newly found route is already expired");
                 NS_LOG_DEBUG("The newly found route is already expired");
+                // Keep the cache as it was before the route was offered
+                rtVector.splice(rtVector.end(), lastEntry);
             }
         }
     }
@@ -919,14 +1480,10 @@ bool
 WDsrRouteCache::FindSameRoute(WDsrRouteCacheEntry& rt, std::list<WDsrRouteCacheEntry>& rtVector)
 {
     NS_LOG_FUNCTION(this);
-    NS_LOG_DEBUG("Checker jeg nogensinde her?");
     for (std::list<WDsrRouteCacheEntry>::iterator i = rtVector.begin(); i != rtVector.end(); ++i)
     {
-        // return the first route in the route vector
-        WDsrRouteCacheEntry::IP_VECTOR routeVector = i->GetVector();
-        WDsrRouteCacheEntry::IP_VECTOR newVector = rt.GetVector();
-
-        if (routeVector == newVector)
+        // Equal paths are interned as the same path
+        if (i->GetPath() == rt.GetPath())
         {
             NS_LOG_DEBUG("Found same routes in the route cache with the vector size "
                          << rt.GetDestination() << " " << rtVector.size());
@@ -936,16 +1493,9 @@ WDsrRouteCache::FindSameRoute(WDsrRouteCacheEntry& rt, std::list<WDsrRouteCacheE
             if (rt.GetExpireTime() > i->GetExpireTime())
             {
                 i->SetExpireTime(rt.GetExpireTime());
+                ScheduleExpiry(rt.GetDestination(), i->GetExpireAt());
             }
-            m_sortedRoutes.erase(rt.GetDestination()); // erase the entry first
-            NS_LOG_DEBUG("Bliver der compared? >> 4");
-            rtVector.sort(CompareRoutesHops);        // sort the route vector first
-            /*
-             * Save the new route cache along with the destination address in map
-             */
-            std::pair<std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator, bool> result =
-                m_sortedRoutes.insert(std::make_pair(rt.GetDestination(), rtVector));
-            return result.second;
+            return true;
         }
     }
     return false;
@@ -956,8 +1506,16 @@ WDsrRouteCache::DeleteRoute(Ipv4Address dst)
 {
     NS_LOG_FUNCTION(this << dst);
     Purge(); // purge the route cache first to remove timeout entries
-    if (m_sortedRoutes.erase(dst) != 0)
+    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator i = m_sortedRoutes.find(dst);
+    if (i != m_sortedRoutes.end())
     {
+        for (std::list<WDsrRouteCacheEntry>::const_iterator j = i->second.begin();
+             j != i->second.end();
+             ++j)
+        {
+            UnindexRoute(dst, *j);
+        }
+        m_sortedRoutes.erase(i);
         NS_LOG_LOGIC("Route deletion to " << dst << " successful");
         return true;
     }
@@ -1007,8 +1565,20 @@ WDsrRouteCache::DeleteAllRoutesIncludeLink(Ipv4Address errorSrc,
         {
             DecStability(i->first);
         }
-        UpdateNetGraph();
-        RebuildBestRouteTable(node);
+        std::map<Ipv4Address, uint32_t>::const_iterator low = m_graphIds.find(link1.m_low);
+        std::map<Ipv4Address, uint32_t>::const_iterator high = m_graphIds.find(link1.m_high);
+        if (CanRepairTree(node) && low != m_graphIds.end() && high != m_graphIds.end())
+        {
+            if (RemoveGraphLink(low->second, high->second))
+            {
+                RepairLinkDown(low->second, high->second);
+            }
+        }
+        else
+        {
+            UpdateNetGraph();
+            RebuildBestRouteTable(node);
+        }
     }
     else
     {
@@ -1022,56 +1592,60 @@ WDsrRouteCache::DeleteAllRoutesIncludeLink(Ipv4Address errorSrc,
             return;
         }
         /*
-         * Loop all the routes saved in the route cache
+         * Only the destinations with a route using the broken link are visited, the link index
+         * tells which ones they are
          */
-        for (std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator j =
-                 m_sortedRoutes.begin();
-             j != m_sortedRoutes.end();)
+        std::map<RouteLink, std::map<Ipv4Address, uint32_t>>::const_iterator l =
+            m_linkIndex.find(RouteLink(errorSrc, unreachNode));
+        if (l == m_linkIndex.end())
+        {
+            NS_LOG_LOGIC("No cached route uses the link " << errorSrc << " " << unreachNode);
+            return;
+        }
+        // The index changes while the routes are cut, keep the destinations aside
+        std::vector<Ipv4Address> affected;
+        for (std::map<Ipv4Address, uint32_t>::const_iterator d = l->second.begin();
+             d != l->second.end();
+             ++d)
         {
-            std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator jtmp = j;
+            affected.push_back(d->first);
+        }
+        for (std::vector<Ipv4Address>::const_iterator a = affected.begin(); a != affected.end();
+             ++a)
+        {
+            std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator j =
+                m_sortedRoutes.find(*a);
+            NS_ASSERT_MSG(j != m_sortedRoutes.end(), "Link index out of sync for " << *a);
             Ipv4Address address = j->first;
-            std::list<WDsrRouteCacheEntry> rtVector = j->second;
+            std::list<WDsrRouteCacheEntry>& rtVector = j->second;
             /*
              * Loop all the routes for a single destination
              */
             for (std::list<WDsrRouteCacheEntry>::iterator k = rtVector.begin(); k != rtVector.end();)
             {
-                // return the first route in the route vector
-                WDsrRouteCacheEntry::IP_VECTOR routeVector = k->GetVector();
-                WDsrRouteCacheEntry::IP_VECTOR changeVector;
                 /*
-                 * Loop the ip addresses within a single route entry
+                 * Walk up the path for the broken link, the route is cut right after errorSrc
                  */
-                for (WDsrRouteCacheEntry::IP_VECTOR::iterator i = routeVector.begin();
-                     i != routeVector.end();
-                     ++i)
+                Ptr<WDsrPath> routePath = k->GetPath();
+                Ptr<WDsrPath> changePath = routePath;
+                for (Ptr<WDsrPath> i = routePath; i && i->GetParent(); i = i->GetParent())
                 {
-                    if (*i != errorSrc)
-                    {
-                        changeVector.push_back(*i);
-                    }
-                    else
+                    if (i->GetAddress() == unreachNode && i->GetParent()->GetAddress() == errorSrc)
                     {
-                        if (*(i + 1) == unreachNode)
-                        {
-                            changeVector.push_back(*i);
-                            break;
-                        }
-                        else
-                        {
-                            changeVector.push_back(*i);
-                        }
+                        changePath = i->GetParent();
+                        break;
                     }
                 }
+                uint32_t changeSize = changePath ? changePath->GetSize() : 0;
                 /*
                  * Verify if need to remove some affected links
                  */
-                if (changeVector.size() == routeVector.size())
+                if (changePath == routePath)
                 {
                     NS_LOG_DEBUG("The route does not contain the broken link");
                     ++k;
                 }
-                else if ((changeVector.size() < routeVector.size()) && (changeVector.size() > 1))
+                else if (changeSize > 1)
                 {
                     NS_LOG_DEBUG("sub route " << m_subRoute);
                     if (m_subRoute)
@@ -1080,17 +1654,20 @@ WDsrRouteCache::DeleteAllRoutesIncludeLink(Ipv4Address errorSrc,
                         /*
                          * Remove the route first
                          */
+                        UnindexRoute(address, *k);
                         k = rtVector.erase(k);
                         WDsrRouteCacheEntry changeEntry;
-                        changeEntry.SetVector(changeVector);
-                        Ipv4Address destination = changeVector.back();
+                        changeEntry.SetPath(changePath);
+                        Ipv4Address destination = changePath->GetAddress();
                         NS_LOG_DEBUG("The destination of the newly formed route "
                                      << destination << " and the size of the route "
-                                     << changeVector.size());
+                                     << changeSize);
                         changeEntry.SetDestination(destination);
-                        changeEntry.SetExpireTime(
-                            expire); // Initialize the timeout value to the one it has
+                        // Initialize the timeout value to the one it has, the expiry record of the
+                        // original entry stays valid since the list it is filed under is the same
+                        changeEntry.SetExpireTime(expire);
                         rtVector.push_back(changeEntry); // Add the route entry to the route list
+                        IndexRoute(address, changeEntry);
                         NS_LOG_DEBUG("We have a sub-route to " << destination);
                     }
                     else
@@ -1098,6 +1675,7 @@ WDsrRouteCache::DeleteAllRoutesIncludeLink(Ipv4Address errorSrc,
                         /*
                          * Remove the route
                          */
+                        UnindexRoute(address, *k);
                         k = rtVector.erase(k);
                     }
                 }
@@ -1107,33 +1685,21 @@ WDsrRouteCache::DeleteAllRoutesIncludeLink(Ipv4Address errorSrc,
                     /*
                      * Remove the route
                      */
+                    UnindexRoute(address, *k);
                     k = rtVector.erase(k);
                 }
             }
-            ++j;
-            if (!IsLinkCache())
-            {
-                m_sortedRoutes.erase(jtmp);
-            }
-            if (rtVector.size())
+            if (rtVector.empty())
             {
-                /*
-                 * Save the new route cache along with the destination address in map
-                 */
-                NS_LOG_DEBUG("Bliver der compared? >> 5");
-                rtVector.sort(CompareRoutesHops);
-                m_sortedRoutes[address] = rtVector;
-            }
-            else
-            {
-                NS_LOG_DEBUG("There is no route left for that destination " << address);
+                NS_LOG_DEBUG("There is no route left for that destination " << address);
+                m_sortedRoutes.erase(j);
             }
         }
     }
 }
 
 void
-WDsrRouteCache::PrintVector(std::vector<Ipv4Address>& vec)
+WDsrRouteCache::PrintVector(const std::vector<Ipv4Address>& vec)
 {
     NS_LOG_FUNCTION(this);
     /*
@@ -1154,15 +1720,14 @@ WDsrRouteCache::PrintVector(std::vector<Ipv4Address>& vec)
 }
 
 void
-WDsrRouteCache::PrintRouteVector(std::list<WDsrRouteCacheEntry> route)
+WDsrRouteCache::PrintRouteVector(const std::list<WDsrRouteCacheEntry>& route)
 {
     NS_LOG_FUNCTION(this);
-    for (std::list<WDsrRouteCacheEntry>::iterator i = route.begin(); i != route.end(); i++)
+    for (std::list<WDsrRouteCacheEntry>::const_iterator i = route.begin(); i != route.end(); i++)
     {
-        std::vector<Ipv4Address> path = i->GetVector();
         NS_LOG_INFO("Route NO. ");
         NS_LOG_DEBUG("Route NO. ");
-        PrintVector(path);
+        PrintVector(i->GetVector());
     }
 }
 
@@ -1174,68 +1739,236 @@ WDsrRouteCache::Purge()
     if (m_sortedRoutes.empty())
     {
         NS_LOG_DEBUG("The route cache is empty :)");
+        // Nothing is left to expire, drop the outdated records as well
+        m_expiryQueue = std::priority_queue<ExpiryRecord,
+                                            std::vector<ExpiryRecord>,
+                                            std::greater<ExpiryRecord>>();
+        return;
+    }
+    /*
+     * Only visit the destinations owning a record that has come due, the entries are kept sorted
+     * by expire time in the heap
+     */
+    Time now = Simulator::Now();
+    while (!m_expiryQueue.empty() && m_expiryQueue.top().first <= now)
+    {
+        Ipv4Address dst = m_expiryQueue.top().second;
+        m_expiryQueue.pop();
+        PurgeDestination(dst);
+    }
+}
+
+void
+WDsrRouteCache::PurgeDestination(Ipv4Address dst)
+{
+    NS_LOG_FUNCTION(this << dst);
+    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator i = m_sortedRoutes.find(dst);
+    if (i == m_sortedRoutes.end())
+    {
+        NS_LOG_DEBUG("The routes to " << dst << " have already been removed");
         return;
     }
-    for (std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator i = m_sortedRoutes.begin();
-         i != m_sortedRoutes.end();)
+    std::list<WDsrRouteCacheEntry>& rtVector = i->second;
+    for (std::list<WDsrRouteCacheEntry>::iterator j = rtVector.begin(); j != rtVector.end();)
     {
-        // Loop of route cache entry with the route size
-        std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::iterator itmp = i;
         /*
-         * The route cache entry vector
+         * First verify if the route has expired or not
          */
-        Ipv4Address dst = i->first;
-        std::list<WDsrRouteCacheEntry> rtVector = i->second;
-        NS_LOG_DEBUG("The route vector size of 1 " << dst << " " << rtVector.size());
-        if (rtVector.size())
+        if (j->GetExpireTime() <= Seconds(0))
         {
-            for (std::list<WDsrRouteCacheEntry>::iterator j = rtVector.begin(); j != rtVector.end();)
-            {
-                NS_LOG_DEBUG("The expire time of every entry with expire time "
-                             << j->GetExpireTime());
-                /*
-                 * First verify if the route has expired or not
-                 */
-                if (j->GetExpireTime() <= Seconds(0))
-                {
-                    /*
-                     * When the expire time has passed, erase the certain route
-                     */
-                    NS_LOG_DEBUG("Erase the expired route for " << dst << " with expire time "
-                                                                << j->GetExpireTime());
-                    j = rtVector.erase(j);
-                }
-                else
-                {
-                    ++j;
-                }
-            }
-            NS_LOG_DEBUG("The route vector size of 2 " << dst << " " << rtVector.size());
-            if (rtVector.size())
-            {
-                ++i;
-                m_sortedRoutes.erase(itmp); // erase the entry first
-                /*
-                 * Save the new route cache along with the destination address in map
-                 */
-                m_sortedRoutes.insert(std::make_pair(dst, rtVector));
-            }
-            else
-            {
-                NS_LOG_DEBUG("Erase1?");
-                ++i;
-                m_sortedRoutes.erase(itmp);
-            }
+            /*
+             * When the expire time has passed, erase the certain route
+             */
+            NS_LOG_DEBUG("Erase the expired route for " << dst << " with expire time "
+                                                        << j->GetExpireTime());
+            UnindexRoute(dst, *j);
+            ++m_stats.m_purgedRoutes;
+            m_evictTrace(*j, true);
+            j = rtVector.erase(j);
         }
         else
         {
-            NS_LOG_DEBUG("Erase2?");
-            ++i;
-            m_sortedRoutes.erase(itmp);
+            ++j;
+        }
+    }
+    if (rtVector.empty())
+    {
+        m_sortedRoutes.erase(i);
+    }
+}
+
+std::list<WDsrRouteCacheEntry>::iterator
+WDsrRouteCache::SelectRoute(Ipv4Address dst, std::list<WDsrRouteCacheEntry>& rtVector)
+{
+    NS_LOG_FUNCTION(this << dst);
+    NS_ASSERT_MSG(!rtVector.empty(), "No route to select for " << dst);
+    uint8_t threshold = γ;
+    if (threshold != m_selectedThreshold)
+    {
+        // The threshold has changed, every selection has to be made again
+        m_selectedRoutes.clear();
+        m_selectedThreshold = threshold;
+    }
+    std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>::iterator>::const_iterator s =
+        m_selectedRoutes.find(dst);
+    if (s != m_selectedRoutes.end())
+    {
+        return s->second;
+    }
+    std::list<WDsrRouteCacheEntry>::iterator best = FindPolicyRoute<false>(rtVector);
+    NS_LOG_DEBUG("Selected the route to " << dst << " with " << m_routePolicy);
+    m_selectedRoutes[dst] = best;
+    return best;
+}
+
+void
+WDsrRouteCache::DropRoute(Ipv4Address dst, const WDsrRouteCacheEntry& rt)
+{
+    NS_LOG_FUNCTION(this << dst);
+    UnindexRoute(dst, rt);
+    ++m_stats.m_droppedRoutes;
+    m_evictTrace(rt, false);
+}
+
+template <class Policy, bool Least>
+std::list<WDsrRouteCacheEntry>::iterator
+WDsrRouteCache::FindRoute(std::list<WDsrRouteCacheEntry>& rtVector)
+{
+    const typename Policy::Context context = Policy::MakeContext(rtVector);
+    std::list<WDsrRouteCacheEntry>::iterator found = rtVector.begin();
+    for (std::list<WDsrRouteCacheEntry>::iterator i = std::next(found); i != rtVector.end(); ++i)
+    {
+        if (Least ? Policy::Prefer(*found, *i, context) : Policy::Prefer(*i, *found, context))
+        {
+            found = i;
+        }
+    }
+    if (!Least)
+    {
+        Policy::Count(context, rtVector, m_stats);
+    }
+    return found;
+}
+
+template <bool Least>
+std::list<WDsrRouteCacheEntry>::iterator
+WDsrRouteCache::FindPolicyRoute(std::list<WDsrRouteCacheEntry>& rtVector)
+{
+    switch (m_policy)
+    {
+    case HOP_COUNT:
+        return FindRoute<WDsrHopCountPolicy, Least>(rtVector);
+    case MMBCR:
+        return FindRoute<WDsrMmbcrPolicy, Least>(rtVector);
+    case MTPR:
+        return FindRoute<WDsrMtprPolicy, Least>(rtVector);
+    case CCMBCR:
+        break;
+    }
+    return FindRoute<WDsrCcmbcrPolicy, Least>(rtVector);
+}
+
+void
+WDsrRouteCache::IndexRoute(Ipv4Address dst, const WDsrRouteCacheEntry& rt)
+{
+    NS_LOG_FUNCTION(this << dst);
+    m_selectedRoutes.erase(dst);
+    if (rt.GetVectorSize() < 2)
+    {
+        return;
+    }
+    for (const WDsrPath* i = PeekPointer(rt.GetPath()); i->GetParent();
+         i = PeekPointer(i->GetParent()))
+    {
+        const WDsrPath* prev = PeekPointer(i->GetParent());
+        ++m_linkIndex[RouteLink(prev->GetAddress(), i->GetAddress())][dst];
+        // Only the intermediate nodes can give a sub route, the source and the last hop are skipped
+        if (prev->GetSize() > 1)
+        {
+            ++m_nodeIndex[prev->GetAddress()][dst];
+        }
+    }
+}
+
+/**
+ * \brief Decrement the count of a destination in an inverted index, the empty entries are erased
+ * \param index the inverted index
+ * \param key the node or link
+ * \param dst the destination
+ */
+template <typename K>
+static void
+DecrementIndex(std::map<K, std::map<Ipv4Address, uint32_t>>& index, const K& key, Ipv4Address dst)
+{
+    typename std::map<K, std::map<Ipv4Address, uint32_t>>::iterator n = index.find(key);
+    if (n == index.end())
+    {
+        return;
+    }
+    std::map<Ipv4Address, uint32_t>::iterator d = n->second.find(dst);
+    if (d != n->second.end() && --d->second == 0)
+    {
+        n->second.erase(d);
+        if (n->second.empty())
+        {
+            index.erase(n);
+        }
+    }
+}
+
+void
+WDsrRouteCache::UnindexRoute(Ipv4Address dst, const WDsrRouteCacheEntry& rt)
+{
+    NS_LOG_FUNCTION(this << dst);
+    m_selectedRoutes.erase(dst);
+    if (rt.GetVectorSize() < 2)
+    {
+        return;
+    }
+    for (const WDsrPath* i = PeekPointer(rt.GetPath()); i->GetParent();
+         i = PeekPointer(i->GetParent()))
+    {
+        const WDsrPath* prev = PeekPointer(i->GetParent());
+        DecrementIndex(m_linkIndex, RouteLink(prev->GetAddress(), i->GetAddress()), dst);
+        if (prev->GetSize() > 1)
+        {
+            DecrementIndex(m_nodeIndex, prev->GetAddress(), dst);
         }
     }
 }
 
+void
+WDsrRouteCache::ScheduleExpiry(Ipv4Address dst, Time expireAt)
+{
+    NS_LOG_FUNCTION(this << dst << expireAt);
+    m_expiryQueue.push(std::make_pair(expireAt, dst));
+    /*
+     * Refreshed and deleted entries leave their old records behind, rebuild the heap from the
+     * cache when the outdated records clearly outnumber the live ones
+     */
+    if (m_expiryQueue.size() > 2 * m_maxEntriesEachDst * (m_sortedRoutes.size() + 1))
+    {
+        std::vector<ExpiryRecord> records;
+        for (std::map<Ipv4Address, std::list<WDsrRouteCacheEntry>>::const_iterator i =
+                 m_sortedRoutes.begin();
+             i != m_sortedRoutes.end();
+             ++i)
+        {
+            for (std::list<WDsrRouteCacheEntry>::const_iterator j = i->second.begin();
+                 j != i->second.end();
+                 ++j)
+            {
+                records.push_back(std::make_pair(j->GetExpireAt(), i->first));
+            }
+        }
+        m_expiryQueue = std::priority_queue<ExpiryRecord,
+                                            std::vector<ExpiryRecord>,
+                                            std::greater<ExpiryRecord>>(
+            std::greater<ExpiryRecord>(),
+            std::move(records));
+    }
+}
+
 void
 WDsrRouteCache::Print(std::ostream& os)
 {
@@ -1286,133 +2019,513 @@ WDsrRouteCache::GetAckSize()
 
 // ----------------------------------------------------------------------------------------------------------
 /**
- * This part maintains a neighbor list to handle unidirectional links and link-layer acks
+ * This part saves and loads route cache snapshots, the values are written least significant byte
+ * first
  */
-bool
-WDsrRouteCache::IsNeighbor(Ipv4Address addr)
+
+/// Tag at the start of a route cache snapshot, "WDRC"
+static const uint32_t WDSR_SNAPSHOT_MAGIC = 0x57445243;
+/// Version of the route cache snapshot format
+static const uint8_t WDSR_SNAPSHOT_VERSION = 1;
+
+/**
+ * \brief Write an integer to a snapshot
+ * \param os the output stream
+ * \param value the value
+ */
+template <typename T>
+static void
+WriteSnapshotValue(std::ostream& os, T value)
 {
-    NS_LOG_FUNCTION(this);
-    PurgeMac(); // purge the mac cache
-    for (std::vector<Neighbor>::const_iterator i = m_nb.begin(); i != m_nb.end(); ++i)
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        os.put(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+    }
+}
+
+/**
+ * \brief Read an integer from a snapshot
+ * \param is the input stream
+ * \param value the value read
+ * \return false if the stream ended
+ */
+template <typename T>
+static bool
+ReadSnapshotValue(std::istream& is, T& value)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
     {
-        if (i->m_neighborAddress == addr)
+        std::istream::int_type c = is.get();
+        if (c == std::istream::traits_type::eof())
         {
-            return true;
+            return false;
         }
+        v |= static_cast<uint64_t>(static_cast<uint8_t>(c)) << (8 * i);
     }
-    return false;
+    value = static_cast<T>(v);
+    return true;
 }
 
-Time
-WDsrRouteCache::GetExpireTime(Ipv4Address addr)
+/**
+ * \brief Write an address to a snapshot
+ * \param os the output stream
+ * \param address the address
+ */
+static void
+WriteSnapshotAddress(std::ostream& os, Ipv4Address address)
 {
-    NS_LOG_FUNCTION(this);
+    WriteSnapshotValue<uint32_t>(os, address.Get());
+}
+
+/**
+ * \brief Read an address from a snapshot
+ * \param is the input stream
+ * \param address the address read
+ * \return false if the stream ended
+ */
+static bool
+ReadSnapshotAddress(std::istream& is, Ipv4Address& address)
+{
+    uint32_t v;
+    if (!ReadSnapshotValue(is, v))
+    {
+        return false;
+    }
+    address.Set(v);
+    return true;
+}
+
+/**
+ * \brief Write a duration to a snapshot, in nanoseconds
+ * \param os the output stream
+ * \param t the duration
+ */
+static void
+WriteSnapshotTime(std::ostream& os, Time t)
+{
+    WriteSnapshotValue<int64_t>(os, t.GetNanoSeconds());
+}
+
+/**
+ * \brief Read a duration from a snapshot
+ * \param is the input stream
+ * \param t the duration read
+ * \return false if the stream ended
+ */
+static bool
+ReadSnapshotTime(std::istream& is, Time& t)
+{
+    int64_t v;
+    if (!ReadSnapshotValue(is, v))
+    {
+        return false;
+    }
+    t = NanoSeconds(v);
+    return true;
+}
+
+void
+WDsrRouteCache::WriteSnapshot(std::ostream& os, Ipv4Address node)
+{
+    NS_LOG_FUNCTION(this << node);
+    Purge();
+    PurgeLinkNode();
     PurgeMac();
-    for (std::vector<Neighbor>::const_iterator i = m_nb.begin(); i != m_nb.end(); ++i)
+    WriteSnapshotValue(os, WDSR_SNAPSHOT_MAGIC);
+    WriteSnapshotValue(os, WDSR_SNAPSHOT_VERSION);
+    WriteSnapshotAddress(os, node);
+    /*
+     * Path cache routes
+     */
+    uint32_t routes = 0;
+    for (std::map<Ipv4Address, routeEntryVector>::const_iterator i = m_sortedRoutes.begin();
+         i != m_sortedRoutes.end();
+         ++i)
+    {
+        routes += i->second.size();
+    }
+    WriteSnapshotValue(os, routes);
+    for (std::map<Ipv4Address, routeEntryVector>::const_iterator i = m_sortedRoutes.begin();
+         i != m_sortedRoutes.end();
+         ++i)
     {
-        if (i->m_neighborAddress == addr)
+        for (routeEntryVector::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
         {
-            return (i->m_expireTime - Simulator::Now());
+            WriteSnapshotAddress(os, i->first);
+            WriteSnapshotValue(os, j->GetLowestBat());
+            WriteSnapshotValue(os, j->GetTxCost());
+            WriteSnapshotTime(os, j->GetExpireTime());
+            WDsrRouteCacheEntry::IP_VECTOR path = j->GetVector();
+            WriteSnapshotValue<uint16_t>(os, path.size());
+            for (WDsrRouteCacheEntry::IP_VECTOR::const_iterator k = path.begin(); k != path.end();
+                 ++k)
+            {
+                WriteSnapshotAddress(os, *k);
+            }
         }
     }
-    return Seconds(0);
+    /*
+     * Link cache links and nodes
+     */
+    WriteSnapshotValue<uint32_t>(os, m_linkCache.size());
+    for (std::map<Link, WDsrLinkStab>::const_iterator i = m_linkCache.begin();
+         i != m_linkCache.end();
+         ++i)
+    {
+        WriteSnapshotAddress(os, i->first.m_low);
+        WriteSnapshotAddress(os, i->first.m_high);
+        WriteSnapshotTime(os, i->second.GetLinkStability());
+        WriteSnapshotValue(os, i->second.GetTxCost());
+    }
+    WriteSnapshotValue<uint32_t>(os, m_nodeCache.size());
+    for (std::map<Ipv4Address, WDsrNodeStab>::const_iterator i = m_nodeCache.begin();
+         i != m_nodeCache.end();
+         ++i)
+    {
+        WriteSnapshotAddress(os, i->first);
+        WriteSnapshotTime(os, i->second.GetNodeStability());
+        WriteSnapshotValue(os, i->second.GetBattery());
+    }
+    /*
+     * Neighbors
+     */
+    WriteSnapshotValue<uint32_t>(os, m_nb.size());
+    for (std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::const_iterator i =
+             m_nb.begin();
+         i != m_nb.end();
+         ++i)
+    {
+        WriteSnapshotAddress(os, i->second.m_neighborAddress);
+        uint8_t mac[6];
+        i->second.m_hardwareAddress.CopyTo(mac);
+        os.write(reinterpret_cast<const char*>(mac), sizeof(mac));
+        WriteSnapshotTime(os, i->second.m_expireTime - Simulator::Now());
+    }
 }
 
-void
-WDsrRouteCache::UpdateNeighbor(std::vector<Ipv4Address> nodeList, Time expire)
+bool
+WDsrRouteCache::ReadSnapshot(std::istream& is, Ipv4Address node)
 {
-    NS_LOG_FUNCTION(this);
-    for (std::vector<Neighbor>::iterator i = m_nb.begin(); i != m_nb.end(); ++i)
+    return DoReadSnapshot(is, node, false, Time(0));
+}
+
+bool
+WDsrRouteCache::ReadSnapshot(std::istream& is, Ipv4Address node, Time routeLifetime)
+{
+    return DoReadSnapshot(is, node, true, routeLifetime);
+}
+
+bool
+WDsrRouteCache::DoReadSnapshot(std::istream& is, Ipv4Address node, bool restamp, Time routeLifetime)
+{
+    NS_LOG_FUNCTION(this << node << restamp << routeLifetime);
+    uint32_t magic;
+    uint8_t version;
+    Ipv4Address owner;
+    if (!ReadSnapshotValue(is, magic) || magic != WDSR_SNAPSHOT_MAGIC ||
+        !ReadSnapshotValue(is, version) || version != WDSR_SNAPSHOT_VERSION ||
+        !ReadSnapshotAddress(is, owner))
+    {
+        NS_LOG_WARN("Not a route cache snapshot");
+        return false;
+    }
+    if (owner != node)
+    {
+        NS_LOG_WARN("The snapshot of " << owner << " does not belong to " << node);
+        return false;
+    }
+    /*
+     * The whole snapshot is read before the cache is changed, a corrupted one is not loaded
+     */
+    std::vector<WDsrRouteCacheEntry> routes;
+    uint32_t count;
+    if (!ReadSnapshotValue(is, count))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i)
     {
-        for (std::vector<Ipv4Address>::iterator j = nodeList.begin(); j != nodeList.end(); ++j)
+        Ipv4Address dst;
+        uint8_t lowestBat;
+        uint8_t txCost;
+        Time expire;
+        uint16_t size;
+        if (!ReadSnapshotAddress(is, dst) || !ReadSnapshotValue(is, lowestBat) ||
+            !ReadSnapshotValue(is, txCost) || !ReadSnapshotTime(is, expire) ||
+            !ReadSnapshotValue(is, size))
+        {
+            NS_LOG_WARN("Truncated route cache snapshot");
+            return false;
+        }
+        WDsrRouteCacheEntry::IP_VECTOR path(size);
+        for (uint16_t j = 0; j < size; ++j)
         {
-            if (i->m_neighborAddress == (*j))
+            if (!ReadSnapshotAddress(is, path[j]))
             {
-                i->m_expireTime = std::max(expire + Simulator::Now(), i->m_expireTime);
-                if (i->m_hardwareAddress == Mac48Address())
-                {
-                    i->m_hardwareAddress = LookupMacAddress(i->m_neighborAddress);
-                }
-                return;
+                NS_LOG_WARN("Truncated route cache snapshot");
+                return false;
             }
         }
+        WDsrRouteCacheEntry entry(path, dst, restamp ? routeLifetime : expire);
+        entry.SetLowestBat(lowestBat);
+        entry.SetTxCost(txCost);
+        routes.push_back(entry);
+    }
+    std::vector<std::pair<Link, WDsrLinkStab>> links;
+    if (!ReadSnapshotValue(is, count))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Ipv4Address low;
+        Ipv4Address high;
+        Time stability;
+        uint8_t txCost;
+        if (!ReadSnapshotAddress(is, low) || !ReadSnapshotAddress(is, high) ||
+            !ReadSnapshotTime(is, stability) || !ReadSnapshotValue(is, txCost))
+        {
+            NS_LOG_WARN("Truncated route cache snapshot");
+            return false;
+        }
+        WDsrLinkStab stab(stability);
+        stab.SetTxCost(txCost);
+        links.emplace_back(Link(low, high), stab);
+    }
+    std::vector<std::pair<Ipv4Address, WDsrNodeStab>> nodes;
+    if (!ReadSnapshotValue(is, count))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Ipv4Address address;
+        Time stability;
+        uint8_t battery;
+        if (!ReadSnapshotAddress(is, address) || !ReadSnapshotTime(is, stability) ||
+            !ReadSnapshotValue(is, battery))
+        {
+            NS_LOG_WARN("Truncated route cache snapshot");
+            return false;
+        }
+        WDsrNodeStab stab(stability);
+        stab.SetBattery(battery);
+        nodes.emplace_back(address, stab);
+    }
+    std::vector<Neighbor> neighbors;
+    if (!ReadSnapshotValue(is, count))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Ipv4Address address;
+        uint8_t mac[6];
+        Time expire;
+        if (!ReadSnapshotAddress(is, address) ||
+            !is.read(reinterpret_cast<char*>(mac), sizeof(mac)) || !ReadSnapshotTime(is, expire))
+        {
+            NS_LOG_WARN("Truncated route cache snapshot");
+            return false;
+        }
+        Mac48Address hardware;
+        hardware.CopyFrom(mac);
+        neighbors.emplace_back(address, hardware, expire + Simulator::Now());
+    }
+    /*
+     * Load the snapshot, the entries that have expired since it was taken are left out
+     */
+    for (std::vector<WDsrRouteCacheEntry>::iterator i = routes.begin(); i != routes.end(); ++i)
+    {
+        if (i->GetExpireTime() > Time(0))
+        {
+            AddRoute(*i);
+        }
+    }
+    bool graphChanged = false;
+    for (std::vector<std::pair<Link, WDsrLinkStab>>::const_iterator i = links.begin();
+         i != links.end();
+         ++i)
+    {
+        if (i->second.GetLinkStability() > Time(0))
+        {
+            m_linkCache[i->first] = i->second;
+            graphChanged = true;
+        }
+    }
+    for (std::vector<std::pair<Ipv4Address, WDsrNodeStab>>::const_iterator i = nodes.begin();
+         i != nodes.end();
+         ++i)
+    {
+        if (i->second.GetNodeStability() > Time(0))
+        {
+            m_nodeCache[i->first] = i->second;
+            graphChanged = true;
+        }
+    }
+    if (graphChanged)
+    {
+        UpdateNetGraph();
+    }
+    for (std::vector<Neighbor>::const_iterator i = neighbors.begin(); i != neighbors.end(); ++i)
+    {
+        if (m_nb.emplace(i->m_neighborAddress, *i).second)
+        {
+            ScheduleNeighborExpiry(i->m_neighborAddress, i->m_expireTime);
+        }
     }
-
-    Ipv4Address addr;
-    NS_LOG_LOGIC("Open link to " << addr);
-    Neighbor neighbor(addr, LookupMacAddress(addr), expire + Simulator::Now());
-    m_nb.push_back(neighbor);
     PurgeMac();
+    NS_LOG_LOGIC("Loaded " << routes.size() << " routes, " << links.size() << " links, "
+                           << nodes.size() << " nodes and " << neighbors.size() << " neighbors");
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------------
+/**
+ * This part maintains a neighbor list to handle unidirectional links and link-layer acks
+ */
+bool
+WDsrRouteCache::IsNeighbor(Ipv4Address addr)
+{
+    NS_LOG_FUNCTION(this);
+    std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::const_iterator i = m_nb.find(addr);
+    // The timer removes the expired neighbors, one may be left within the current time step
+    return i != m_nb.end() && i->second.m_expireTime >= Simulator::Now();
+}
+
+Time
+WDsrRouteCache::GetExpireTime(Ipv4Address addr)
+{
+    NS_LOG_FUNCTION(this);
+    std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::const_iterator i = m_nb.find(addr);
+    if (i != m_nb.end() && i->second.m_expireTime >= Simulator::Now())
+    {
+        return (i->second.m_expireTime - Simulator::Now());
+    }
+    return Seconds(0);
+}
+
+void
+WDsrRouteCache::UpdateNeighbor(std::vector<Ipv4Address> nodeList, Time expire)
+{
+    NS_LOG_FUNCTION(this);
+    for (std::vector<Ipv4Address>::const_iterator j = nodeList.begin(); j != nodeList.end(); ++j)
+    {
+        RefreshNeighbor(*j, expire + Simulator::Now());
+    }
 }
 
 void
 WDsrRouteCache::AddNeighbor(std::vector<Ipv4Address> nodeList, Ipv4Address ownAddress, Time expire)
 {
     NS_LOG_LOGIC("Add neighbor number " << nodeList.size());
-    for (std::vector<Ipv4Address>::iterator j = nodeList.begin(); j != nodeList.end();)
+    for (std::vector<Ipv4Address>::const_iterator j = nodeList.begin(); j != nodeList.end(); ++j)
     {
-        Ipv4Address addr = *j;
-        if (addr == ownAddress)
+        if (*j != ownAddress)
         {
-            j = nodeList.erase(j);
-            NS_LOG_DEBUG("The node list size " << nodeList.size());
+            RefreshNeighbor(*j, expire + Simulator::Now());
         }
-        else
-        {
-            ++j;
-        }
-        Neighbor neighbor(addr, LookupMacAddress(addr), expire + Simulator::Now());
-        m_nb.push_back(neighbor);
-        PurgeMac();
     }
 }
 
-/// CloseNeighbor structure
-struct CloseNeighbor
+void
+WDsrRouteCache::RefreshNeighbor(Ipv4Address addr, Time expireAt)
 {
-    /**
-     * Check if the entry is expired
-     *
-     * \param nb WDsrRouteCache::Neighbor entry
-     * \return true if expired or closed, false otherwise
-     */
-    bool operator()(const WDsrRouteCache::Neighbor& nb) const
+    NS_LOG_FUNCTION(this << addr << expireAt);
+    std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::iterator i = m_nb.find(addr);
+    if (i == m_nb.end())
     {
-        return ((nb.m_expireTime < Simulator::Now()) || nb.close);
+        NS_LOG_LOGIC("Open link to " << addr);
+        m_nb.emplace(addr, Neighbor(addr, LookupMacAddress(addr), expireAt));
     }
-};
+    else
+    {
+        if (i->second.m_hardwareAddress == Mac48Address())
+        {
+            i->second.m_hardwareAddress = LookupMacAddress(addr);
+        }
+        if (expireAt <= i->second.m_expireTime)
+        {
+            return;
+        }
+        i->second.m_expireTime = expireAt;
+    }
+    ScheduleNeighborExpiry(addr, expireAt);
+}
 
 void
-WDsrRouteCache::PurgeMac()
+WDsrRouteCache::ScheduleNeighborExpiry(Ipv4Address addr, Time expireAt)
 {
-    if (m_nb.empty())
+    NS_LOG_FUNCTION(this << addr << expireAt);
+    m_nbExpiryQueue.push(std::make_pair(expireAt, addr));
+    // Rebuild the heap from the table once the outdated records outnumber the live ones
+    if (m_nbExpiryQueue.size() > 2 * (m_nb.size() + 1))
     {
-        return;
+        std::vector<ExpiryRecord> records;
+        records.reserve(m_nb.size());
+        for (std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::const_iterator i =
+                 m_nb.begin();
+             i != m_nb.end();
+             ++i)
+        {
+            records.push_back(std::make_pair(i->second.m_expireTime, i->first));
+        }
+        m_nbExpiryQueue = std::priority_queue<ExpiryRecord,
+                                              std::vector<ExpiryRecord>,
+                                              std::greater<ExpiryRecord>>(
+            std::greater<ExpiryRecord>(),
+            std::move(records));
     }
+    ScheduleTimer();
+}
 
-    CloseNeighbor pred;
-    if (!m_handleLinkFailure.IsNull())
+void
+WDsrRouteCache::PurgeMac()
+{
+    NS_LOG_FUNCTION(this);
+    /*
+     * Only the neighbors owning a record that has come due are visited, a neighbor is kept until
+     * its expire time has passed
+     */
+    Time now = Simulator::Now();
+    while (!m_nbExpiryQueue.empty() && m_nbExpiryQueue.top().first < now)
     {
-        for (std::vector<Neighbor>::iterator j = m_nb.begin(); j != m_nb.end(); ++j)
+        Ipv4Address addr = m_nbExpiryQueue.top().second;
+        m_nbExpiryQueue.pop();
+        std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::iterator i = m_nb.find(addr);
+        if (i != m_nb.end() && i->second.m_expireTime < now)
         {
-            if (pred(*j))
-            {
-                NS_LOG_LOGIC("Close link to " << j->m_neighborAddress);
-                /// \todo disable temporarily
-                //              m_handleLinkFailure (j->m_neighborAddress);
-            }
+            NS_LOG_LOGIC("Close link to " << addr);
+            /// \todo disable temporarily
+            //              m_handleLinkFailure (addr);
+            m_nb.erase(i);
         }
     }
-    m_nb.erase(std::remove_if(m_nb.begin(), m_nb.end(), pred), m_nb.end());
-    m_ntimer.Cancel();
-    m_ntimer.Schedule();
+    if (m_nb.empty())
+    {
+        ClearMac();
+        return;
+    }
+    ScheduleTimer();
 }
 
 void
 WDsrRouteCache::ScheduleTimer()
 {
+    if (m_nbExpiryQueue.empty())
+    {
+        m_ntimer.Cancel();
+        return;
+    }
+    // Fire right after the earliest expire time, when the neighbor has expired
+    Time delay = m_nbExpiryQueue.top().first - Simulator::Now() + TimeStep(1);
+    if (m_ntimer.IsRunning() && m_ntimer.GetDelayLeft() == delay)
+    {
+        return;
+    }
     m_ntimer.Cancel();
-    m_ntimer.Schedule();
+    m_ntimer.Schedule(delay);
 }
 
 void
@@ -1448,11 +2561,18 @@ WDsrRouteCache::ProcessTxError(const WifiMacHeader& hdr)
 {
     Mac48Address addr = hdr.GetAddr1();
 
-    for (std::vector<Neighbor>::iterator i = m_nb.begin(); i != m_nb.end(); ++i)
+    // The records of the closed neighbors are skipped when they come due
+    for (std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::iterator i = m_nb.begin();
+         i != m_nb.end();)
     {
-        if (i->m_hardwareAddress == addr)
+        if (i->second.m_hardwareAddress == addr)
         {
-            i->close = true;
+            NS_LOG_LOGIC("Close link to " << i->first);
+            i = m_nb.erase(i);
+        }
+        else
+        {
+            ++i;
         }
     }
     PurgeMac();
@@ -34,6 +34,7 @@
 #ifndef WDSR_RCACHE_H
 #define WDSR_RCACHE_H
 
+#include "wdsr-fs-header.h"
 #include "wdsr-option-header.h"
 
 #include "ns3/arp-cache.h"
@@ -49,12 +50,17 @@
 #include "ns3/simple-ref-count.h"
 #include "ns3/simulator.h"
 #include "ns3/timer.h"
+#include "ns3/traced-callback.h"
 
 #include <cassert>
+#include <functional>
 #include <iostream>
+#include <list>
 #include <map>
+#include <queue>
 #include <stdint.h>
 #include <sys/types.h>
+#include <unordered_map>
 #include <vector>
 
 namespace ns3
@@ -174,6 +180,24 @@ class WDsrLinkStab
         return m_linkStability - Simulator::Now();
     }
 
+    /**
+     * \brief set the transmission cost of the link
+     * \param txCost the transmission cost, used as the link weight
+     */
+    void SetTxCost(uint8_t txCost)
+    {
+        m_txCost = txCost;
+    }
+
+    /**
+     * \brief get the transmission cost of the link
+     * \returns the transmission cost
+     */
+    uint8_t GetTxCost() const
+    {
+        return m_txCost;
+    }
+
     /// Print function
     void Print() const;
 
@@ -183,6 +207,7 @@ class WDsrLinkStab
      * happens when purge the node and link cache before update them when receiving new information
      */
     Time m_linkStability;
+    uint8_t m_txCost; ///< The transmission cost of the link
 };
 
 /**
@@ -218,8 +243,166 @@ class WDsrNodeStab
         return m_nodeStability - Simulator::Now();
     }
 
+    /**
+     * Set the remaining battery of the node
+     * \param battery the remaining battery in 63rd parts, as carried by the lowestBat field
+     */
+    void SetBattery(uint8_t battery)
+    {
+        m_battery = battery;
+    }
+
+    /**
+     * Get the remaining battery of the node
+     * \returns the remaining battery in 63rd parts, a full battery when nothing is known
+     */
+    uint8_t GetBattery() const
+    {
+        return m_battery;
+    }
+
   private:
     Time m_nodeStability; ///< the node stability
+    uint8_t m_battery;    ///< the remaining battery of the node
+};
+
+/**
+ * \brief The wdsr header of the data packets originated along a path
+ *
+ * The source route option is serialized once, sending a data packet only prepends the header.
+ */
+struct WDsrHeaderTemplate
+{
+    uint8_t protocol;               ///< The protocol number of the payload
+    std::vector<Ipv4Address> route; ///< The addresses of the path
+    WDsrRoutingHeader header;       ///< The fixed header holding the source route option
+};
+
+/**
+ * \class WDsrPath
+ * \brief WDsrPath class (interned route path)
+ *
+ * A path is a node of a prefix trie shared by all the route caches: it holds the 16-bit id of its
+ * last node and a reference to the path of its first nodes. Routes from the same source share
+ * their prefixes, equal paths are the same object and a prefix of a path is one of its ancestors.
+ */
+class WDsrPath : public SimpleRefCount<WDsrPath>
+{
+  public:
+    /**
+     * \brief Constructor, the paths are created through Intern
+     * \param parent the path of the first nodes, null for a path of one node
+     * \param node the id of the last node
+     */
+    WDsrPath(Ptr<WDsrPath> parent, uint16_t node);
+    ~WDsrPath();
+
+    /**
+     * \brief Get the interned path of a vector of addresses
+     * \param ip the addresses of the path
+     * \return the path, null for an empty vector
+     */
+    static Ptr<WDsrPath> Intern(const std::vector<Ipv4Address>& ip);
+    /**
+     * \brief Get the interned path made of a path followed by one more node
+     * \param parent the path to extend, null to start a path
+     * \param address the address of the node to append
+     * \return the path
+     */
+    static Ptr<WDsrPath> Extend(Ptr<WDsrPath> parent, Ipv4Address address);
+    /**
+     * \brief Get the 16-bit id of an address, a new id is given to an unknown address
+     * \param address the address
+     * \return the id
+     */
+    static uint16_t GetNodeId(Ipv4Address address);
+    /**
+     * \brief Get the address of a node id
+     * \param id the id given by GetNodeId
+     * \return the address
+     */
+    static Ipv4Address GetNodeAddress(uint16_t id);
+
+    /**
+     * \brief Get the path without its last node
+     * \return the parent path, null for a path of one node
+     */
+    Ptr<WDsrPath> GetParent() const
+    {
+        return m_parent;
+    }
+
+    /**
+     * \brief Get the address of the last node
+     * \return the address
+     */
+    Ipv4Address GetAddress() const
+    {
+        return GetNodeAddress(m_node);
+    }
+
+    /**
+     * \brief Get the number of nodes in the path
+     * \return the number of nodes
+     */
+    uint16_t GetSize() const
+    {
+        return m_size;
+    }
+
+    /**
+     * \brief Get the addresses of the path
+     * \return the addresses from the first node to the last one
+     */
+    std::vector<Ipv4Address> GetVector() const;
+
+    /**
+     * \brief Get the header template of the data packets of a protocol sent along the path
+     * \param protocol the protocol number of the payload
+     * \return the template, null if none is kept
+     */
+    const WDsrHeaderTemplate* GetHeaderTemplate(uint8_t protocol) const;
+    /**
+     * \brief Keep the header template of the data packets of a protocol sent along the path
+     *
+     * The template lives as long as the path, a route that changes is another path.
+     * \param headerTemplate the template
+     * \return the template kept
+     */
+    const WDsrHeaderTemplate& SetHeaderTemplate(const WDsrHeaderTemplate& headerTemplate);
+
+  private:
+    /// The interned extensions of a path, sorted by node id
+    typedef std::vector<std::pair<uint16_t, WDsrPath*>> Children;
+    /**
+     * \brief Find the interned extension of a path by the node id
+     * \param children the interned extensions
+     * \param node the node id
+     * \return the extension, or where it would be inserted
+     */
+    static Children::iterator FindChild(Children& children, uint16_t node);
+    /// \return the interned paths of one node
+    static Children& GetRoots();
+    /// The ids of the node addresses
+    struct NodeIds
+    {
+        std::map<Ipv4Address, uint16_t> m_ids; //!< The id of each address
+        std::vector<Ipv4Address> m_addresses;  //!< The address of each id
+        bool m_destroyScheduled;               //!< Whether ClearNodeIds is scheduled
+    };
+
+    /// \return the ids of the node addresses
+    static NodeIds& GetNodeIds();
+    /// Forget the node ids when the simulation is destroyed, unless paths are still interned
+    static void ClearNodeIds();
+    /// \return the list this path is interned in
+    Children& GetSiblings() const;
+
+    Ptr<WDsrPath> m_parent; ///< The path of the first nodes
+    uint16_t m_node;        ///< The id of the last node
+    uint16_t m_size;        ///< The number of nodes
+    Children m_children;    ///< The interned extensions, they do not hold a reference
+    std::list<WDsrHeaderTemplate> m_headerTemplates; ///< The header templates by protocol
 };
 
 /**
@@ -312,16 +495,43 @@ class WDsrRouteCacheEntry
      */
     IP_VECTOR GetVector() const
     {
-        return m_path;
+        return m_path ? m_path->GetVector() : IP_VECTOR();
     }
 
     /**
      * Sets the IP vector
      * \param v the IP vector
      */
-    void SetVector(IP_VECTOR v)
+    void SetVector(const IP_VECTOR& v)
     {
-        m_path = v;
+        m_path = WDsrPath::Intern(v);
+    }
+
+    /**
+     * Get the number of addresses in the IP vector
+     * \returns the size of the IP vector
+     */
+    uint32_t GetVectorSize() const
+    {
+        return m_path ? m_path->GetSize() : 0;
+    }
+
+    /**
+     * Get the interned path
+     * \returns the path, null when the IP vector is empty
+     */
+    Ptr<WDsrPath> GetPath() const
+    {
+        return m_path;
+    }
+
+    /**
+     * Sets the interned path
+     * \param path the path
+     */
+    void SetPath(Ptr<WDsrPath> path)
+    {
+        m_path = path;
     }
 
     /**
@@ -341,6 +551,15 @@ class WDsrRouteCacheEntry
     {
         return m_expire - Simulator::Now();
     }
+
+    /**
+     * Get the absolute expire time
+     * \returns the simulation time at which the entry expires
+     */
+    Time GetExpireAt() const
+    {
+        return m_expire;
+    }
     /**
      * \brief Set the 1 reserved field to txCost
      * \param the total transmission cost of the route
@@ -374,48 +593,278 @@ class WDsrRouteCacheEntry
      */
     bool operator==(const WDsrRouteCacheEntry& o) const
     {
-        if (m_path.size() != o.m_path.size())
+        // Equal paths are interned as the same path
+        return m_path == o.m_path;
+    }
+
+    // \}
+
+  private:
+    Ipv4Address m_dst;       ///< The destination Ip address
+    Ptr<WDsrPath> m_path;    ///< brief The IP address constructed route
+    uint8_t m_lowestBat;     ///< Lowest battery cost on route
+    uint8_t m_txCost;        ///< Transmission cost for the entire route
+    uint8_t m_reqCount;      ///< Number of route requests
+    bool m_blackListState;   ///< Indicate if this entry is in "blacklist"
+    Time m_expire;           ///< Expire time for queue entry
+    Time m_blackListTimeout; ///< Time for which the node is put into the blacklist
+};
+
+/**
+ * \ingroup wdsr
+ * \brief Counters of a route cache, they can be summed over the nodes of a network
+ */
+struct WDsrRouteCacheStats
+{
+    uint64_t m_lookups;         ///< Route lookups
+    uint64_t m_hits;            ///< Lookups that found a route
+    uint64_t m_misses;          ///< Lookups that found no route
+    uint64_t m_subRouteHits;    ///< Hits on a sub route derived from the route of another node
+    uint64_t m_mtprSelections;  ///< Route selections made on the transmission cost (MTPR)
+    uint64_t m_mmbcrSelections; ///< Route selections made on the lowest battery (MMBCR)
+    uint64_t m_filteredRoutes;  ///< Routes passed over by MTPR for being below the threshold
+    uint64_t m_purgedRoutes;    ///< Routes removed when they expired
+    uint64_t m_droppedRoutes;   ///< Routes dropped to make room for a new one
+    uint64_t m_purgedLinks;     ///< Link cache links removed when they expired
+    uint64_t m_rebuilds;        ///< Full rebuilds of the link cache best route tree
+    uint64_t m_repairs;         ///< Incremental repairs of the link cache best route tree
+    Time m_rebuildTime;         ///< Wall clock time spent in the full rebuilds
+
+    /// Constructor, all the counters are zero
+    WDsrRouteCacheStats();
+
+    /**
+     * \brief Add the counters of another route cache
+     * \param o the counters to add
+     * \return this
+     */
+    WDsrRouteCacheStats& operator+=(const WDsrRouteCacheStats& o);
+
+    /**
+     * \brief Print the counters
+     * \param os the output stream
+     */
+    void Print(std::ostream& os) const;
+};
+
+/**
+ * \ingroup wdsr
+ * \brief Route selection policy of the path cache, the route with the fewest hops is used (DSR)
+ *
+ * A policy gives the Context computed once over the routes of a destination and Prefer, which
+ * tells if a route is strictly preferred over another one.  The route cache is specialized for
+ * each policy at compile time, see WDsrRouteCache::FindPolicyRoute.
+ */
+struct WDsrHopCountPolicy
+{
+    /// Nothing is computed over the routes
+    struct Context
+    {
+    };
+
+    /**
+     * \brief Compute the context of a selection
+     * \param routes the route list of the destination
+     * \return the context
+     */
+    static Context MakeContext([[maybe_unused]] const std::list<WDsrRouteCacheEntry>& routes)
+    {
+        return Context();
+    }
+
+    /**
+     * \brief Check if a route is strictly preferred over another one
+     * \param a the first route
+     * \param b the second route
+     * \param context the context of the selection
+     * \return true if a is preferred over b
+     */
+    static bool Prefer(const WDsrRouteCacheEntry& a,
+                       const WDsrRouteCacheEntry& b,
+                       [[maybe_unused]] const Context& context)
+    {
+        return a.GetVectorSize() < b.GetVectorSize();
+    }
+
+    /**
+     * \brief Count the selection made in the counters of the route cache
+     * \param context the context of the selection
+     * \param routes the route list of the destination
+     * \param stats the counters
+     */
+    static void Count([[maybe_unused]] const Context& context,
+                      [[maybe_unused]] const std::list<WDsrRouteCacheEntry>& routes,
+                      [[maybe_unused]] WDsrRouteCacheStats& stats)
+    {
+    }
+};
+
+/**
+ * \ingroup wdsr
+ * \brief Route selection policy of the path cache, the route with the highest lowest battery is
+ * used (MMBCR), the hop count breaks the ties
+ */
+struct WDsrMmbcrPolicy
+{
+    /// Nothing is computed over the routes
+    struct Context
+    {
+    };
+
+    /**
+     * \brief Compute the context of a selection
+     * \param routes the route list of the destination
+     * \return the context
+     */
+    static Context MakeContext([[maybe_unused]] const std::list<WDsrRouteCacheEntry>& routes)
+    {
+        return Context();
+    }
+
+    /**
+     * \brief Check if a route is strictly preferred over another one
+     * \param a the first route
+     * \param b the second route
+     * \param context the context of the selection
+     * \return true if a is preferred over b
+     */
+    static bool Prefer(const WDsrRouteCacheEntry& a,
+                       const WDsrRouteCacheEntry& b,
+                       [[maybe_unused]] const Context& context)
+    {
+        if (a.GetLowestBat() != b.GetLowestBat())
         {
-            NS_ASSERT(false);
-            return false;
+            return a.GetLowestBat() > b.GetLowestBat();
+        }
+        return a.GetVectorSize() < b.GetVectorSize();
+    }
+
+    /**
+     * \brief Count the selection made in the counters of the route cache
+     * \param context the context of the selection
+     * \param routes the route list of the destination
+     * \param stats the counters
+     */
+    static void Count([[maybe_unused]] const Context& context,
+                      [[maybe_unused]] const std::list<WDsrRouteCacheEntry>& routes,
+                      WDsrRouteCacheStats& stats)
+    {
+        ++stats.m_mmbcrSelections;
+    }
+};
+
+/**
+ * \ingroup wdsr
+ * \brief Route selection policy of the path cache, the route with the lowest transmission cost
+ * is used (MTPR), the hop count breaks the ties
+ */
+struct WDsrMtprPolicy
+{
+    /// Nothing is computed over the routes
+    struct Context
+    {
+    };
+
+    /**
+     * \brief Compute the context of a selection
+     * \param routes the route list of the destination
+     * \return the context
+     */
+    static Context MakeContext([[maybe_unused]] const std::list<WDsrRouteCacheEntry>& routes)
+    {
+        return Context();
+    }
+
+    /**
+     * \brief Check if a route is strictly preferred over another one
+     * \param a the first route
+     * \param b the second route
+     * \param context the context of the selection
+     * \return true if a is preferred over b
+     */
+    static bool Prefer(const WDsrRouteCacheEntry& a,
+                       const WDsrRouteCacheEntry& b,
+                       [[maybe_unused]] const Context& context)
+    {
+        if (a.GetTxCost() != b.GetTxCost())
+        {
+            return a.GetTxCost() < b.GetTxCost();
         }
-        IP_VECTOR::const_iterator j = o.m_path.begin();
-        for (IP_VECTOR::const_iterator i = m_path.begin(); i != m_path.end(); i++, j++)
+        return a.GetVectorSize() < b.GetVectorSize();
+    }
+
+    /**
+     * \brief Count the selection made in the counters of the route cache
+     * \param context the context of the selection
+     * \param routes the route list of the destination
+     * \param stats the counters
+     */
+    static void Count([[maybe_unused]] const Context& context,
+                      [[maybe_unused]] const std::list<WDsrRouteCacheEntry>& routes,
+                      WDsrRouteCacheStats& stats)
+    {
+        ++stats.m_mtprSelections;
+    }
+};
+
+/**
+ * \ingroup wdsr
+ * \brief Route selection policy of the path cache, WDSR conditional MMBCR (CCMBCR)
+ *
+ * When a route has a lowest battery above the threshold, the route with the lowest transmission
+ * cost among the ones not below the threshold is used (MTPR), otherwise the route with the
+ * highest lowest battery is used (MMBCR).  The hop count breaks the ties.
+ */
+struct WDsrCcmbcrPolicy
+{
+    /// Threshold of the selection and the mode it selects
+    struct Context
+    {
+        uint8_t m_threshold; ///< the battery threshold
+        bool m_mtpr;         ///< true when a route is above the threshold
+    };
+
+    /**
+     * \brief Compute the context of a selection
+     * \param routes the route list of the destination
+     * \return the context
+     */
+    static Context MakeContext(const std::list<WDsrRouteCacheEntry>& routes);
+
+    /**
+     * \brief Check if a route is strictly preferred over another one
+     * \param a the first route
+     * \param b the second route
+     * \param context the context of the selection
+     * \return true if a is preferred over b
+     */
+    static bool Prefer(const WDsrRouteCacheEntry& a,
+                       const WDsrRouteCacheEntry& b,
+                       const Context& context)
+    {
+        if (context.m_mtpr)
         {
-            /*
-             * Verify if neither the entry are not 0 and they equal to each other
-             */
-            if (((*i) == nullptr) || ((*j) == nullptr))
+            // The routes below the threshold are only used as a last resort
+            bool aBelow = a.GetLowestBat() < context.m_threshold;
+            bool bBelow = b.GetLowestBat() < context.m_threshold;
+            if (aBelow != bBelow)
             {
-                return false;
-            }
-            else if (!((*i) == (*j)))
-            {
-                return false;
-            }
-            else
-            {
-                return true;
+                return bBelow;
             }
+            return WDsrMtprPolicy::Prefer(a, b, WDsrMtprPolicy::Context());
         }
-        return false;
+        return WDsrMmbcrPolicy::Prefer(a, b, WDsrMmbcrPolicy::Context());
     }
 
-    // \}
-
-  private:
-    Timer m_ackTimer;             ///< RREP_ACK timer
-    Ipv4Address m_dst;            ///< The destination Ip address
-    IP_VECTOR m_path;             ///< brief The IP address constructed route
-    uint8_t m_lowestBat;          ///< Lowest battery cost on route
-    uint8_t m_txCost;             ///< Transmission cost for the entire route
-    Time m_expire;                ///< Expire time for queue entry
-    Ipv4InterfaceAddress m_iface; ///< Output interface address
-    uint8_t m_reqCount;           ///< Number of route requests
-    bool m_blackListState;        ///< Indicate if this entry is in "blacklist"
-    Time m_blackListTimeout;      ///< Time for which the node is put into the blacklist
-    Ptr<Ipv4Route> m_ipv4Route;   ///< The Ipv4 route
-    Ptr<Ipv4> m_ipv4;             ///< The Ipv4 layer 3
+    /**
+     * \brief Count the selection made in the counters of the route cache
+     * \param context the context of the selection
+     * \param routes the route list of the destination
+     * \param stats the counters
+     */
+    static void Count(const Context& context,
+                      const std::list<WDsrRouteCacheEntry>& routes,
+                      WDsrRouteCacheStats& stats);
 };
 
 /**
@@ -651,16 +1100,16 @@ class WDsrRouteCache : public Object
      * \brief Print the route vector elements
      * \param vec the route vector
      */
-    void PrintVector(std::vector<Ipv4Address>& vec);
+    void PrintVector(const std::vector<Ipv4Address>& vec);
     /**
      * \brief Print all the route vector elements from the route list
      * \param route the route list
      */
-    void PrintRouteVector(std::list<WDsrRouteCacheEntry> route);
+    void PrintRouteVector(const std::list<WDsrRouteCacheEntry>& route);
     /**
      * \brief Find the same route in the route cache
      * \param rt entry with destination address dst, if exists
-     * \param rtVector the route vector
+     * \param rtVector the cached route list of the destination, refreshed in place
      * \return true if same
      */
     bool FindSameRoute(WDsrRouteCacheEntry& rt, std::list<WDsrRouteCacheEntry>& rtVector);
@@ -694,6 +1143,77 @@ class WDsrRouteCache : public Object
     /// \param os the output stream
     void Print(std::ostream& os);
 
+    /**
+     * \brief Write a binary snapshot of the cached routes, the link and node stability and the
+     * neighbor state
+     *
+     * The expire and stability times are saved as the time left, so a snapshot taken at some
+     * point of a simulation can be loaded at the start of another one.
+     * \param os the output stream
+     * \param node the address of the node owning the cache
+     */
+    void WriteSnapshot(std::ostream& os, Ipv4Address node);
+    /**
+     * \brief Load a binary snapshot written by WriteSnapshot into the route cache
+     *
+     * The routes of the snapshot are added to the cached ones.  In link cache mode the best
+     * route tree has to be rebuilt by the caller, as the source is not known here.
+     * \param is the input stream
+     * \param node the address of the node owning the cache
+     * \return true if the snapshot was read, false if it is corrupted or of another node
+     */
+    bool ReadSnapshot(std::istream& is, Ipv4Address node);
+    /**
+     * \brief Load a binary snapshot written by WriteSnapshot into the route cache, giving the
+     * loaded routes a new lifetime
+     *
+     * The route lifetime of the loading simulation replaces the time the routes had left when
+     * the snapshot was taken, the links, nodes and neighbors keep their time left.
+     * \param is the input stream
+     * \param node the address of the node owning the cache
+     * \param routeLifetime the lifetime of the loaded routes
+     * \return true if the snapshot was read, false if it is corrupted or of another node
+     */
+    bool ReadSnapshot(std::istream& is, Ipv4Address node, Time routeLifetime);
+
+    /**
+     * \brief Get the counters of the route cache
+     * \return the counters
+     */
+    const WDsrRouteCacheStats& GetStats() const
+    {
+        return m_stats;
+    }
+
+    /// Reset the counters of the route cache
+    void ResetStats()
+    {
+        m_stats = WDsrRouteCacheStats();
+    }
+
+    /**
+     * TracedCallback signature for route lookups.
+     *
+     * \param [in] dst The destination looked up.
+     * \param [in] found True if a route was found.
+     * \param [in] subRoute True if the route was derived from the route to another node.
+     */
+    typedef void (*LookupTracedCallback)(Ipv4Address dst, bool found, bool subRoute);
+    /**
+     * TracedCallback signature for the routes removed from the path cache.
+     *
+     * \param [in] route The route removed.
+     * \param [in] expired True if the route expired, false if it was dropped for a new route.
+     */
+    typedef void (*EvictTracedCallback)(const WDsrRouteCacheEntry& route, bool expired);
+    /**
+     * TracedCallback signature for the full rebuilds of the link cache best route tree.
+     *
+     * \param [in] source The source of the tree.
+     * \param [in] duration The wall clock time taken by the rebuild.
+     */
+    typedef void (*RebuildTracedCallback)(Ipv4Address source, Time duration);
+
     //------------------------------------------------------------------------------------------
     /**
      * \brief Check for duplicate ids and save new entries if the id is not present in the table
@@ -766,7 +1286,8 @@ class WDsrRouteCache : public Object
      */
     void PurgeMac();
     /**
-     * \brief Schedule m_ntimer.
+     * \brief Schedule m_ntimer for the next neighbor to expire, it is left alone when it is
+     * already set for that time.
      */
     void ScheduleTimer();
 
@@ -776,6 +1297,10 @@ class WDsrRouteCache : public Object
     void ClearMac()
     {
         m_nb.clear();
+        m_nbExpiryQueue = std::priority_queue<ExpiryRecord,
+                                              std::vector<ExpiryRecord>,
+                                              std::greater<ExpiryRecord>>();
+        m_ntimer.Cancel();
     }
 
     /**
@@ -841,6 +1366,45 @@ class WDsrRouteCache : public Object
     std::map<Ipv4Address, routeEntryVector>
         m_sortedRoutes; ///< Map the ipv4Address to route entry vector
 
+    /// Expiry record, the absolute expire time of an entry and the destination it is filed under
+    typedef std::pair<Time, Ipv4Address> ExpiryRecord;
+    /**
+     * Min-heap of the route entry expire times. Every entry in m_sortedRoutes has a record with
+     * its current expire time; records left behind by refreshed or deleted entries are dropped
+     * lazily when they reach the top of the heap.
+     */
+    std::priority_queue<ExpiryRecord, std::vector<ExpiryRecord>, std::greater<ExpiryRecord>>
+        m_expiryQueue;
+
+    /**
+     * Inverted node index, maps a node to the destinations whose cached routes pass through it as
+     * an intermediate hop, together with the number of such routes
+     */
+    std::map<Ipv4Address, std::map<Ipv4Address, uint32_t>> m_nodeIndex;
+
+    /// Directed link between two consecutive hops of a cached route
+    typedef std::pair<Ipv4Address, Ipv4Address> RouteLink;
+    /**
+     * Inverted link index, maps a link to the destinations whose cached routes use it, together
+     * with the number of such routes
+     */
+    std::map<RouteLink, std::map<Ipv4Address, uint32_t>> m_linkIndex;
+
+    /**
+     * Memoized selected route of each destination, an entry is dropped whenever a route is added
+     * to or removed from the route list of its destination
+     */
+    std::map<Ipv4Address, routeEntryVector::iterator> m_selectedRoutes;
+    uint8_t m_selectedThreshold; ///< Battery threshold the memoized routes were selected with
+
+    WDsrRouteCacheStats m_stats; ///< Counters of the route cache
+    /// Trace of the route lookups
+    TracedCallback<Ipv4Address, bool, bool> m_lookupTrace;
+    /// Trace of the routes removed from the path cache
+    TracedCallback<const WDsrRouteCacheEntry&, bool> m_evictTrace;
+    /// Trace of the full rebuilds of the link cache best route tree
+    TracedCallback<Ipv4Address, Time> m_rebuildTrace;
+
     routeEntryVector m_routeEntryVector; ///< Define the route vector
 
     uint32_t m_maxEntriesEachDst; ///< number of entries for each destination
@@ -855,15 +1419,40 @@ class WDsrRouteCache : public Object
  * when the weight is calculated we normalized them: 100*weight/max of Weight
  */
 #define MAXWEIGHT 0xFFFF;
+    /// Edge of the network graph, the neighbor is given by its dense graph index
+    struct GraphEdge
+    {
+        uint32_t m_to;     ///< graph index of the neighbor
+        uint32_t m_weight; ///< weight of the link
+    };
+
     /**
-     * Current network graph state for this node, double is weight, which is calculated by the node
-     * information and link information, any time some changes of link cache and node cache change
-     * the weight and then recompute the best choice for each node
+     * Current network graph state for this node, the nodes are numbered densely in m_graphIds and
+     * every node keeps an array of its edges. Any time the link cache or node cache changes the
+     * weight, the best choice for each node is recomputed.
      */
-    std::map<Ipv4Address, std::map<Ipv4Address, uint32_t>> m_netGraph;
+    std::vector<std::vector<GraphEdge>> m_netGraph;
+    std::map<Ipv4Address, uint32_t> m_graphIds; ///< Dense graph index of every node in the graph
+    std::vector<Ipv4Address> m_graphAddresses;  ///< Address of every graph index
+    std::vector<uint8_t> m_graphBattery;        ///< Remaining battery of every graph index
 
-    std::map<Ipv4Address, WDsrRouteCacheEntry::IP_VECTOR>
-        m_bestRoutesTable_link;                     ///< for link route cache
+    /**
+     * The best route table for link route cache, kept as the shortest path tree rooted at
+     * m_treeSource. The route to a destination is read back by following m_treePre from the
+     * destination to the source, so repairing the tree repairs every route below the change.
+     */
+    Ipv4Address m_treeSource;
+    bool m_treeValid;                 ///< Whether the tree has been computed for m_treeSource
+    std::vector<uint32_t> m_treeDist; ///< Distance from the tree source of every graph index
+    std::vector<uint32_t> m_treePre;  ///< Preceding graph index of every graph index
+    bool m_incrementalUpdate;         ///< Repair the tree on link changes instead of rebuilding
+    /**
+     * The fallback tree of the CCMBCR selection, the routes with the maximum bottleneck battery
+     * (MMBCR) for the destinations the shortest path tree cannot reach through nodes above the
+     * battery threshold. It is only computed when such a destination is looked up.
+     */
+    std::vector<uint32_t> m_widestPre;
+    bool m_widestValid; ///< Whether m_widestPre is up to date with the graph
     std::map<Link, WDsrLinkStab> m_linkCache;        ///< The data structure to store link info
     std::map<Ipv4Address, WDsrNodeStab> m_nodeCache; ///< The data structure to store node info
     /**
@@ -873,6 +1462,14 @@ class WDsrRouteCache : public Object
      * \return true if route route found
      */
     bool LookupRoute_Link(Ipv4Address id, WDsrRouteCacheEntry& rt);
+    /**
+     * \brief used by LookupRoute when PathCache
+     * \param id the ip address we are looking for
+     * \param rt the route cache entry to store the found one
+     * \param subRoute set to true when the route was derived from the route to another node
+     * \return true if route route found
+     */
+    bool LookupRoute_Path(Ipv4Address id, WDsrRouteCacheEntry& rt, bool& subRoute);
     /**
      * \brief increase the stability of the node
      * \param node the ip address of the node we want to increase stability
@@ -885,6 +1482,174 @@ class WDsrRouteCache : public Object
      * \return true if success
      */
     bool DecStability(Ipv4Address node);
+    /**
+     * \brief Record the expire time of a path cache entry in the expiry heap
+     * \param dst the destination the entry is filed under
+     * \param expireAt the absolute expire time of the entry
+     */
+    void ScheduleExpiry(Ipv4Address dst, Time expireAt);
+    /**
+     * \brief Remove the expired entries of a single destination in place
+     * \param dst the destination to purge
+     */
+    void PurgeDestination(Ipv4Address dst);
+    /**
+     * \brief Load a binary snapshot written by WriteSnapshot into the route cache
+     * \param is the input stream
+     * \param node the address of the node owning the cache
+     * \param restamp true to give the loaded routes routeLifetime instead of their time left
+     * \param routeLifetime the lifetime of the loaded routes when restamp is true
+     * \return true if the snapshot was read, false if it is corrupted or of another node
+     */
+    bool DoReadSnapshot(std::istream& is, Ipv4Address node, bool restamp, Time routeLifetime);
+    /**
+     * \brief Select the route to use for a destination under the route policy
+     *
+     * The choice is memoized until the route list of the destination, the battery threshold or
+     * the policy changes.
+     * \param dst the destination the routes are filed under
+     * \param rtVector the non empty route list of the destination
+     * \return the selected route
+     */
+    routeEntryVector::iterator SelectRoute(Ipv4Address dst, routeEntryVector& rtVector);
+    /**
+     * \brief Find the most or the least preferred route of a destination under a policy
+     * \tparam Policy the route selection policy
+     * \tparam Least true to find the least preferred route
+     * \param rtVector the non empty route list of the destination
+     * \return the route, the first one in the list among equals
+     */
+    template <class Policy, bool Least>
+    routeEntryVector::iterator FindRoute(routeEntryVector& rtVector);
+
+    /**
+     * \brief Find the most or the least preferred route of a destination under the route policy
+     *
+     * A switch over the policy calls the FindRoute instantiation of the policy, which is inlined
+     * with no indirect call.
+     * \tparam Least true to find the least preferred route
+     * \param rtVector the non empty route list of the destination
+     * \return the route, the first one in the list among equals
+     */
+    template <bool Least>
+    routeEntryVector::iterator FindPolicyRoute(routeEntryVector& rtVector);
+
+    /// Route selection policies of the path cache
+    enum RoutePolicy
+    {
+        HOP_COUNT, ///< WDsrHopCountPolicy
+        MMBCR,     ///< WDsrMmbcrPolicy
+        MTPR,      ///< WDsrMtprPolicy
+        CCMBCR,    ///< WDsrCcmbcrPolicy
+    };
+
+    std::string m_routePolicy; ///< Name of the route selection policy
+    RoutePolicy m_policy;      ///< The route selection policy
+    /**
+     * \brief Get the dense graph index of a node, adding the node to the graph when it is new
+     * \param address the ip address of the node
+     * \return the graph index
+     */
+    uint32_t GetGraphId(Ipv4Address address);
+    /**
+     * \brief Remove the link between two graph nodes from m_netGraph
+     * \param u graph index of one end
+     * \param v graph index of the other end
+     * \return true if the link was in the graph
+     */
+    bool RemoveGraphLink(uint32_t u, uint32_t v);
+    /**
+     * \brief Add the link between two graph nodes to m_netGraph or update its weight
+     * \param u graph index of one end
+     * \param v graph index of the other end
+     * \param weight the weight of the link
+     * \return the previous weight of the link, 0 if the link is new
+     */
+    uint32_t SetGraphLink(uint32_t u, uint32_t v, uint32_t weight);
+    /**
+     * \brief Check if a node may forward on a shortest path tree route, its battery has to be
+     * above the threshold
+     * \param u graph index of the node
+     * \return true if the node can be an intermediate node
+     */
+    bool IsRelay(uint32_t u) const;
+    /**
+     * \brief Compute m_widestPre, the routes with the maximum bottleneck battery from m_treeSource
+     */
+    void RebuildWidestTree();
+    /**
+     * \brief Compare two candidate preceding nodes of equal distance, the link with the longest
+     * expected lifetime wins
+     * \param node graph index of the node
+     * \param oldPre graph index of the current preceding node
+     * \param newPre graph index of the candidate preceding node
+     * \return true if the candidate should replace the current preceding node
+     */
+    bool PreferLink(uint32_t node, uint32_t oldPre, uint32_t newPre);
+    /**
+     * \brief Relax a link of the shortest path tree
+     * \param from graph index of the node the link is used from
+     * \param to graph index of the node the link leads to
+     * \param weight the weight of the link
+     * \return true if the distance of to decreased
+     */
+    bool RelaxLink(uint32_t from, uint32_t to, uint32_t weight);
+    /// Heap entry of the shortest path computation, a distance and a graph index
+    typedef std::pair<uint32_t, uint32_t> TreeHeapEntry;
+    /// Min-heap used by the shortest path computation
+    typedef std::priority_queue<TreeHeapEntry,
+                                std::vector<TreeHeapEntry>,
+                                std::greater<TreeHeapEntry>>
+        TreeHeap;
+    /**
+     * \brief Run Dijkstra from the nodes in the heap until no distance can be decreased
+     * \param heap the nodes whose distance has just decreased
+     */
+    void PropagateTree(TreeHeap& heap);
+    /**
+     * \brief Repair the shortest path tree after a link was added or its weight decreased
+     * \param u graph index of one end
+     * \param v graph index of the other end
+     * \param weight the weight of the link
+     */
+    void RepairLinkUp(uint32_t u, uint32_t v, uint32_t weight);
+    /**
+     * \brief Repair the shortest path tree after a link was removed or its weight increased, only
+     * the subtree hanging below the link is recomputed
+     * \param u graph index of one end
+     * \param v graph index of the other end
+     */
+    void RepairLinkDown(uint32_t u, uint32_t v);
+    /**
+     * \brief Check if the shortest path tree can be repaired in place for the source
+     * \param source the source of the routes
+     * \return true if the tree is valid for the source and incremental update is enabled
+     */
+    bool CanRepairTree(Ipv4Address source) const
+    {
+        return m_incrementalUpdate && m_treeValid && m_treeSource == source;
+    }
+    /**
+     * \brief Add the intermediate nodes and the links of a cached route to the node and link
+     * indexes, the selected route of the destination is dropped
+     * \param dst the destination the route is filed under
+     * \param rt the route cache entry
+     */
+    void IndexRoute(Ipv4Address dst, const WDsrRouteCacheEntry& rt);
+    /**
+     * \brief Remove the intermediate nodes and the links of a cached route from the node and link
+     * indexes, the selected route of the destination is dropped
+     * \param dst the destination the route is filed under
+     * \param rt the route cache entry
+     */
+    void UnindexRoute(Ipv4Address dst, const WDsrRouteCacheEntry& rt);
+    /**
+     * \brief Unindex a route dropped to make room for a new route of its destination, and
+     * count it
+     * \param dst the destination the route is filed under
+     * \param rt the route cache entry
+     */
+    void DropRoute(Ipv4Address dst, const WDsrRouteCacheEntry& rt);
 
   public:
     /**
@@ -893,6 +1658,22 @@ class WDsrRouteCache : public Object
      * cache
      */
     void SetCacheType(std::string type);
+    /**
+     * \brief Set the route selection policy of the path cache
+     *
+     * The route cache is specialized for each policy at compile time, the name only picks the
+     * instantiation the lookups switch to.  The link cache always uses CCMBCR.
+     * \param policy "HopCount", "MMBCR", "MTPR" or "CCMBCR", any other name is a fatal error
+     */
+    void SetRoutePolicy(std::string policy);
+    /**
+     * \brief Get the route selection policy of the path cache
+     * \return the policy name
+     */
+    std::string GetRoutePolicy() const
+    {
+        return m_routePolicy;
+    }
     /**
      * \brief is link cached
      * \return true if the link is cached
@@ -902,16 +1683,38 @@ class WDsrRouteCache : public Object
      * \brief dd route link to cache
      * \param nodelist vector of nodes
      * \param node ip address of node to add
+     * \param lowestBat the lowest battery of the intermediate nodes, as carried by the RREQ/RREP
+     * \param txCost the transmission cost of the route, 0 to count the hops
      * \return true if the link is cached
      */
-    bool AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist, Ipv4Address node);
+    bool AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist,
+                       Ipv4Address node,
+                       uint8_t lowestBat = 0x3f,
+                       uint8_t txCost = 0);
     /**
-     *  \brief Rebuild the best route table
-     *  \note Use MAXWEIGHT to represeant maximum weight, use the IPv4 broadcast
-     *        address of 255.255.255.255 to represent a null preceding address
+     *  \brief Rebuild the best route table with a binary heap Dijkstra over m_netGraph, the
+     *  routes go through the nodes with a battery above the threshold (MTPR)
      *  \param source The source address used for computing the routes
      */
     void RebuildBestRouteTable(Ipv4Address source);
+    /**
+     * \brief Set whether link cache changes repair the best route table in place
+     * \param incremental true to repair the affected subtree, false to always rebuild it
+     */
+    void SetIncrementalUpdate(bool incremental)
+    {
+        m_incrementalUpdate = incremental;
+    }
+
+    /**
+     * \brief Get whether link cache changes repair the best route table in place
+     * \return true if incremental update is enabled
+     */
+    bool GetIncrementalUpdate() const
+    {
+        return m_incrementalUpdate;
+    }
+
     /**
      *  \brief Purge from the cache if the stability time expired
      */
@@ -923,7 +1726,7 @@ class WDsrRouteCache : public Object
      * route chosen for a packet originated or salvaged by this node, the link's lifetime is set to
      * be at least UseExtends into the future \param rt cache entry
      */
-    void UseExtends(WDsrRouteCacheEntry::IP_VECTOR rt);
+    void UseExtends(WDsrRouteCacheEntry::IP_VECTOR const& rt);
     /**
      *  \brief Update the Net Graph for the link and node cache has changed
      */
@@ -936,15 +1739,19 @@ class WDsrRouteCache : public Object
 
     Callback<void, const WifiMacHeader&> m_txErrorCallback; ///< TX error callback
 
-    Timer m_ntimer; ///< Timer for neighbor's list. Schedule Purge().
+    Timer m_ntimer; ///< Timer for neighbor's list, set for the next neighbor to expire
 
-    std::vector<Neighbor> m_nb; ///< vector of entries
+    std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash> m_nb; ///< neighbors by address
+    /**
+     * \brief Expire times of the neighbors, the earliest first.  A neighbor whose expire time is
+     * extended gets a new record and its old one is skipped when it comes due.
+     */
+    std::priority_queue<ExpiryRecord, std::vector<ExpiryRecord>, std::greater<ExpiryRecord>>
+        m_nbExpiryQueue;
 
     std::vector<Ptr<ArpCache>>
         m_arp; ///< list of ARP cached to be used for layer 2 notifications processing
 
-    Time m_delay; ///< This timeout deals with the passive ack
-
     /// Find MAC address by IP using list of ARP caches
     /// \param addr the IPv4 address to look for
     /// \return The MAC address
@@ -953,6 +1760,19 @@ class WDsrRouteCache : public Object
     /// Process layer 2 TX error notification
     /// \param hdr Wi-Fi Mac Header
     void ProcessTxError(const WifiMacHeader& hdr);
+
+    /**
+     * \brief Add a neighbor, or extend the expire time of a known one
+     * \param addr the neighbor address
+     * \param expireAt the absolute expire time
+     */
+    void RefreshNeighbor(Ipv4Address addr, Time expireAt);
+    /**
+     * \brief Record the expire time of a neighbor and set the timer if it is the next one
+     * \param addr the neighbor address
+     * \param expireAt the absolute expire time
+     */
+    void ScheduleNeighborExpiry(Ipv4Address addr, Time expireAt);
 };
 } // namespace wdsr
 } // namespace ns3
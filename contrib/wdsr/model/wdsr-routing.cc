@@ -38,11 +38,13 @@
 #include "wdsr-routing.h"
 
 #include "wdsr-fs-header.h"
+#include "wdsr-node-directory.h"
 #include "wdsr-options.h"
 #include "wdsr-rcache.h"
 #include "wdsr-rreq-table.h"
 #include "wdsr-test.h"
 
+#include "ns3/abort.h"
 #include "ns3/adhoc-wifi-mac.h"
 #include "ns3/arp-header.h"
 #include "ns3/assert.h"
@@ -191,8 +193,10 @@ WDsrRouting::GetTypeId()
             .AddAttribute("SendBuffInterval",
                           "How often to check send buffer for packet with route.",
                           TimeValue(Seconds(500)),
-                          MakeTimeAccessor(&WDsrRouting::m_sendBuffInterval),
-                          MakeTimeChecker())
+                          MakeEmptyAttributeAccessor(),
+                          MakeTimeChecker(),
+                          TypeId::SupportLevel::DEPRECATED,
+                          "The send buffer is checked when a route is added to the route cache.")
             .AddAttribute("NodeTraversalTime",
                           "The time it takes to traverse two neighboring nodes.",
                           TimeValue(MilliSeconds(40)),
@@ -300,6 +304,12 @@ WDsrRouting::GetTypeId()
                           StringValue("PathCache"),
                           MakeStringAccessor(&WDsrRouting::m_cacheType),
                           MakeStringChecker())
+            .AddAttribute("RoutePolicy",
+                          "The route selection policy of the path cache: HopCount, MMBCR, MTPR "
+                          "or CCMBCR",
+                          StringValue("CCMBCR"),
+                          MakeStringAccessor(&WDsrRouting::m_routePolicy),
+                          MakeStringChecker())
             .AddAttribute("StabilityDecrFactor",
                           "The stability decrease factor for link cache",
                           UintegerValue(2),
@@ -325,6 +335,12 @@ WDsrRouting::GetTypeId()
                           TimeValue(Seconds(120)),
                           MakeTimeAccessor(&WDsrRouting::m_useExtends),
                           MakeTimeChecker())
+            .AddAttribute("IncrementalLinkCache",
+                          "Repair the best routes of the link cache when a link is "
+                          "added or removed instead of recomputing all of them",
+                          BooleanValue(true),
+                          MakeBooleanAccessor(&WDsrRouting::m_incrementalLinkCache),
+                          MakeBooleanChecker())
             .AddAttribute("EnableSubRoute",
                           "Enables saving of sub route when receiving "
                           "route error messages, only available when "
@@ -353,6 +369,18 @@ WDsrRouting::GetTypeId()
                           UintegerValue(2),
                           MakeUintegerAccessor(&WDsrRouting::m_numPriorityQueues),
                           MakeUintegerChecker<uint32_t>())
+            .AddAttribute("SchedulerBurst",
+                          "The max number of packets sent down from the network queues at each "
+                          "wakeup of the scheduler.",
+                          UintegerValue(4),
+                          MakeUintegerAccessor(&WDsrRouting::m_schedulerBurst),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("NextHopQuantum",
+                          "The number of bytes each next hop may send every round of the deficit "
+                          "round robin over the next hops of a network queue.",
+                          UintegerValue(1500),
+                          MakeUintegerAccessor(&WDsrRouting::m_nextHopQuantum),
+                          MakeUintegerChecker<uint32_t>(1))
             .AddAttribute("LinkAcknowledgment",
                           "Enable Link layer acknowledgment mechanism",
                           BooleanValue(true),
@@ -370,6 +398,8 @@ WDsrRouting::GetTypeId()
 }
 
 WDsrRouting::WDsrRouting()
+    : m_checkAllSendBuff(false),
+      m_networkQueueSize(0)
 {
     NS_LOG_FUNCTION_NOARGS();
 
@@ -399,10 +429,6 @@ WDsrRouting::WDsrRouting()
     Insert(rerrOption);
     Insert(ackReq);
     Insert(ack);
-
-    // Check the send buffer for sending packets
-    m_sendBuffTimer.SetFunction(&WDsrRouting::SendBuffTimerExpire, this);
-    m_sendBuffTimer.Schedule(Seconds(100));
 }
 
 WDsrRouting::~WDsrRouting()
@@ -451,6 +477,7 @@ WDsrRouting::Start()
                                               << m_maxNetworkDelay.As(Time::S));
         Ptr<wdsr::WDsrNetworkQueue> queue_i =
             CreateObject<wdsr::WDsrNetworkQueue>(m_maxNetworkSize, m_maxNetworkDelay);
+        queue_i->SetQuantum(m_nextHopQuantum);
         std::pair<std::map<uint32_t, Ptr<wdsr::WDsrNetworkQueue>>::iterator, bool> result_i =
             m_priorityQueue.insert(std::make_pair(i, queue_i));
         NS_ASSERT_MSG(result_i.second, "Error in creating queues");
@@ -472,6 +499,8 @@ WDsrRouting::Start()
     // Set the send buffer parameters
     m_sendBuffer.SetMaxQueueLen(m_maxSendBuffLen);
     m_sendBuffer.SetSendBufferTimeout(m_sendBufferTimeout);
+    m_sendBuffer.SetDropCallback(
+        MakeCallback(&TracedCallback<Ptr<const Packet>>::operator(), &m_dropTrace));
     // Set the error buffer parameters using just the send buffer parameters
     m_errorBuffer.SetMaxQueueLen(m_maxSendBuffLen);
     m_errorBuffer.SetErrorBufferTimeout(m_sendBufferTimeout);
@@ -497,6 +526,7 @@ WDsrRouting::Start()
                 Ptr<wdsr::WDsrRouteCache> routeCache = CreateObject<wdsr::WDsrRouteCache>();
                 // Configure the path cache parameters
                 routeCache->SetCacheType(m_cacheType);
+                routeCache->SetRoutePolicy(m_routePolicy);
                 routeCache->SetSubRoute(m_subRoute);
                 routeCache->SetMaxCacheLen(m_maxCacheLen);
                 routeCache->SetCacheTimeout(m_maxCacheTime);
@@ -507,6 +537,7 @@ WDsrRouting::Start()
                 routeCache->SetInitStability(m_initStability);
                 routeCache->SetMinLifeTime(m_minLifeTime);
                 routeCache->SetUseExtends(m_useExtends);
+                routeCache->SetIncrementalUpdate(m_incrementalLinkCache);
                 routeCache->ScheduleTimer();
                 // The call back to handle link error and send error message to appropriate nodes
                 /// TODO whether this SendRerrWhenBreaksLinkToNextHop is used or not
@@ -539,6 +570,8 @@ WDsrRouting::Start()
         }
         NS_ASSERT(m_mainAddress != Ipv4Address() && m_broadcast != Ipv4Address());
     }
+    // The addresses are assigned by now, index them for the other nodes
+    WDsrNodeDirectory::Add(m_node, this);
 }
 
 Ptr<NetDevice>
@@ -594,6 +627,8 @@ WDsrRouting::DoDispose()
             }
         }
     }
+    m_schedulerEvent.Cancel();
+    m_sendBuffEvent.Cancel();
     IpL4Protocol::DoDispose();
 }
 
@@ -624,6 +659,31 @@ WDsrRouting::GetRouteCache() const
     return m_routeCache;
 }
 
+void
+WDsrRouting::WriteSnapshot(std::ostream& os)
+{
+    NS_LOG_FUNCTION(this);
+    NS_ASSERT_MSG(m_routeCache, "WDSR has not been started on the node");
+    m_routeCache->WriteSnapshot(os, m_mainAddress);
+}
+
+bool
+WDsrRouting::ReadSnapshot(std::istream& is)
+{
+    NS_LOG_FUNCTION(this);
+    NS_ASSERT_MSG(m_routeCache, "WDSR has not been started on the node");
+    // The routes get the lifetime of this simulation, which may differ from the saving one
+    if (!m_routeCache->ReadSnapshot(is, m_mainAddress, Seconds(α)))
+    {
+        return false;
+    }
+    if (m_routeCache->IsLinkCache())
+    {
+        m_routeCache->RebuildBestRouteTable(m_mainAddress);
+    }
+    return true;
+}
+
 void
 WDsrRouting::SetRequestTable(Ptr<wdsr::WDsrRreqTable> q)
 {
@@ -656,18 +716,7 @@ Ptr<Node>
 WDsrRouting::GetNodeWithAddress(Ipv4Address ipv4Address)
 {
     NS_LOG_FUNCTION(this << ipv4Address);
-    int32_t nNodes = NodeList::GetNNodes();
-    for (int32_t i = 0; i < nNodes; ++i)
-    {
-        Ptr<Node> node = NodeList::GetNode(i);
-        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-        int32_t ifIndex = ipv4->GetInterfaceForAddress(ipv4Address);
-        if (ifIndex != -1)
-        {
-            return node;
-        }
-    }
-    return nullptr;
+    return WDsrNodeDirectory::GetNode(ipv4Address);
 }
 
 bool
@@ -677,7 +726,7 @@ WDsrRouting::IsLinkCache()
 }
 
 void
-WDsrRouting::UseExtends(WDsrRouteCacheEntry::IP_VECTOR rt)
+WDsrRouting::UseExtends(WDsrRouteCacheEntry::IP_VECTOR const& rt)
 {
     m_routeCache->UseExtends(rt);
 }
@@ -689,11 +738,20 @@ WDsrRouting::LookupRoute(Ipv4Address id, WDsrRouteCacheEntry& rt)
 }
 
 bool
-WDsrRouting::AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist, Ipv4Address source)
+WDsrRouting::AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist,
+                           Ipv4Address source,
+                           uint8_t lowestBat,
+                           uint8_t txCost)
 {
     Ipv4Address nextHop = SearchNextHop(source, nodelist);
     m_errorBuffer.DropPacketForErrLink(source, nextHop);
-    return m_routeCache->AddRoute_Link(nodelist, source);
+    if (!m_routeCache->AddRoute_Link(nodelist, source, lowestBat, txCost))
+    {
+        return false;
+    }
+    // A new link can complete the routes to any destination, they are all checked
+    ScheduleCheckSendBuffer();
+    return true;
 }
 
 bool
@@ -702,7 +760,13 @@ WDsrRouting::AddRoute(WDsrRouteCacheEntry& rt)
     std::vector<Ipv4Address> nodelist = rt.GetVector();
     Ipv4Address nextHop = SearchNextHop(m_mainAddress, nodelist);
     m_errorBuffer.DropPacketForErrLink(m_mainAddress, nextHop);
-    return m_routeCache->AddRoute(rt);
+    if (!m_routeCache->AddRoute(rt))
+    {
+        return false;
+    }
+    // Only the nodes of the new path have become reachable
+    ScheduleCheckSendBuffer(nodelist);
+    return true;
 }
 
 void
@@ -711,6 +775,10 @@ WDsrRouting::DeleteAllRoutesIncludeLink(Ipv4Address errorSrc,
                                        Ipv4Address node)
 {
     m_routeCache->DeleteAllRoutesIncludeLink(errorSrc, unreachNode, node);
+    if (errorSrc == m_mainAddress)
+    {
+        DropNetworkQueueNextHop(unreachNode);
+    }
 }
 
 bool
@@ -729,19 +797,7 @@ Ipv4Address
 WDsrRouting::GetIPfromMAC(Mac48Address address)
 {
     NS_LOG_FUNCTION(this << address);
-    int32_t nNodes = NodeList::GetNNodes();
-    for (int32_t i = 0; i < nNodes; ++i)
-    {
-        Ptr<Node> node = NodeList::GetNode(i);
-        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-        Ptr<NetDevice> netDevice = ipv4->GetNetDevice(1);
-
-        if (netDevice->GetAddress() == address)
-        {
-            return ipv4->GetAddress(1, 0).GetLocal();
-        }
-    }
-    return nullptr;
+    return WDsrNodeDirectory::GetAddress(address);
 }
 
 void
@@ -766,7 +822,7 @@ WDsrRouting::PrintVector(std::vector<Ipv4Address>& vec)
 }
 
 Ipv4Address
-WDsrRouting::SearchNextHop(Ipv4Address ipv4Address, std::vector<Ipv4Address>& vec)
+WDsrRouting::SearchNextHop(Ipv4Address ipv4Address, const std::vector<Ipv4Address>& vec)
 {
     NS_LOG_FUNCTION(this << ipv4Address);
     Ipv4Address nextHop;
@@ -820,32 +876,27 @@ WDsrRouting::GetProtocolNumber() const
 uint16_t
 WDsrRouting::GetIDfromIP(Ipv4Address address)
 {
-    int32_t nNodes = NodeList::GetNNodes();
-    for (int32_t i = 0; i < nNodes; ++i)
+    uint32_t id = WDsrNodeDirectory::GetId(address);
+    if (id == WDsrNodeDirectory::INVALID_ID)
     {
-        Ptr<Node> node = NodeList::GetNode(i);
-        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-        if (ipv4->GetAddress(1, 0).GetLocal() == address)
-        {
-            return uint16_t(i);
-        }
+        return WDsrFsHeader::INVALID_ID;
     }
-    return 256;
+    NS_ABORT_MSG_IF(id >= WDsrFsHeader::INVALID_ID,
+                    "Node " << id << " can not be addressed in the WDSR header");
+    return uint16_t(id);
 }
 
 Ipv4Address
 WDsrRouting::GetIPfromID(uint16_t id)
 {
-    if (id >= 256)
+    if (id >= WDsrFsHeader::INVALID_ID)
     {
-        NS_LOG_DEBUG("Exceed the node range");
+        NS_LOG_DEBUG("The id " << id << " is reserved");
         return "0.0.0.0";
     }
     else
     {
-        Ptr<Node> node = NodeList::GetNode(uint32_t(id));
-        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-        return ipv4->GetAddress(1, 0).GetLocal();
+        return WDsrNodeDirectory::GetAddress(uint32_t(id));
     }
 }
 
@@ -863,14 +914,37 @@ WDsrRouting::GetPriority(WDsrMessageType messageType)
 }
 
 void
-WDsrRouting::SendBuffTimerExpire()
+WDsrRouting::ScheduleCheckSendBuffer()
 {
-    if (m_sendBuffTimer.IsRunning())
+    // The packets are sent right after the route is added, out of the processing of the option
+    if (m_sendBuffer.GetSize() != 0)
     {
-        m_sendBuffTimer.Cancel();
+        m_checkAllSendBuff = true;
+        if (!m_sendBuffEvent.IsRunning())
+        {
+            m_sendBuffEvent = Simulator::ScheduleNow(&WDsrRouting::CheckSendBuffer, this);
+        }
+    }
+}
+
+void
+WDsrRouting::ScheduleCheckSendBuffer(const std::vector<Ipv4Address>& destinations)
+{
+    for (std::vector<Ipv4Address>::const_iterator i = destinations.begin();
+         i != destinations.end();
+         ++i)
+    {
+        if (m_sendBuffer.Find(*i) &&
+            std::find(m_sendBuffDestinations.begin(), m_sendBuffDestinations.end(), *i) ==
+                m_sendBuffDestinations.end())
+        {
+            m_sendBuffDestinations.push_back(*i);
+        }
+    }
+    if (!m_sendBuffDestinations.empty() && !m_sendBuffEvent.IsRunning())
+    {
+        m_sendBuffEvent = Simulator::ScheduleNow(&WDsrRouting::CheckSendBuffer, this);
     }
-    m_sendBuffTimer.Schedule(m_sendBuffInterval);
-    CheckSendBuffer();
 }
 
 void
@@ -879,233 +953,224 @@ WDsrRouting::CheckSendBuffer()
     NS_LOG_INFO(Simulator::Now().As(Time::S) << " Checking send buffer at " << m_mainAddress
                                              << " with size " << m_sendBuffer.GetSize());
 
-    for (std::vector<WDsrSendBuffEntry>::iterator i = m_sendBuffer.GetBuffer().begin();
-         i != m_sendBuffer.GetBuffer().end();)
+    // The route cache is looked up once for each destination to check
+    std::vector<Ipv4Address> destinations;
+    if (m_checkAllSendBuff)
+    {
+        destinations = m_sendBuffer.GetDestinations();
+    }
+    else
+    {
+        destinations.swap(m_sendBuffDestinations);
+    }
+    m_sendBuffDestinations.clear();
+    m_checkAllSendBuff = false;
+    for (std::vector<Ipv4Address>::const_iterator i = destinations.begin();
+         i != destinations.end();
+         ++i)
     {
-        NS_LOG_DEBUG("Here we try to find the data packet in the send buffer");
-        Ipv4Address destination = i->GetDestination();
         WDsrRouteCacheEntry toDst;
-        bool findRoute = m_routeCache->LookupRoute(destination, toDst);
-        if (findRoute)
+        if (!m_routeCache->LookupRoute(*i, toDst))
         {
-            NS_LOG_INFO("We have found a route for the packet");
-            Ptr<const Packet> packet = i->GetPacket();
-            Ptr<Packet> cleanP = packet->Copy();
-            uint8_t protocol = i->GetProtocol();
+            continue;
+        }
+        NS_LOG_INFO("We have found a route for the packets to " << *i);
+        // Take all the packets out first, a packet that can not be sent is buffered again
+        std::vector<WDsrSendBuffEntry> entries;
+        WDsrSendBuffEntry entry;
+        while (m_sendBuffer.Dequeue(*i, entry))
+        {
+            entries.push_back(entry);
+        }
+        for (std::vector<WDsrSendBuffEntry>::const_iterator j = entries.begin();
+             j != entries.end();
+             ++j)
+        {
+            SendBufferedPacket(*j, toDst);
+        }
+    }
+}
 
-            i = m_sendBuffer.GetBuffer().erase(i);
+void
+WDsrRouting::SendBufferedPacket(const WDsrSendBuffEntry& entry, WDsrRouteCacheEntry& toDst)
+{
+    NS_LOG_FUNCTION(this << entry.GetPacket() << entry.GetDestination());
+    Ipv4Address destination = entry.GetDestination();
+    Ptr<const Packet> packet = entry.GetPacket();
+    Ptr<Packet> cleanP = packet->Copy();
+    uint8_t protocol = entry.GetProtocol();
 
-            WDsrRoutingHeader wdsrRoutingHeader;
-            Ptr<Packet> copyP = packet->Copy();
-            Ptr<Packet> wdsrPacket = packet->Copy();
-            wdsrPacket->RemoveHeader(wdsrRoutingHeader);
-            uint32_t offset = wdsrRoutingHeader.GetWDsrOptionsOffset();
-            copyP->RemoveAtStart(offset); // Here the processed size is 8 bytes, which is the fixed
-                                          // sized extension header
-            // The packet to get ipv4 header
-            Ptr<Packet> ipv4P = copyP->Copy();
-            /*
-             * Peek data to get the option type as well as length and segmentsLeft field
-             */
-            uint32_t size = copyP->GetSize();
-            uint8_t* data = new uint8_t[size];
-            copyP->CopyData(data, size);
+    WDsrRoutingHeader wdsrRoutingHeader;
+    Ptr<Packet> copyP = packet->Copy();
+    Ptr<Packet> wdsrPacket = packet->Copy();
+    wdsrPacket->RemoveHeader(wdsrRoutingHeader);
+    uint32_t offset = wdsrRoutingHeader.GetWDsrOptionsOffset();
+    copyP->RemoveAtStart(offset); // Here the processed size is 8 bytes, which is the fixed
+                                  // sized extension header
+    /*
+     * Peek data to get the option type as well as length and segmentsLeft field
+     */
+    uint8_t data[4] = {0};
+    copyP->CopyData(data, sizeof(data));
 
-            uint8_t optionType = 0;
-            optionType = *(data);
+    uint8_t optionType = 0;
+    optionType = *(data);
 
-            if (optionType == 3)
-            {
-                Ptr<wdsr::WDsrOptions> wdsrOption;
-                WDsrOptionHeader wdsrOptionHeader;
-                uint8_t errorType = *(data + 2);
+    if (optionType == 3)
+    {
+        Ptr<wdsr::WDsrOptions> wdsrOption;
+        WDsrOptionHeader wdsrOptionHeader;
+        uint8_t errorType = *(data + 2);
 
-                if (errorType == 1) // This is the Route Error Option
-                {
-                    WDsrOptionRerrUnreachHeader rerr;
-                    copyP->RemoveHeader(rerr);
-                    NS_ASSERT(copyP->GetSize() == 0);
+        if (errorType == 1) // This is the Route Error Option
+        {
+            WDsrOptionRerrUnreachHeader rerr;
+            copyP->RemoveHeader(rerr);
+            NS_ASSERT(copyP->GetSize() == 0);
 
-                    WDsrOptionRerrUnreachHeader newUnreach;
-                    newUnreach.SetErrorType(1);
-                    newUnreach.SetErrorSrc(rerr.GetErrorSrc());
-                    newUnreach.SetUnreachNode(rerr.GetUnreachNode());
-                    newUnreach.SetErrorDst(rerr.GetErrorDst());
-                    newUnreach.SetSalvage(rerr.GetSalvage()); // Set the value about whether to
-                                                              // salvage a packet or not
+            WDsrOptionRerrUnreachHeader newUnreach;
+            newUnreach.SetErrorType(1);
+            newUnreach.SetErrorSrc(rerr.GetErrorSrc());
+            newUnreach.SetUnreachNode(rerr.GetUnreachNode());
+            newUnreach.SetErrorDst(rerr.GetErrorDst());
+            newUnreach.SetSalvage(rerr.GetSalvage()); // Set the value about whether to
+                                                      // salvage a packet or not
 
-                    WDsrOptionSRHeader sourceRoute;
-                    std::vector<Ipv4Address> errorRoute = toDst.GetVector();
-                    sourceRoute.SetNodesAddress(errorRoute);
-                    /// When found a route and use it, UseExtends to the link cache
-                    if (m_routeCache->IsLinkCache())
-                    {
-                        m_routeCache->UseExtends(errorRoute);
-                    }
-                    sourceRoute.SetSegmentsLeft((errorRoute.size() - 2));
-                    uint8_t salvage = 0;
-                    sourceRoute.SetSalvage(salvage);
-                    Ipv4Address nextHop =
-                        SearchNextHop(m_mainAddress, errorRoute); // Get the next hop address
+            WDsrOptionSRHeader sourceRoute;
+            std::vector<Ipv4Address> errorRoute = toDst.GetVector();
+            sourceRoute.SetNodesAddress(errorRoute);
+            /// When found a route and use it, UseExtends to the link cache
+            if (m_routeCache->IsLinkCache())
+            {
+                m_routeCache->UseExtends(errorRoute);
+            }
+            sourceRoute.SetSegmentsLeft((errorRoute.size() - 2));
+            uint8_t salvage = 0;
+            sourceRoute.SetSalvage(salvage);
+            Ipv4Address nextHop =
+                SearchNextHop(m_mainAddress, errorRoute); // Get the next hop address
 
-                    if (nextHop == "0.0.0.0")
-                    {
-                        PacketNewRoute(wdsrPacket, m_mainAddress, destination, protocol);
-                        return;
-                    }
+            if (nextHop == "0.0.0.0")
+            {
+                PacketNewRoute(wdsrPacket, m_mainAddress, destination, protocol);
+                return;
+            }
 
-                    SetRoute(nextHop, m_mainAddress);
-                    uint8_t length = (sourceRoute.GetLength() + newUnreach.GetLength());
-                    wdsrRoutingHeader.SetNextHeader(protocol);
-                    wdsrRoutingHeader.SetMessageType(1);
-                    wdsrRoutingHeader.SetSourceId(GetIDfromIP(m_mainAddress));
-                    wdsrRoutingHeader.SetDestId(255);
-                    wdsrRoutingHeader.SetPayloadLength(uint16_t(length) + 4);
-                    wdsrRoutingHeader.AddWDsrOption(newUnreach);
-                    wdsrRoutingHeader.AddWDsrOption(sourceRoute);
+            SetRoute(nextHop, m_mainAddress);
+            uint8_t length = (sourceRoute.GetLength() + newUnreach.GetLength());
+            wdsrRoutingHeader.SetNextHeader(protocol);
+            wdsrRoutingHeader.SetMessageType(1);
+            wdsrRoutingHeader.SetSourceId(GetIDfromIP(m_mainAddress));
+            wdsrRoutingHeader.SetDestId(WDsrFsHeader::BROADCAST_ID);
+            wdsrRoutingHeader.SetPayloadLength(uint16_t(length) + 4);
+            wdsrRoutingHeader.AddWDsrOption(newUnreach);
+            wdsrRoutingHeader.AddWDsrOption(sourceRoute);
 
-                    Ptr<Packet> newPacket = Create<Packet>();
-                    newPacket->AddHeader(wdsrRoutingHeader); // Add the routing header with rerr and
-                                                            // sourceRoute attached to it
-                    Ptr<NetDevice> dev =
-                        m_ip->GetNetDevice(m_ip->GetInterfaceForAddress(m_mainAddress));
-                    m_ipv4Route->SetOutputDevice(dev);
+            Ptr<Packet> newPacket = Create<Packet>();
+            newPacket->AddHeader(wdsrRoutingHeader); // Add the routing header with rerr and
+                                                    // sourceRoute attached to it
+            Ptr<NetDevice> dev = m_ip->GetNetDevice(m_ip->GetInterfaceForAddress(m_mainAddress));
+            m_ipv4Route->SetOutputDevice(dev);
+
+            uint32_t priority = GetPriority(WDSR_CONTROL_PACKET); /// This will be priority 0
+            std::map<uint32_t, Ptr<wdsr::WDsrNetworkQueue>>::iterator i =
+                m_priorityQueue.find(priority);
+            Ptr<wdsr::WDsrNetworkQueue> wdsrNetworkQueue = i->second;
+            NS_LOG_LOGIC("Will be inserting into priority queue number: " << priority);
+
+            // m_downTarget (newPacket, m_mainAddress, nextHop, GetProtocolNumber (),
+            // m_ipv4Route);
+
+            /// \todo New WDsrNetworkQueueEntry
+            WDsrNetworkQueueEntry newEntry(newPacket,
+                                          m_mainAddress,
+                                          nextHop,
+                                          Simulator::Now(),
+                                          m_ipv4Route);
+
+            if (wdsrNetworkQueue->Enqueue(newEntry))
+            {
+                Scheduler(priority);
+            }
+            else
+            {
+                NS_LOG_INFO("Packet dropped as wdsr network queue is full");
+            }
+        }
+    }
+    else
+    {
+        // The header with the source route option is kept with the route
+        const WDsrHeaderTemplate& headerTemplate = GetHeaderTemplate(toDst.GetPath(), protocol);
+        const std::vector<Ipv4Address>& nodeList = headerTemplate.route;
+        Ipv4Address nextHop =
+            SearchNextHop(m_mainAddress, nodeList); // Get the next hop address for the route
+        if (nextHop == "0.0.0.0")
+        {
+            PacketNewRoute(wdsrPacket, m_mainAddress, destination, protocol);
+            return;
+        }
+        /// When found a route and use it, UseExtends to the link cache
+        if (m_routeCache->IsLinkCache())
+        {
+            m_routeCache->UseExtends(nodeList);
+        }
+        AddSourceRouteHeader(cleanP, headerTemplate, m_mainAddress);
+        Ptr<const Packet> mtP = cleanP->Copy();
+        // Put the data packet in the maintenance queue for data packet retransmission
+        WDsrMaintainBuffEntry newEntry(/*packet=*/mtP,
+                                      /*ourAddress=*/m_mainAddress,
+                                      /*nextHop=*/nextHop,
+                                      /*src=*/m_mainAddress,
+                                      /*dst=*/destination,
+                                      /*ackId=*/0,
+                                      /*segsLeft=*/nodeList.size() - 2,
+                                      /*expire=*/m_maxMaintainTime);
+        bool result = m_maintainBuffer.Enqueue(
+            newEntry); // Enqueue the packet the the maintenance buffer
+        if (result)
+        {
+            NetworkKey networkKey;
+            networkKey.m_ackId = newEntry.GetAckId();
+            networkKey.m_ourAdd = newEntry.GetOurAdd();
+            networkKey.m_nextHop = newEntry.GetNextHop();
+            networkKey.m_source = newEntry.GetSrc();
+            networkKey.m_destination = newEntry.GetDst();
 
-                    uint32_t priority = GetPriority(WDSR_CONTROL_PACKET); /// This will be priority 0
-                    std::map<uint32_t, Ptr<wdsr::WDsrNetworkQueue>>::iterator i =
-                        m_priorityQueue.find(priority);
-                    Ptr<wdsr::WDsrNetworkQueue> wdsrNetworkQueue = i->second;
-                    NS_LOG_LOGIC("Will be inserting into priority queue number: " << priority);
+            PassiveKey passiveKey;
+            passiveKey.m_ackId = 0;
+            passiveKey.m_source = newEntry.GetSrc();
+            passiveKey.m_destination = newEntry.GetDst();
+            passiveKey.m_segsLeft = newEntry.GetSegsLeft();
 
-                    // m_downTarget (newPacket, m_mainAddress, nextHop, GetProtocolNumber (),
-                    // m_ipv4Route);
+            LinkKey linkKey;
+            linkKey.m_source = newEntry.GetSrc();
+            linkKey.m_destination = newEntry.GetDst();
+            linkKey.m_ourAdd = newEntry.GetOurAdd();
+            linkKey.m_nextHop = newEntry.GetNextHop();
 
-                    /// \todo New WDsrNetworkQueueEntry
-                    WDsrNetworkQueueEntry newEntry(newPacket,
-                                                  m_mainAddress,
-                                                  nextHop,
-                                                  Simulator::Now(),
-                                                  m_ipv4Route);
+            m_addressForwardCnt[networkKey] = 0;
+            m_passiveCnt[passiveKey] = 0;
+            m_linkCnt[linkKey] = 0;
 
-                    if (wdsrNetworkQueue->Enqueue(newEntry))
-                    {
-                        Scheduler(priority);
-                    }
-                    else
-                    {
-                        NS_LOG_INFO("Packet dropped as wdsr network queue is full");
-                    }
-                }
+            if (m_linkAck)
+            {
+                ScheduleLinkPacketRetry(newEntry, protocol);
             }
             else
             {
-                wdsrRoutingHeader.SetNextHeader(protocol);
-                wdsrRoutingHeader.SetMessageType(2);
-                wdsrRoutingHeader.SetSourceId(GetIDfromIP(m_mainAddress));
-                wdsrRoutingHeader.SetDestId(GetIDfromIP(destination));
-
-                WDsrOptionSRHeader sourceRoute;
-                std::vector<Ipv4Address> nodeList =
-                    toDst.GetVector(); // Get the route from the route entry we found
-                Ipv4Address nextHop =
-                    SearchNextHop(m_mainAddress,
-                                  nodeList); // Get the next hop address for the route
-                if (nextHop == "0.0.0.0")
-                {
-                    PacketNewRoute(wdsrPacket, m_mainAddress, destination, protocol);
-                    return;
-                }
-                uint8_t salvage = 0;
-                sourceRoute.SetNodesAddress(
-                    nodeList); // Save the whole route in the source route header of the packet
-                sourceRoute.SetSegmentsLeft(
-                    (nodeList.size() - 2)); // The segmentsLeft field will indicate the hops to go
-                sourceRoute.SetSalvage(salvage);
-                /// When found a route and use it, UseExtends to the link cache
-                if (m_routeCache->IsLinkCache())
-                {
-                    m_routeCache->UseExtends(nodeList);
-                }
-                uint8_t length = sourceRoute.GetLength();
-                wdsrRoutingHeader.SetPayloadLength(uint16_t(length) + 2);
-                wdsrRoutingHeader.AddWDsrOption(sourceRoute);
-                cleanP->AddHeader(wdsrRoutingHeader);
-                Ptr<const Packet> mtP = cleanP->Copy();
-                // Put the data packet in the maintenance queue for data packet retransmission
-                WDsrMaintainBuffEntry newEntry(/*packet=*/mtP,
-                                              /*ourAddress=*/m_mainAddress,
-                                              /*nextHop=*/nextHop,
-                                              /*src=*/m_mainAddress,
-                                              /*dst=*/destination,
-                                              /*ackId=*/0,
-                                              /*segsLeft=*/nodeList.size() - 2,
-                                              /*expire=*/m_maxMaintainTime);
-                bool result = m_maintainBuffer.Enqueue(
-                    newEntry); // Enqueue the packet the the maintenance buffer
-                if (result)
+                NS_LOG_LOGIC("Not using link acknowledgment");
+                if (nextHop != destination)
                 {
-                    NetworkKey networkKey;
-                    networkKey.m_ackId = newEntry.GetAckId();
-                    networkKey.m_ourAdd = newEntry.GetOurAdd();
-                    networkKey.m_nextHop = newEntry.GetNextHop();
-                    networkKey.m_source = newEntry.GetSrc();
-                    networkKey.m_destination = newEntry.GetDst();
-
-                    PassiveKey passiveKey;
-                    passiveKey.m_ackId = 0;
-                    passiveKey.m_source = newEntry.GetSrc();
-                    passiveKey.m_destination = newEntry.GetDst();
-                    passiveKey.m_segsLeft = newEntry.GetSegsLeft();
-
-                    LinkKey linkKey;
-                    linkKey.m_source = newEntry.GetSrc();
-                    linkKey.m_destination = newEntry.GetDst();
-                    linkKey.m_ourAdd = newEntry.GetOurAdd();
-                    linkKey.m_nextHop = newEntry.GetNextHop();
-
-                    m_addressForwardCnt[networkKey] = 0;
-                    m_passiveCnt[passiveKey] = 0;
-                    m_linkCnt[linkKey] = 0;
-
-                    if (m_linkAck)
-                    {
-                        ScheduleLinkPacketRetry(newEntry, protocol);
-                    }
-                    else
-                    {
-                        NS_LOG_LOGIC("Not using link acknowledgment");
-                        if (nextHop != destination)
-                        {
-                            SchedulePassivePacketRetry(newEntry, protocol);
-                        }
-                        else
-                        {
-                            // This is the first network retry
-                            ScheduleNetworkPacketRetry(newEntry, true, protocol);
-                        }
-                    }
+                    SchedulePassivePacketRetry(newEntry, protocol);
                 }
-                // we need to suspend the normal timer that checks the send buffer
-                // until we are done sending packets
-                if (!m_sendBuffTimer.IsSuspended())
+                else
                 {
-                    m_sendBuffTimer.Suspend();
+                    // This is the first network retry
+                    ScheduleNetworkPacketRetry(newEntry, true, protocol);
                 }
-                Simulator::Schedule(m_sendBuffInterval, &WDsrRouting::SendBuffTimerExpire, this);
-                return;
             }
         }
-        else
-        {
-            ++i;
-        }
-    }
-    // after going through the entire send buffer and send all packets found route,
-    // we need to resume the timer if it has been suspended
-    if (m_sendBuffTimer.IsSuspended())
-    {
-        NS_LOG_DEBUG("Resume the send buffer timer");
-        m_sendBuffTimer.Resume();
     }
 }
 
@@ -1121,19 +1186,29 @@ WDsrRouting::PromiscReceive(Ptr<NetDevice> device,
     {
         return false;
     }
-    // Remove the ipv4 header here
-    Ptr<Packet> pktMinusIpHdr = packet->Copy();
-    Ipv4Header ipv4Header;
-    pktMinusIpHdr->RemoveHeader(ipv4Header);
-
-    if (ipv4Header.GetProtocol() != WDsrRouting::PROT_NUMBER)
+    /*
+     * Every overheard frame comes here, so it is first filtered on the bytes peeked from its
+     * start: the 20 bytes IPv4 header, the wdsr fixed header and the first option type.  The
+     * frame is only copied and its headers removed when an option is processed for it.
+     */
+    uint8_t data[20 + 8 + 1];
+    if (packet->CopyData(data, sizeof(data)) != sizeof(data) || data[0] != 0x45 ||
+        data[9] != WDsrRouting::PROT_NUMBER)
+    {
+        return false;
+    }
+    const uint8_t* wdsrData = data + 20;
+    uint8_t messageType = wdsrData[1];
+    uint8_t optionType = wdsrData[8];
+    bool isSourceRoute = packetType == NetDevice::PACKET_OTHERHOST && optionType == 96;
+    if (messageType != 2 && !isSourceRoute)
     {
         return false;
     }
-    // Remove the wdsr routing header here
-    Ptr<Packet> pktMinusWDsrHdr = pktMinusIpHdr->Copy();
-    WDsrRoutingHeader wdsrRouting;
-    pktMinusWDsrHdr->RemoveHeader(wdsrRouting);
+    // The 16-bit fields of the fixed header are written low byte first, see WDsrFsHeader
+    uint16_t sourceId = wdsrData[2] | (wdsrData[3] << 8);
+    uint16_t destId = wdsrData[4] | (wdsrData[5] << 8);
+    uint16_t payloadLength = wdsrData[6] | (wdsrData[7] << 8);
 
     /*
      * Message type 2 means the data packet, we will further process the data
@@ -1143,81 +1218,64 @@ WDsrRouting::PromiscReceive(Ptr<NetDevice> device,
      */
     Ipv4Address ourAddress = m_ipv4->GetAddress(1, 0).GetLocal();
     // check if the message type is 2 and if the ipv4 address matches
-    if (wdsrRouting.GetMessageType() == 2 && ourAddress == m_mainAddress)
+    if (messageType == 2 && ourAddress == m_mainAddress)
     {
         NS_LOG_DEBUG("data packet receives " << packet->GetUid());
-        Ipv4Address sourceIp = GetIPfromID(wdsrRouting.GetSourceId());
-        Ipv4Address destinationIp = GetIPfromID(wdsrRouting.GetDestId());
         /// This is the ip address we just received data packet from
         Ipv4Address previousHop = GetIPfromMAC(Mac48Address::ConvertFrom(from));
-
-        Ptr<Packet> p = Create<Packet>();
-        // Here the segments left value need to plus one to check the earlier hop maintain buffer
-        // entry
-        WDsrMaintainBuffEntry newEntry;
-        newEntry.SetPacket(p);
-        newEntry.SetSrc(sourceIp);
-        newEntry.SetDst(destinationIp);
-        /// Remember this is the entry for previous node
-        newEntry.SetOurAdd(previousHop);
-        newEntry.SetNextHop(ourAddress);
         /// Get the previous node's maintenance buffer and passive ack
-        Ptr<Node> node = GetNodeWithAddress(previousHop);
+        Ptr<wdsr::WDsrRouting> wdsr = WDsrNodeDirectory::GetRouting(previousHop);
         NS_LOG_DEBUG("The previous node " << previousHop);
-
-        Ptr<wdsr::WDsrRouting> wdsr = node->GetObject<wdsr::WDsrRouting>();
-        wdsr->CancelLinkPacketTimer(newEntry);
+        if (wdsr)
+        {
+            // Here the segments left value need to plus one to check the earlier hop maintain
+            // buffer entry
+            WDsrMaintainBuffEntry newEntry;
+            newEntry.SetSrc(GetIPfromID(sourceId));
+            newEntry.SetDst(GetIPfromID(destId));
+            /// Remember this is the entry for previous node
+            newEntry.SetOurAdd(previousHop);
+            newEntry.SetNextHop(ourAddress);
+            wdsr->CancelLinkPacketTimer(newEntry);
+        }
     }
 
     // Receive only IP packets and packets destined for other hosts
-    if (packetType == NetDevice::PACKET_OTHERHOST)
+    if (isSourceRoute)
     {
+        // Remove the ipv4 header and the wdsr fixed header here
+        Ptr<Packet> pktMinusIpHdr = packet->Copy();
+        Ipv4Header ipv4Header;
+        pktMinusIpHdr->RemoveHeader(ipv4Header);
         // just to minimize debug output
         NS_LOG_INFO(this << from << to << packetType << *pktMinusIpHdr);
+        pktMinusIpHdr->RemoveAtStart(8);
+        // The options are skipped, not deserialized, to get the packet without the wdsr header
+        Ptr<Packet> pktMinusWDsrHdr = pktMinusIpHdr->Copy();
+        pktMinusWDsrHdr->RemoveAtStart(payloadLength);
 
-        uint8_t offset =
-            wdsrRouting
-                .GetWDsrOptionsOffset(); // Get the offset for option header, 4 bytes in this case
-        uint8_t nextHeader = wdsrRouting.GetNextHeader();
-        uint32_t sourceId = wdsrRouting.GetSourceId();
+        uint8_t nextHeader = wdsrData[0];
         Ipv4Address source = GetIPfromID(sourceId);
-
-        // This packet is used to peek option type
-        pktMinusIpHdr->RemoveAtStart(offset);
-        /*
-         * Peek data to get the option type as well as length and segmentsLeft field
-         */
-        uint32_t size = pktMinusIpHdr->GetSize();
-        uint8_t* data = new uint8_t[size];
-        pktMinusIpHdr->CopyData(data, size);
-        uint8_t optionType = 0;
-        optionType = *(data);
-
-        Ptr<wdsr::WDsrOptions> wdsrOption;
-
-        if (optionType == 96) // This is the source route option
-        {
-            Ipv4Address promiscSource = GetIPfromMAC(Mac48Address::ConvertFrom(from));
-            wdsrOption = GetOption(
-                optionType); // Get the relative WDSR option and demux to the process function
-            NS_LOG_DEBUG(Simulator::Now().As(Time::S)
-                         << " WDSR node " << m_mainAddress
-                         << " overhearing packet PID: " << pktMinusIpHdr->GetUid() << " from "
-                         << promiscSource << " to " << GetIPfromMAC(Mac48Address::ConvertFrom(to))
-                         << " with source IP " << ipv4Header.GetSource() << " and destination IP "
-                         << ipv4Header.GetDestination() << " and packet : " << *pktMinusWDsrHdr);
-
-            bool isPromisc = true; // Set the boolean value isPromisc as true
-            wdsrOption->Process(pktMinusIpHdr,
-                               pktMinusWDsrHdr,
-                               m_mainAddress,
-                               source,
-                               ipv4Header,
-                               nextHeader,
-                               isPromisc,
-                               promiscSource);
-            return true;
-        }
+        Ipv4Address promiscSource = GetIPfromMAC(Mac48Address::ConvertFrom(from));
+        // Get the relative WDSR option and demux to the process function
+        Ptr<wdsr::WDsrOptions> wdsrOption = GetOption(optionType);
+        NS_LOG_DEBUG(Simulator::Now().As(Time::S)
+                     << " WDSR node " << m_mainAddress << " overhearing packet PID: "
+                     << pktMinusIpHdr->GetUid() << " from " << promiscSource << " to "
+                     << GetIPfromMAC(Mac48Address::ConvertFrom(to)) << " with source IP "
+                     << ipv4Header.GetSource() << " and destination IP "
+                     << ipv4Header.GetDestination() << " and packet : " << *pktMinusWDsrHdr);
+
+        bool isPromisc = true; // Set the boolean value isPromisc as true
+        wdsrOption->Process(pktMinusIpHdr,
+                           pktMinusWDsrHdr,
+                           m_mainAddress,
+                           source,
+                           ipv4Header,
+                           nextHeader,
+                           isPromisc,
+                           promiscSource);
+        return true;
     }
     return false;
 }
@@ -1592,15 +1650,9 @@ WDsrRouting::Send(Ptr<Packet> packet,
         else
         {
             Ptr<Packet> cleanP = packet->Copy();
-            WDsrRoutingHeader wdsrRoutingHeader;
-            wdsrRoutingHeader.SetNextHeader(protocol);
-            wdsrRoutingHeader.SetMessageType(2);
-            wdsrRoutingHeader.SetSourceId(GetIDfromIP(source));
-            wdsrRoutingHeader.SetDestId(GetIDfromIP(destination));
-
-            WDsrOptionSRHeader sourceRoute;
-            std::vector<Ipv4Address> nodeList =
-                toDst.GetVector(); // Get the route from the route entry we found
+            // The header with the source route option is kept with the route
+            const WDsrHeaderTemplate& headerTemplate = GetHeaderTemplate(toDst.GetPath(), protocol);
+            const std::vector<Ipv4Address>& nodeList = headerTemplate.route;
             Ipv4Address nextHop =
                 SearchNextHop(m_mainAddress, nodeList); // Get the next hop address for the route
             if (nextHop == "0.0.0.0")
@@ -1608,23 +1660,12 @@ WDsrRouting::Send(Ptr<Packet> packet,
                 PacketNewRoute(cleanP, source, destination, protocol);
                 return;
             }
-            uint8_t salvage = 0;
-            sourceRoute.SetNodesAddress(
-                nodeList); // Save the whole route in the source route header of the packet
             /// When found a route and use it, UseExtends to the link cache
             if (m_routeCache->IsLinkCache())
             {
                 m_routeCache->UseExtends(nodeList);
             }
-            sourceRoute.SetSegmentsLeft(
-                (nodeList.size() - 2)); // The segmentsLeft field will indicate the hops to go
-            sourceRoute.SetSalvage(salvage);
-
-            uint8_t length = sourceRoute.GetLength();
-
-            wdsrRoutingHeader.SetPayloadLength(uint16_t(length) + 2);
-            wdsrRoutingHeader.AddWDsrOption(sourceRoute);
-            cleanP->AddHeader(wdsrRoutingHeader);
+            AddSourceRouteHeader(cleanP, headerTemplate, source);
 
             Ptr<const Packet> mtP = cleanP->Copy();
             NS_LOG_DEBUG("maintain packet size " << cleanP->GetSize());
@@ -1686,6 +1727,10 @@ WDsrRouting::Send(Ptr<Packet> packet,
             if (m_sendBuffer.GetSize() != 0 && m_sendBuffer.Find(destination))
             {
                 // Try to send packet from *previously* queued entries from send buffer if any
+                WDsrOptionSRHeader sourceRoute;
+                sourceRoute.SetNodesAddress(nodeList);
+                sourceRoute.SetSegmentsLeft((nodeList.size() - 2));
+                sourceRoute.SetSalvage(0);
                 Simulator::Schedule(MilliSeconds(m_uniformRandomVariable->GetInteger(0, 100)),
                                     &WDsrRouting::SendPacketFromBuffer,
                                     this,
@@ -1776,6 +1821,7 @@ void
 WDsrRouting::Scheduler(uint32_t priority)
 {
     NS_LOG_FUNCTION(this);
+    m_networkQueueSize++;
     PriorityScheduler(priority, true);
 }
 
@@ -1792,71 +1838,62 @@ WDsrRouting::PriorityScheduler(uint32_t priority, bool continueWithFirst)
     {
         numPriorities = priority;
     }
+    uint32_t sent = 0;
     // priorities ranging from 0 to m_numPriorityQueues, with 0 as the highest priority
-    for (uint32_t i = priority; numPriorities < m_numPriorityQueues; numPriorities++)
+    for (uint32_t i = priority; numPriorities < m_numPriorityQueues && sent < m_schedulerBurst;
+         numPriorities++)
     {
         std::map<uint32_t, Ptr<WDsrNetworkQueue>>::iterator q = m_priorityQueue.find(i);
         Ptr<wdsr::WDsrNetworkQueue> wdsrNetworkQueue = q->second;
-        uint32_t queueSize = wdsrNetworkQueue->GetSize();
-        if (queueSize == 0)
-        {
-            if ((i == (m_numPriorityQueues - 1)) && continueWithFirst)
-            {
-                i = 0;
-            }
-            else
-            {
-                i++;
-            }
-        }
-        else
+        while (m_networkQueueSize > 0 && sent < m_schedulerBurst)
         {
-            uint32_t totalQueueSize = 0;
-            for (std::map<uint32_t, Ptr<wdsr::WDsrNetworkQueue>>::iterator j =
-                     m_priorityQueue.begin();
-                 j != m_priorityQueue.end();
-                 j++)
-            {
-                NS_LOG_INFO("The size of the network queue for " << j->first << " is "
-                                                                 << j->second->GetSize());
-                totalQueueSize += j->second->GetSize();
-                NS_LOG_INFO("The total network queue size is " << totalQueueSize);
-            }
-            if (totalQueueSize > 5)
+            NS_LOG_INFO("The total network queue size is " << m_networkQueueSize);
+            if (m_networkQueueSize > 5)
             {
                 // Here the queue size is larger than 5, we need to increase the retransmission
                 // timer for each packet in the network queue
                 IncreaseRetransTimer();
             }
+            // The expired packets the queue drops are taken off the total as well
+            uint32_t queueSize = wdsrNetworkQueue->GetSize();
             WDsrNetworkQueueEntry newEntry;
-            wdsrNetworkQueue->Dequeue(newEntry);
-            if (SendRealDown(newEntry))
-            {
-                NS_LOG_LOGIC("Packet sent by WDsr. Calling PriorityScheduler after some time");
-                // packet was successfully sent down. call scheduler after some time
-                Simulator::Schedule(MicroSeconds(m_uniformRandomVariable->GetInteger(0, 1000)),
-                                    &WDsrRouting::PriorityScheduler,
-                                    this,
-                                    i,
-                                    false);
-            }
-            else
+            bool found = wdsrNetworkQueue->Dequeue(newEntry);
+            m_networkQueueSize -= queueSize - wdsrNetworkQueue->GetSize();
+            if (!found)
             {
-                // packet was dropped by WDsr. Call scheduler immediately so that we can
-                // send another packet immediately.
-                NS_LOG_LOGIC("Packet dropped by WDsr. Calling PriorityScheduler immediately");
-                Simulator::Schedule(Seconds(0), &WDsrRouting::PriorityScheduler, this, i, false);
+                break;
             }
-
-            if ((i == (m_numPriorityQueues - 1)) && continueWithFirst)
+            if (SendRealDown(newEntry))
             {
-                i = 0;
+                NS_LOG_LOGIC("Packet sent by WDsr");
+                sent++;
             }
             else
             {
-                i++;
+                // packet was dropped by WDsr, send another packet immediately
+                NS_LOG_LOGIC("Packet dropped by WDsr");
             }
         }
+
+        if ((i == (m_numPriorityQueues - 1)) && continueWithFirst)
+        {
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (m_networkQueueSize > 0 && !m_schedulerEvent.IsRunning())
+    {
+        NS_LOG_LOGIC("Calling PriorityScheduler after some time for the packets left");
+        m_schedulerEvent = Simulator::Schedule(
+            MicroSeconds(m_uniformRandomVariable->GetInteger(0, 1000)),
+            &WDsrRouting::PriorityScheduler,
+            this,
+            0,
+            true);
     }
 }
 
@@ -1870,25 +1907,84 @@ WDsrRouting::IncreaseRetransTimer()
     std::map<uint32_t, Ptr<wdsr::WDsrNetworkQueue>>::iterator i = m_priorityQueue.find(priority);
     Ptr<wdsr::WDsrNetworkQueue> wdsrNetworkQueue = i->second;
 
-    std::vector<WDsrNetworkQueueEntry> newNetworkQueue = wdsrNetworkQueue->GetQueue();
-    for (std::vector<WDsrNetworkQueueEntry>::iterator i = newNetworkQueue.begin();
-         i != newNetworkQueue.end();
+    // The timers are increased once for every queued entry of their next hop
+    const WDsrNetworkQueue::NextHops& nextHops = wdsrNetworkQueue->GetNextHops();
+    for (WDsrNetworkQueue::NextHops::const_iterator i = nextHops.begin(); i != nextHops.end();
          i++)
     {
-        Ipv4Address nextHop = i->GetNextHopAddress();
-        for (std::map<NetworkKey, Timer>::iterator j = m_addressForwardTimer.begin();
-             j != m_addressForwardTimer.end();
-             j++)
+        typedef std::multimap<Ipv4Address, std::map<NetworkKey, Timer>::iterator>::iterator
+            NextHopIterator;
+        std::pair<NextHopIterator, NextHopIterator> timers =
+            m_addressForwardNextHop.equal_range(i->first);
+        for (NextHopIterator j = timers.first; j != timers.second; j++)
         {
-            if (nextHop == j->first.m_nextHop)
+            Timer& timer = j->second->second;
+            for (uint32_t k = 0; k < i->second.m_sequences.size(); k++)
             {
-                NS_LOG_DEBUG("The network delay left is " << j->second.GetDelayLeft());
-                j->second.SetDelay(j->second.GetDelayLeft() + m_retransIncr);
+                NS_LOG_DEBUG("The network delay left is " << timer.GetDelayLeft());
+                timer.SetDelay(timer.GetDelayLeft() + m_retransIncr);
             }
         }
     }
 }
 
+void
+WDsrRouting::DropNetworkQueueNextHop(Ipv4Address nextHop)
+{
+    NS_LOG_FUNCTION(this << nextHop);
+    for (std::map<uint32_t, Ptr<wdsr::WDsrNetworkQueue>>::iterator i = m_priorityQueue.begin();
+         i != m_priorityQueue.end();
+         i++)
+    {
+        Ptr<wdsr::WDsrNetworkQueue> wdsrNetworkQueue = i->second;
+        uint32_t queueSize = wdsrNetworkQueue->GetSize();
+        WDsrNetworkQueueEntry entry;
+        while (wdsrNetworkQueue->FindPacketWithNexthop(nextHop, entry))
+        {
+            NS_LOG_INFO("Drop the queued packet as the link to " << nextHop << " is broken");
+            m_dropTrace(entry.GetPacket());
+        }
+        m_networkQueueSize -= queueSize - wdsrNetworkQueue->GetSize();
+    }
+}
+
+Timer&
+WDsrRouting::GetAddressForwardTimer(const NetworkKey& networkKey)
+{
+    std::map<NetworkKey, Timer>::iterator i = m_addressForwardTimer.find(networkKey);
+    if (i == m_addressForwardTimer.end())
+    {
+        i = m_addressForwardTimer
+                .insert(std::make_pair(networkKey, Timer(Timer::CANCEL_ON_DESTROY)))
+                .first;
+        m_addressForwardNextHop.insert(std::make_pair(networkKey.m_nextHop, i));
+    }
+    return i->second;
+}
+
+void
+WDsrRouting::EraseAddressForwardTimer(const NetworkKey& networkKey)
+{
+    std::map<NetworkKey, Timer>::iterator i = m_addressForwardTimer.find(networkKey);
+    if (i == m_addressForwardTimer.end())
+    {
+        return;
+    }
+    typedef std::multimap<Ipv4Address, std::map<NetworkKey, Timer>::iterator>::iterator
+        NextHopIterator;
+    std::pair<NextHopIterator, NextHopIterator> timers =
+        m_addressForwardNextHop.equal_range(networkKey.m_nextHop);
+    for (NextHopIterator j = timers.first; j != timers.second; j++)
+    {
+        if (j->second == i)
+        {
+            m_addressForwardNextHop.erase(j);
+            break;
+        }
+    }
+    m_addressForwardTimer.erase(i);
+}
+
 bool
 WDsrRouting::SendRealDown(WDsrNetworkQueueEntry& newEntry)
 {
@@ -1933,18 +2029,28 @@ WDsrRouting::SendPacketFromBuffer(const WDsrOptionSRHeader& sourceRoute,
         {
             Ptr<Packet> packet = entry.GetPacket()->Copy();
             Ptr<Packet> p = packet->Copy(); // get a copy of the packet
-            // Set the source route option
-            WDsrRoutingHeader wdsrRoutingHeader;
-            wdsrRoutingHeader.SetNextHeader(protocol);
-            wdsrRoutingHeader.SetMessageType(2);
-            wdsrRoutingHeader.SetSourceId(GetIDfromIP(source));
-            wdsrRoutingHeader.SetDestId(GetIDfromIP(destination));
+            // Set the source route option, from the header kept with the route unless salvaged
+            if (sourceRoute.GetSalvage() == 0 &&
+                sourceRoute.GetSegmentsLeft() == nodeList.size() - 2)
+            {
+                AddSourceRouteHeader(p,
+                                     GetHeaderTemplate(WDsrPath::Intern(nodeList), protocol),
+                                     source);
+            }
+            else
+            {
+                WDsrRoutingHeader wdsrRoutingHeader;
+                wdsrRoutingHeader.SetNextHeader(protocol);
+                wdsrRoutingHeader.SetMessageType(2);
+                wdsrRoutingHeader.SetSourceId(GetIDfromIP(source));
+                wdsrRoutingHeader.SetDestId(GetIDfromIP(destination));
 
-            uint8_t length = sourceRoute.GetLength();
-            wdsrRoutingHeader.SetPayloadLength(uint16_t(length) + 2);
-            wdsrRoutingHeader.AddWDsrOption(sourceRoute);
+                uint8_t length = sourceRoute.GetLength();
+                wdsrRoutingHeader.SetPayloadLength(uint16_t(length) + 2);
+                wdsrRoutingHeader.AddWDsrOption(sourceRoute);
 
-            p->AddHeader(wdsrRoutingHeader);
+                p->AddHeader(wdsrRoutingHeader);
+            }
 
             Ptr<const Packet> mtP = p->Copy();
             // Put the data packet in the maintenance queue for data packet retransmission
@@ -2043,9 +2149,8 @@ WDsrRouting::SendPacketFromBuffer(const WDsrOptionSRHeader& sourceRoute,
             /*
              * Peek data to get the option type as well as length and segmentsLeft field
              */
-            uint32_t size = copyP->GetSize();
-            uint8_t* data = new uint8_t[size];
-            copyP->CopyData(data, size);
+            uint8_t data[4] = {0};
+            copyP->CopyData(data, sizeof(data));
 
             uint8_t optionType = 0;
             optionType = *(data);
@@ -2143,6 +2248,49 @@ WDsrRouting::SendPacketFromBuffer(const WDsrOptionSRHeader& sourceRoute,
     }
 }
 
+const WDsrHeaderTemplate&
+WDsrRouting::GetHeaderTemplate(Ptr<WDsrPath> path, uint8_t protocol)
+{
+    NS_LOG_FUNCTION(this << (uint32_t)protocol);
+    const WDsrHeaderTemplate* cached = path->GetHeaderTemplate(protocol);
+    if (cached)
+    {
+        return *cached;
+    }
+    WDsrHeaderTemplate headerTemplate;
+    headerTemplate.protocol = protocol;
+    headerTemplate.route = path->GetVector();
+
+    WDsrOptionSRHeader sourceRoute;
+    sourceRoute.SetNodesAddress(headerTemplate.route);
+    sourceRoute.SetSegmentsLeft((headerTemplate.route.size() - 2));
+    sourceRoute.SetSalvage(0);
+
+    WDsrRoutingHeader& wdsrRoutingHeader = headerTemplate.header;
+    wdsrRoutingHeader.SetNextHeader(protocol);
+    wdsrRoutingHeader.SetMessageType(2);
+    wdsrRoutingHeader.SetSourceId(GetIDfromIP(headerTemplate.route.front()));
+    wdsrRoutingHeader.SetDestId(GetIDfromIP(headerTemplate.route.back()));
+    wdsrRoutingHeader.SetPayloadLength(uint16_t(sourceRoute.GetLength()) + 2);
+    wdsrRoutingHeader.AddWDsrOption(sourceRoute);
+    return path->SetHeaderTemplate(headerTemplate);
+}
+
+void
+WDsrRouting::AddSourceRouteHeader(Ptr<Packet> packet,
+                                  const WDsrHeaderTemplate& headerTemplate,
+                                  Ipv4Address source)
+{
+    if (source == headerTemplate.route.front())
+    {
+        packet->AddHeader(headerTemplate.header);
+        return;
+    }
+    WDsrRoutingHeader wdsrRoutingHeader = headerTemplate.header;
+    wdsrRoutingHeader.SetSourceId(GetIDfromIP(source));
+    packet->AddHeader(wdsrRoutingHeader);
+}
+
 bool
 WDsrRouting::PassiveEntryCheck(Ptr<Packet> packet,
                               Ipv4Address source,
@@ -2154,10 +2302,10 @@ WDsrRouting::PassiveEntryCheck(Ptr<Packet> packet,
 {
     NS_LOG_FUNCTION(this << packet << source << destination << (uint32_t)segsLeft);
 
-    Ptr<Packet> p = packet->Copy();
     // Here the segments left value need to plus one to check the earlier hop maintain buffer entry
+    // The packet is only copied to be kept, the passive buffer compares the packet uids
     WDsrPassiveBuffEntry newEntry;
-    newEntry.SetPacket(p);
+    newEntry.SetPacket(packet);
     newEntry.SetSource(source);
     newEntry.SetDestination(destination);
     newEntry.SetIdentification(identification);
@@ -2173,7 +2321,7 @@ WDsrRouting::PassiveEntryCheck(Ptr<Packet> packet,
         NS_LOG_DEBUG("We get the all equal for passive buffer here");
 
         WDsrMaintainBuffEntry mbEntry;
-        mbEntry.SetPacket(p);
+        mbEntry.SetPacket(packet->Copy());
         mbEntry.SetSrc(source);
         mbEntry.SetDst(destination);
         mbEntry.SetAckId(0);
@@ -2185,6 +2333,7 @@ WDsrRouting::PassiveEntryCheck(Ptr<Packet> packet,
     if (saveEntry)
     {
         /// Save this passive buffer entry for later check
+        newEntry.SetPacket(packet->Copy());
         m_passiveBuffer->Enqueue(newEntry);
     }
     return false;
@@ -2338,7 +2487,7 @@ WDsrRouting::CancelNetworkPacketTimer(WDsrMaintainBuffEntry& mb)
         {
             NS_LOG_INFO("Timer not canceled");
         }
-        m_addressForwardTimer.erase(networkKey);
+        EraseAddressForwardTimer(networkKey);
     }
     // Erase the maintenance entry
     // yet this does not check the segments left value here
@@ -2667,23 +2816,18 @@ WDsrRouting::ScheduleNetworkPacketRetry(WDsrMaintainBuffEntry& mb, bool isFirst,
             NS_LOG_ERROR("Failed to enqueue packet retry");
         }
 
-        if (m_addressForwardTimer.find(networkKey) == m_addressForwardTimer.end())
-        {
-            Timer timer(Timer::CANCEL_ON_DESTROY);
-            m_addressForwardTimer[networkKey] = timer;
-        }
+        Timer& timer = GetAddressForwardTimer(networkKey);
 
         // After m_tryPassiveAcks, schedule the packet retransmission using network acknowledgment
         // option
-        m_addressForwardTimer[networkKey].SetFunction(&WDsrRouting::NetworkScheduleTimerExpire,
-                                                      this);
-        m_addressForwardTimer[networkKey].Cancel();
-        m_addressForwardTimer[networkKey].SetArguments(newEntry, protocol);
+        timer.SetFunction(&WDsrRouting::NetworkScheduleTimerExpire, this);
+        timer.Cancel();
+        timer.SetArguments(newEntry, protocol);
         NS_LOG_DEBUG("The packet retries time for " << newEntry.GetAckId() << " is "
                                                     << m_sendRetries << " and the delay time is "
                                                     << Time(2 * m_nodeTraversalTime).As(Time::S));
         // Back-off mechanism
-        m_addressForwardTimer[networkKey].Schedule(Time(2 * m_nodeTraversalTime));
+        timer.Schedule(Time(2 * m_nodeTraversalTime));
     }
     else
     {
@@ -2726,15 +2870,15 @@ WDsrRouting::ScheduleNetworkPacketRetry(WDsrMaintainBuffEntry& mb, bool isFirst,
 
         // After m_tryPassiveAcks, schedule the packet retransmission using network acknowledgment
         // option
-        m_addressForwardTimer[networkKey].SetFunction(&WDsrRouting::NetworkScheduleTimerExpire,
-                                                      this);
-        m_addressForwardTimer[networkKey].Cancel();
-        m_addressForwardTimer[networkKey].SetArguments(mb, protocol);
+        Timer& timer = GetAddressForwardTimer(networkKey);
+        timer.SetFunction(&WDsrRouting::NetworkScheduleTimerExpire, this);
+        timer.Cancel();
+        timer.SetArguments(mb, protocol);
         NS_LOG_DEBUG("The packet retries time for "
                      << mb.GetAckId() << " is " << m_sendRetries << " and the delay time is "
                      << Time(2 * m_sendRetries * m_nodeTraversalTime).As(Time::S));
         // Back-off mechanism
-        m_addressForwardTimer[networkKey].Schedule(Time(2 * m_sendRetries * m_nodeTraversalTime));
+        timer.Schedule(Time(2 * m_sendRetries * m_nodeTraversalTime));
     }
 }
 
@@ -2773,7 +2917,7 @@ WDsrRouting::LinkScheduleTimerExpire(WDsrMaintainBuffEntry& mb, uint8_t protocol
         NS_LOG_INFO("We need to send error messages now");
 
         // Delete all the routes including the links
-        m_routeCache->DeleteAllRoutesIncludeLink(m_mainAddress, nextHop, m_mainAddress);
+        DeleteAllRoutesIncludeLink(m_mainAddress, nextHop, m_mainAddress);
         /*
          * here we cancel the packet retransmission time for all the packets have next hop address
          * as nextHop Also salvage the packet for the all the packet destined for the nextHop
@@ -2851,7 +2995,7 @@ WDsrRouting::NetworkScheduleTimerExpire(WDsrMaintainBuffEntry& mb, uint8_t proto
     if (m_sendRetries >= m_maxMaintRexmt)
     {
         // Delete all the routes including the links
-        m_routeCache->DeleteAllRoutesIncludeLink(m_mainAddress, nextHop, m_mainAddress);
+        DeleteAllRoutesIncludeLink(m_mainAddress, nextHop, m_mainAddress);
         /*
          * here we cancel the packet retransmission time for all the packets have next hop address
          * as nextHop Also salvage the packet for the all the packet destined for the nextHop
@@ -2878,6 +3022,30 @@ WDsrRouting::ForwardPacket(Ptr<const Packet> packet,
 {
     NS_LOG_FUNCTION(this << packet << sourceRoute << source << nextHop << targetAddress
                          << (uint32_t)protocol << route);
+
+    // The source route option is word aligned right after the fixed header, no padding is needed
+    Ptr<Packet> p = packet->Copy();
+    p->AddHeader(sourceRoute);
+    ForwardPacket(p,
+                  sourceRoute.GetLength(),
+                  sourceRoute.GetSegmentsLeft(),
+                  source,
+                  nextHop,
+                  targetAddress,
+                  protocol);
+}
+
+void
+WDsrRouting::ForwardPacket(Ptr<Packet> packet,
+                          uint8_t length,
+                          uint8_t segsLeft,
+                          Ipv4Address source,
+                          Ipv4Address nextHop,
+                          Ipv4Address targetAddress,
+                          uint8_t protocol)
+{
+    NS_LOG_FUNCTION(this << packet << (uint32_t)length << (uint32_t)segsLeft << source << nextHop
+                         << targetAddress << (uint32_t)protocol);
     NS_ASSERT_MSG(!m_downTarget.IsNull(), "Error, WDsrRouting cannot send downward");
 
     WDsrRoutingHeader wdsrRoutingHeader;
@@ -2885,16 +3053,10 @@ WDsrRouting::ForwardPacket(Ptr<const Packet> packet,
     wdsrRoutingHeader.SetMessageType(2);
     wdsrRoutingHeader.SetSourceId(GetIDfromIP(source));
     wdsrRoutingHeader.SetDestId(GetIDfromIP(targetAddress));
-
-    // We get the salvage value in sourceRoute header and set it to route error header if triggered
-    // error
-    Ptr<Packet> p = packet->Copy();
-    uint8_t length = sourceRoute.GetLength();
     wdsrRoutingHeader.SetPayloadLength(uint16_t(length) + 2);
-    wdsrRoutingHeader.AddWDsrOption(sourceRoute);
-    p->AddHeader(wdsrRoutingHeader);
+    packet->AddHeader(wdsrRoutingHeader);
 
-    Ptr<const Packet> mtP = p->Copy();
+    Ptr<const Packet> mtP = packet->Copy();
 
     WDsrMaintainBuffEntry newEntry(/*packet=*/mtP,
                                   /*ourAddress=*/m_mainAddress,
@@ -2902,7 +3064,7 @@ WDsrRouting::ForwardPacket(Ptr<const Packet> packet,
                                   /*src=*/source,
                                   /*dst=*/targetAddress,
                                   /*ackId=*/m_ackId,
-                                  /*segsLeft=*/sourceRoute.GetSegmentsLeft(),
+                                  /*segsLeft=*/segsLeft,
                                   /*expire=*/m_maxMaintainTime);
     bool result = m_maintainBuffer.Enqueue(newEntry);
 
@@ -2966,7 +3128,7 @@ WDsrRouting::SendInitialRequest(Ipv4Address source, Ipv4Address destination, uin
     wdsrRoutingHeader.SetNextHeader(protocol);
     wdsrRoutingHeader.SetMessageType(1);
     wdsrRoutingHeader.SetSourceId(GetIDfromIP(source));
-    wdsrRoutingHeader.SetDestId(255);
+    wdsrRoutingHeader.SetDestId(WDsrFsHeader::BROADCAST_ID);
 
     WDsrOptionRreqHeader rreqHeader;           // has an alignment of 4n+0
     rreqHeader.AddNodeAddress(m_mainAddress); // Add our own address in the header
@@ -3085,7 +3247,7 @@ WDsrRouting::SendErrorRequest(WDsrOptionRerrUnreachHeader& rerr, uint8_t protoco
         wdsrRoutingHeader.SetNextHeader(protocol);
         wdsrRoutingHeader.SetMessageType(1);
         wdsrRoutingHeader.SetSourceId(GetIDfromIP(m_mainAddress));
-        wdsrRoutingHeader.SetDestId(255);
+        wdsrRoutingHeader.SetDestId(WDsrFsHeader::BROADCAST_ID);
 
         Ptr<Packet> dstP = Create<Packet>();
         WDsrOptionRreqHeader rreqHeader;           // has an alignment of 4n+0
@@ -3607,7 +3769,6 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
      */
     WDsrRoutingHeader wdsrRoutingHeader;
     packet->RemoveHeader(wdsrRoutingHeader); // Remove the WDSR header in whole
-    Ptr<Packet> copy = packet->Copy();
 
     uint8_t protocol = wdsrRoutingHeader.GetNextHeader();
     uint32_t sourceId = wdsrRoutingHeader.GetSourceId();
@@ -3631,9 +3792,8 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
     /*
      * Peek data to get the option type as well as length and segmentsLeft field
      */
-    uint32_t size = p->GetSize();
-    uint8_t* data = new uint8_t[size];
-    p->CopyData(data, size);
+    uint8_t data[4] = {0};
+    p->CopyData(data, sizeof(data));
 
     uint8_t optionType = 0;
     uint8_t optionLength = 0;
@@ -3654,7 +3814,6 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
             m_dropTrace(p);
         }
 
-        wdsrOption = GetOption(optionType);
         optionLength =
             wdsrOption
                 ->Process(p, packet, m_mainAddress, source, ip, protocol, isPromisc, promiscSource);
@@ -3667,7 +3826,6 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
     }
     else if (optionType == 2)
     {
-        wdsrOption = GetOption(optionType);
         optionLength =
             wdsrOption
                 ->Process(p, packet, m_mainAddress, source, ip, protocol, isPromisc, promiscSource);
@@ -3682,7 +3840,6 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
     else if (optionType == 32) // This is the ACK option
     {
         NS_LOG_INFO("This is the ack option");
-        wdsrOption = GetOption(optionType);
         optionLength =
             wdsrOption
                 ->Process(p, packet, m_mainAddress, source, ip, protocol, isPromisc, promiscSource);
@@ -3699,7 +3856,6 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
         // populate this route error
         NS_LOG_INFO("The option type value " << (uint32_t)optionType);
 
-        wdsrOption = GetOption(optionType);
         optionLength =
             wdsrOption
                 ->Process(p, packet, m_mainAddress, source, ip, protocol, isPromisc, promiscSource);
@@ -3714,7 +3870,6 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
 
     else if (optionType == 96) // This is the source route option
     {
-        wdsrOption = GetOption(optionType);
         optionLength =
             wdsrOption
                 ->Process(p, packet, m_mainAddress, source, ip, protocol, isPromisc, promiscSource);
@@ -3734,11 +3889,10 @@ WDsrRouting::Receive(Ptr<Packet> p, const Ipv4Header& ip, Ptr<Ipv4Interface> inc
                 Ptr<IpL4Protocol> nextProto = l3proto->GetProtocol(nextHeader);
                 if (nextProto)
                 {
-                    // we need to make a copy in the unlikely event we hit the
-                    // RX_ENDPOINT_UNREACH code path
-                    // Here we can use the packet that has been get off whole WDSR header
+                    // The source route option leaves the packet that has been get off whole
+                    // WDSR header untouched at the final destination, it is passed up as is
                     enum IpL4Protocol::RxStatus status =
-                        nextProto->Receive(copy, ip, incomingInterface);
+                        nextProto->Receive(packet, ip, incomingInterface);
                     NS_LOG_DEBUG("The receive status " << status);
                     switch (status)
                     {
@@ -3832,20 +3986,20 @@ WDsrRouting::GetDownTarget6() const
 void
 WDsrRouting::Insert(Ptr<wdsr::WDsrOptions> option)
 {
-    m_options.push_back(option);
+    uint8_t optionNumber = option->GetOptionNumber();
+    NS_ASSERT_MSG(!m_options[optionNumber],
+                  "Option " << (uint32_t)optionNumber << " inserted twice");
+    m_options[optionNumber] = option;
 }
 
 Ptr<wdsr::WDsrOptions>
 WDsrRouting::GetOption(int optionNumber)
 {
-    for (WDsrOptionList_t::iterator i = m_options.begin(); i != m_options.end(); ++i)
+    if (optionNumber < 0 || optionNumber >= static_cast<int>(m_options.size()))
     {
-        if ((*i)->GetOptionNumber() == optionNumber)
-        {
-            return *i;
-        }
+        return nullptr;
     }
-    return nullptr;
+    return m_options[optionNumber];
 }
 } /* namespace wdsr */
 } /* namespace ns3 */
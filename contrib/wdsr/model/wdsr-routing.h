@@ -67,6 +67,7 @@
 #include "ns3/traced-callback.h"
 #include "ns3/wifi-mac.h"
 
+#include <array>
 #include <cassert>
 #include <list>
 #include <map>
@@ -135,6 +136,20 @@ class WDsrRouting : public IpL4Protocol
      * \return the route cache
      */
     Ptr<wdsr::WDsrRouteCache> GetRouteCache() const;
+    /**
+     * \brief Write a binary snapshot of the route cache of this node
+     * \param os the output stream
+     */
+    void WriteSnapshot(std::ostream& os);
+    /**
+     * \brief Load a snapshot written by WriteSnapshot for this node into the route cache, the
+     * protocol has to be started
+     *
+     * The loaded routes get the route lifetime of this simulation instead of their time left.
+     * \param is the input stream
+     * \return true if the snapshot was loaded, false if it is corrupted or of another node
+     */
+    bool ReadSnapshot(std::istream& is);
     /**
      * \brief Set the node.
      * \param r the request table to set
@@ -170,7 +185,7 @@ class WDsrRouting : public IpL4Protocol
      *
      * \param rt the route to extend
      */
-    void UseExtends(WDsrRouteCacheEntry::IP_VECTOR rt);
+    void UseExtends(WDsrRouteCacheEntry::IP_VECTOR const& rt);
 
     /**
      * \brief Lookup route cache entry with destination address dst
@@ -188,9 +203,14 @@ class WDsrRouting : public IpL4Protocol
      *
      * \param nodelist vector of nodes
      * \param source ip address of node to add
+     * \param lowestBat the lowest battery of the intermediate nodes
+     * \param txCost the transmission cost of the route
      * \return true if the link is cached
      */
-    bool AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist, Ipv4Address source);
+    bool AddRoute_Link(WDsrRouteCacheEntry::IP_VECTOR nodelist,
+                       Ipv4Address source,
+                       uint8_t lowestBat = 0x3f,
+                       uint8_t txCost = 0);
 
     /**
      * \brief Add route cache entry if it doesn't yet exist in route cache
@@ -204,6 +224,7 @@ class WDsrRouting : public IpL4Protocol
     /**
      * \brief Delete all the routes which includes the link from next hop address that has just been
      * notified as unreachable. See also WDsrRouteCache::DeleteAllRoutesIncludeLink
+     * When the link is ours, the packets queued for the unreachable node are dropped.
      *
      * \param errorSrc The error source address
      * \param unreachNode The unreachable node
@@ -280,20 +301,34 @@ class WDsrRouting : public IpL4Protocol
      * \param vec Route
      * \return the next hop address of the route
      */
-    Ipv4Address SearchNextHop(Ipv4Address ipv4Address, std::vector<Ipv4Address>& vec);
+    Ipv4Address SearchNextHop(Ipv4Address ipv4Address, const std::vector<Ipv4Address>& vec);
     /**
      * \brief Get the wdsr protocol number.
      * \return protocol number
      */
     int GetProtocolNumber() const override;
     /**
-     * \brief The send buffer timer expire.
+     * \brief Check the send buffer for all the destinations that can be reached now, once a link
+     * has been added to the route cache.
+     */
+    void ScheduleCheckSendBuffer();
+    /**
+     * \brief Check the send buffer for the given destinations, once a route to them has been added
+     * to the route cache.
+     * \param destinations the destinations that can be reached now
      */
-    void SendBuffTimerExpire();
+    void ScheduleCheckSendBuffer(const std::vector<Ipv4Address>& destinations);
     /**
-     * \brief Check the send buffer of packets with route when send buffer timer expire.
+     * \brief Send the packets of the send buffer to the scheduled destinations found in the route
+     * cache.
      */
     void CheckSendBuffer();
+    /**
+     * \brief Send a packet taken from the send buffer along a route.
+     * \param entry the send buffer entry
+     * \param toDst the route to the destination of the packet
+     */
+    void SendBufferedPacket(const WDsrSendBuffEntry& entry, WDsrRouteCacheEntry& toDst);
     /**
      * \brief When route vector corrupted, originate a new packet, normally not happening.
      * \param packet to route
@@ -370,12 +405,16 @@ class WDsrRouting : public IpL4Protocol
      */
     void SendPacket(Ptr<Packet> packet, Ipv4Address source, Ipv4Address nextHop, uint8_t protocol);
     /**
-     * \brief This function is called to schedule sending packets from the network queue
-     * \param priority for sending
+     * \brief This function is called when a packet has been put in the network queue, the queued
+     * packets are sent down right away
+     * \param priority of the queue the packet was put in
      */
     void Scheduler(uint32_t priority);
     /**
-     * \brief This function is called to schedule sending packets from the network queue by priority
+     * \brief This function is called to send packets from the network queues by priority
+     *
+     * Up to SchedulerBurst packets are sent down, and a single wakeup is scheduled for the next
+     * ones while packets are left in the queues.
      * \param priority schedule
      * \param continueWithFirst use all priorities
      */
@@ -385,6 +424,22 @@ class WDsrRouting : public IpL4Protocol
      * network queue
      */
     void IncreaseRetransTimer();
+    /**
+     * \brief Drop the packets queued in the network queues for a next hop that can not be reached
+     * \param nextHop the next hop address
+     */
+    void DropNetworkQueueNextHop(Ipv4Address nextHop);
+    /**
+     * \brief Get the forward timer of a network key, it is created if needed
+     * \param networkKey the network key
+     * \return the forward timer
+     */
+    Timer& GetAddressForwardTimer(const NetworkKey& networkKey);
+    /**
+     * \brief Remove the forward timer of a network key
+     * \param networkKey the network key
+     */
+    void EraseAddressForwardTimer(const NetworkKey& networkKey);
     /**
      * \brief This function is called to send packets down stack
      * \param newEntry queue entry
@@ -400,6 +455,22 @@ class WDsrRouting : public IpL4Protocol
     void SendPacketFromBuffer(const WDsrOptionSRHeader& sourceRoute,
                               Ipv4Address nextHop,
                               uint8_t protocol);
+    /**
+     * \brief Get the header of the data packets sent along a path, made once per path and protocol
+     * \param path the path of the route
+     * \param protocol the protocol number of the payload
+     * \return the header template, the source route option has no salvage
+     */
+    const WDsrHeaderTemplate& GetHeaderTemplate(Ptr<WDsrPath> path, uint8_t protocol);
+    /**
+     * \brief Prepend the header of a template to a data packet
+     * \param packet the data packet
+     * \param headerTemplate the header template of the route
+     * \param source the source of the packet, the first node of the route unless salvaged
+     */
+    void AddSourceRouteHeader(Ptr<Packet> packet,
+                              const WDsrHeaderTemplate& headerTemplate,
+                              Ipv4Address source);
     /**
      * \brief Find the same passive entry
      * \param packet to process
@@ -532,6 +603,23 @@ class WDsrRouting : public IpL4Protocol
                        Ipv4Address targetAddress,
                        uint8_t protocol,
                        Ptr<Ipv4Route> route);
+    /**
+     * \brief Forward a packet whose source route option has already been written
+     * \param packet The packet starting with the source route option, without the fixed header
+     * \param length length of the source route option
+     * \param segsLeft segments left in the source route option
+     * \param source source address
+     * \param nextHop next hop address
+     * \param targetAddress target address
+     * \param protocol protocol number
+     */
+    void ForwardPacket(Ptr<Packet> packet,
+                       uint8_t length,
+                       uint8_t segsLeft,
+                       Ipv4Address source,
+                       Ipv4Address nextHop,
+                       Ipv4Address targetAddress,
+                       uint8_t protocol);
     /**
      * \brief Broadcast the route request packet in subnet
      * \param source source address
@@ -767,13 +855,9 @@ class WDsrRouting : public IpL4Protocol
                         const Address& to,
                         NetDevice::PacketType packetType);
     /**
-     * \brief Define the list to hold WDSR options.
+     * \brief WDSR Options supported, indexed by option number.
      */
-    typedef std::list<Ptr<WDsrOptions>> WDsrOptionList_t;
-    /**
-     * \brief List of WDSR Options supported.
-     */
-    WDsrOptionList_t m_options;
+    std::array<Ptr<WDsrOptions>, 256> m_options;
 
     Ptr<Ipv4L3Protocol> m_ipv4; ///< Ipv4l3Protocol
 
@@ -863,9 +947,11 @@ class WDsrRouting : public IpL4Protocol
 
     uint32_t m_tryLinkAcks; ///< Maximum number of packet transmission using link acknowledgment
 
-    Timer m_sendBuffTimer; ///< The send buffer timer
+    EventId m_sendBuffEvent; ///< The pending check of the send buffer
+
+    std::vector<Ipv4Address> m_sendBuffDestinations; ///< The destinations of the pending check
 
-    Time m_sendBuffInterval; ///< how often to check send buffer
+    bool m_checkAllSendBuff; ///< Whether the pending check covers all the destinations
 
     Time m_gratReplyHoldoff; ///< The max gratuitous reply hold off time
 
@@ -875,6 +961,8 @@ class WDsrRouting : public IpL4Protocol
 
     std::string m_cacheType; ///< The type of route cache
 
+    std::string m_routePolicy; ///< The route selection policy of the path cache
+
     std::string m_routeSortType; ///< The type of route sort methods
 
     uint32_t m_stabilityDecrFactor; ///< The initial decrease factor for link cache
@@ -887,6 +975,8 @@ class WDsrRouting : public IpL4Protocol
 
     Time m_useExtends; ///< The use extension of the life time for link cache
 
+    bool m_incrementalLinkCache; ///< Repair the link cache best routes incrementally
+
     bool m_subRoute; ///< Whether to save sub route or not
 
     Time m_retransIncr; ///< the increase time for retransmission timer when face network congestion
@@ -899,6 +989,9 @@ class WDsrRouting : public IpL4Protocol
 
     std::map<NetworkKey, Timer> m_addressForwardTimer; ///< Map network key + forward timer.
 
+    /// The forward timers by next hop
+    std::multimap<Ipv4Address, std::map<NetworkKey, Timer>::iterator> m_addressForwardNextHop;
+
     std::map<NetworkKey, uint32_t> m_addressForwardCnt; ///< Map network key + forward counts.
 
     std::map<PassiveKey, uint32_t> m_passiveCnt; ///< Map packet key + passive forward counts.
@@ -924,6 +1017,14 @@ class WDsrRouting : public IpL4Protocol
 
     std::map<uint32_t, Ptr<wdsr::WDsrNetworkQueue>> m_priorityQueue; ///< priority queues
 
+    uint32_t m_networkQueueSize; ///< The number of packets in the priority queues
+
+    uint32_t m_schedulerBurst; ///< The max number of packets sent down at each wakeup
+
+    uint32_t m_nextHopQuantum; ///< The bytes each next hop may send every round of the queues
+
+    EventId m_schedulerEvent; ///< The next wakeup of the scheduler
+
     WDsrGraReply m_graReply; ///< The gratuitous route reply.
 
     WDsrNetworkQueue m_networkQueue; ///< The network queue.
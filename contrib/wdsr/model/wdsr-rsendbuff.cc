@@ -57,20 +57,12 @@ bool
 WDsrSendBuffer::Enqueue(WDsrSendBuffEntry& entry)
 {
     Purge();
-    for (std::vector<WDsrSendBuffEntry>::const_iterator i = m_sendBuffer.begin();
-         i != m_sendBuffer.end();
-         ++i)
+    std::unordered_map<Ipv4Address, Destination, Ipv4AddressHash>::iterator i =
+        m_destinations.find(entry.GetDestination());
+    if (i != m_destinations.end() &&
+        i->second.m_uids.find(entry.GetPacket()->GetUid()) != i->second.m_uids.end())
     {
-        //      NS_LOG_DEBUG ("packet id " << i->GetPacket ()->GetUid () << " " << entry.GetPacket
-        //      ()->GetUid ()
-        //                                << " dst " << i->GetDestination () << " " <<
-        //                                entry.GetDestination ());
-
-        if ((i->GetPacket()->GetUid() == entry.GetPacket()->GetUid()) &&
-            (i->GetDestination() == entry.GetDestination()))
-        {
-            return false;
-        }
+        return false;
     }
 
     entry.SetExpireTime(m_sendBufferTimeout); // Initialize the send buffer timeout
@@ -80,10 +72,20 @@ WDsrSendBuffer::Enqueue(WDsrSendBuffEntry& entry)
     if (m_sendBuffer.size() >= m_maxLen)
     {
         Drop(m_sendBuffer.front(), "Drop the most aged packet"); // Drop the most aged packet
-        m_sendBuffer.erase(m_sendBuffer.begin());
+        PopFront();
     }
     // enqueue the entry
     m_sendBuffer.push_back(entry);
+    i = m_destinations.find(entry.GetDestination());
+    if (i == m_destinations.end())
+    {
+        i = m_destinations.emplace(entry.GetDestination(), Destination()).first;
+        i->second.m_order =
+            m_destinationOrder.insert(m_destinationOrder.end(), entry.GetDestination());
+    }
+    Destination& destination = i->second;
+    destination.m_entries.push_back(std::prev(m_sendBuffer.end()));
+    destination.m_uids.insert(entry.GetPacket()->GetUid());
     return true;
 }
 
@@ -95,19 +97,22 @@ WDsrSendBuffer::DropPacketWithDst(Ipv4Address dst)
     /*
      * Drop the packet with destination address dst
      */
-    for (std::vector<WDsrSendBuffEntry>::iterator i = m_sendBuffer.begin(); i != m_sendBuffer.end();
-         ++i)
+    std::unordered_map<Ipv4Address, Destination, Ipv4AddressHash>::iterator i =
+        m_destinations.find(dst);
+    if (i == m_destinations.end())
     {
-        if (i->GetDestination() == dst)
-        {
-            Drop(*i, "DropPacketWithDst");
-        }
+        return;
     }
-    auto new_end =
-        std::remove_if(m_sendBuffer.begin(), m_sendBuffer.end(), [&](const WDsrSendBuffEntry& en) {
-            return en.GetDestination() == dst;
-        });
-    m_sendBuffer.erase(new_end, m_sendBuffer.end());
+    for (std::deque<std::list<WDsrSendBuffEntry>::iterator>::iterator j =
+             i->second.m_entries.begin();
+         j != i->second.m_entries.end();
+         ++j)
+    {
+        Drop(**j, "DropPacketWithDst");
+        m_sendBuffer.erase(*j);
+    }
+    m_destinationOrder.erase(i->second.m_order);
+    m_destinations.erase(i);
 }
 
 bool
@@ -117,18 +122,18 @@ WDsrSendBuffer::Dequeue(Ipv4Address dst, WDsrSendBuffEntry& entry)
     /*
      * Dequeue the entry with destination address dst
      */
-    for (std::vector<WDsrSendBuffEntry>::iterator i = m_sendBuffer.begin(); i != m_sendBuffer.end();
-         ++i)
+    std::unordered_map<Ipv4Address, Destination, Ipv4AddressHash>::iterator i =
+        m_destinations.find(dst);
+    if (i == m_destinations.end())
     {
-        if (i->GetDestination() == dst)
-        {
-            entry = *i;
-            i = m_sendBuffer.erase(i);
-            NS_LOG_DEBUG("Packet size while dequeuing " << entry.GetPacket()->GetSize());
-            return true;
-        }
+        return false;
     }
-    return false;
+    std::list<WDsrSendBuffEntry>::iterator j = i->second.m_entries.front();
+    entry = *j;
+    PopDestination(dst);
+    m_sendBuffer.erase(j);
+    NS_LOG_DEBUG("Packet size while dequeuing " << entry.GetPacket()->GetSize());
+    return true;
 }
 
 bool
@@ -137,58 +142,67 @@ WDsrSendBuffer::Find(Ipv4Address dst)
     /*
      * Make sure if the send buffer contains entry with certain dst
      */
-    for (std::vector<WDsrSendBuffEntry>::const_iterator i = m_sendBuffer.begin();
-         i != m_sendBuffer.end();
-         ++i)
+    Purge();
+    if (m_destinations.find(dst) != m_destinations.end())
     {
-        if (i->GetDestination() == dst)
-        {
-            NS_LOG_DEBUG("Found the packet");
-            return true;
-        }
+        NS_LOG_DEBUG("Found the packet");
+        return true;
     }
     return false;
 }
 
-struct IsExpired
+std::vector<Ipv4Address>
+WDsrSendBuffer::GetDestinations()
 {
-    /**
-     * comparison operator
-     * \param e entry to compare
-     * \return true if expired
-     */
-    bool operator()(const WDsrSendBuffEntry& e) const
+    Purge();
+    return std::vector<Ipv4Address>(m_destinationOrder.begin(), m_destinationOrder.end());
+}
+
+void
+WDsrSendBuffer::PopFront()
+{
+    PopDestination(m_sendBuffer.front().GetDestination());
+    m_sendBuffer.pop_front();
+}
+
+void
+WDsrSendBuffer::PopDestination(Ipv4Address dst)
+{
+    std::unordered_map<Ipv4Address, Destination, Ipv4AddressHash>::iterator i =
+        m_destinations.find(dst);
+    NS_ASSERT(i != m_destinations.end());
+    i->second.m_uids.erase(i->second.m_entries.front()->GetPacket()->GetUid());
+    i->second.m_entries.pop_front();
+    if (i->second.m_entries.empty())
     {
-        // NS_LOG_DEBUG("Expire time for packet in req queue: "<<e.GetExpireTime ());
-        return (e.GetExpireTime() < Seconds(0));
+        m_destinationOrder.erase(i->second.m_order);
+        m_destinations.erase(i);
     }
-};
+}
 
 void
 WDsrSendBuffer::Purge()
 {
     /*
-     * Purge the buffer to eliminate expired entries
+     * Purge the buffer to eliminate expired entries, the expire times only grow along the buffer
      */
     NS_LOG_INFO("The send buffer size " << m_sendBuffer.size());
-    IsExpired pred;
-    for (std::vector<WDsrSendBuffEntry>::iterator i = m_sendBuffer.begin(); i != m_sendBuffer.end();
-         ++i)
+    while (!m_sendBuffer.empty() && m_sendBuffer.front().GetExpireTime() < Seconds(0))
     {
-        if (pred(*i))
-        {
-            NS_LOG_DEBUG("Dropping Queue Packets");
-            Drop(*i, "Drop out-dated packet ");
-        }
+        NS_LOG_DEBUG("Dropping Queue Packets");
+        Drop(m_sendBuffer.front(), "Drop out-dated packet ");
+        PopFront();
     }
-    m_sendBuffer.erase(std::remove_if(m_sendBuffer.begin(), m_sendBuffer.end(), pred),
-                       m_sendBuffer.end());
 }
 
 void
 WDsrSendBuffer::Drop(WDsrSendBuffEntry en, std::string reason)
 {
     NS_LOG_LOGIC(reason << en.GetPacket()->GetUid() << " " << en.GetDestination());
+    if (!m_dropCallback.IsNull())
+    {
+        m_dropCallback(en.GetPacket());
+    }
     //  en.GetErrorCallback () (en.GetPacket (), en.GetDestination (),
     //     Socket::ERROR_NOROUTETOHOST);
 }
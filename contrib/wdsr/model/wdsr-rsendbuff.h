@@ -35,6 +35,10 @@
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/simulator.h"
 
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace ns3
@@ -164,6 +168,10 @@ class WDsrSendBuffEntry
 /**
  * \ingroup wdsr
  * \brief WDSR send buffer
+ *
+ * The entries are kept in insertion order, which is also the order of their expire times, so the
+ * expired entries and the most aged one are always at the head of the buffer.  The entries of each
+ * destination are indexed, oldest first, with the uids of their packets.
  */
 /************************************************************************************************************************/
 class WDsrSendBuffer
@@ -258,24 +266,51 @@ class WDsrSendBuffer
     // \}
 
     /**
-     * Return a pointer to the internal queue
+     * Return the destinations of the buffered packets
+     *
+     * \return the destinations, in the order they got buffered packets
+     */
+    std::vector<Ipv4Address> GetDestinations();
+
+    /**
+     * Set the callback notified with the packet of every dropped entry
      *
-     * \return a pointer to the internal queue
+     * \param cb the drop callback
      */
-    std::vector<WDsrSendBuffEntry>& GetBuffer()
+    void SetDropCallback(Callback<void, Ptr<const Packet>> cb)
     {
-        return m_sendBuffer;
+        m_dropCallback = cb;
     }
 
   private:
-    std::vector<WDsrSendBuffEntry> m_sendBuffer; ///< The send buffer to cache unsent packet
-    void Purge();                               ///< Remove all expired entries
+    /// The buffered entries of a destination
+    struct Destination
+    {
+        std::deque<std::list<WDsrSendBuffEntry>::iterator> m_entries; //!< Entries, oldest first
+        std::unordered_set<uint64_t> m_uids; //!< Uids of the packets of the entries
+        std::list<Ipv4Address>::iterator m_order; //!< Position in the destination order
+    };
+
+    std::list<WDsrSendBuffEntry> m_sendBuffer; ///< The send buffer to cache unsent packet
+    std::unordered_map<Ipv4Address, Destination, Ipv4AddressHash>
+        m_destinations; ///< The entries of each destination
+    std::list<Ipv4Address>
+        m_destinationOrder; ///< The destinations, in the order they got buffered packets
+    void Purge();           ///< Remove all expired entries
+    /// Remove the entry at the head of the buffer
+    void PopFront();
+    /**
+     * Remove the oldest entry of a destination
+     * \param dst the destination
+     */
+    void PopDestination(Ipv4Address dst);
 
     /// Notify that packet is dropped from queue by timeout
     /// \param en BuffEntry Buffer entry
     /// \param reason Drop reason
     void Drop(WDsrSendBuffEntry en, std::string reason);
 
+    Callback<void, Ptr<const Packet>> m_dropCallback; ///< Notified of the dropped packets
     uint32_t
         m_maxLen; ///< The maximum number of packets that we allow a routing protocol to buffer.
     Time m_sendBufferTimeout; ///< The maximum period of time that a routing protocol is allowed to
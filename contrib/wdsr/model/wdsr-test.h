@@ -3,7 +3,4 @@
 
     extern uint8_t α;
     extern uint8_t γ;
-    extern double initialBattery;
-    extern double initialEnergy[];
-    extern double remainingEnergy[];
     #endif
\ No newline at end of file
@@ -31,22 +31,34 @@
 
 #include "ns3/boolean.h"
 #include "ns3/double.h"
+#include "ns3/wdsr-energy-provider.h"
 #include "ns3/wdsr-fs-header.h"
 #include "ns3/wdsr-helper.h"
 #include "ns3/wdsr-main-helper.h"
+#include "ns3/wdsr-network-queue.h"
+#include "ns3/wdsr-node-directory.h"
 #include "ns3/wdsr-option-header.h"
+#include "ns3/wdsr-options.h"
 #include "ns3/wdsr-rcache.h"
+#include "ns3/wdsr-routing.h"
 #include "ns3/wdsr-rreq-table.h"
 #include "ns3/wdsr-rsendbuff.h"
+#include "ns3/wdsr-test.h"
+#include "ns3/internet-stack-helper.h"
 #include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/ipv4-list-routing.h"
 #include "ns3/ipv4-route.h"
 #include "ns3/mesh-helper.h"
 #include "ns3/ptr.h"
+#include "ns3/simple-net-device-helper.h"
 #include "ns3/simulator.h"
 #include "ns3/string.h"
 #include "ns3/test.h"
 #include "ns3/uinteger.h"
 
+#include <sstream>
 #include <vector>
 
 using namespace ns3;
@@ -100,6 +112,19 @@ WDsrFsHeaderTest::DoRun()
     NS_TEST_EXPECT_MSG_EQ(*(data + 8),
                           rreqHeader.GetType(),
                           "expect the rreqHeader after fixed size header");
+
+    // Node ids above 255 and the broadcast id go through unchanged
+    wdsr::WDsrFsHeader fsHeader;
+    fsHeader.SetSourceId(4000);
+    fsHeader.SetDestId(wdsr::WDsrFsHeader::BROADCAST_ID);
+    Ptr<Packet> p = Create<Packet>();
+    p->AddHeader(fsHeader);
+    wdsr::WDsrFsHeader fsHeader2;
+    p->RemoveHeader(fsHeader2);
+    NS_TEST_EXPECT_MSG_EQ(fsHeader2.GetSourceId(), 4000, "source id above 255");
+    NS_TEST_EXPECT_MSG_EQ(fsHeader2.GetDestId(),
+                          wdsr::WDsrFsHeader::BROADCAST_ID,
+                          "broadcast destination id");
 }
 
 // -----------------------------------------------------------------------------
@@ -156,6 +181,28 @@ WDsrRreqHeaderTest::DoRun()
     h2.SetNumberAddress(3);
     uint32_t bytes = p->RemoveHeader(h2);
     NS_TEST_EXPECT_MSG_EQ(bytes, 20, "Total RREP is 20 bytes long");
+
+    // A forwarded request is the fixed part written again in front of the received addresses
+    p = Create<Packet>();
+    h.SetTxCost(4);
+    p->AddHeader(h);
+    wdsr::WDsrOptionRreqHeader fixed;
+    NS_TEST_EXPECT_MSG_EQ(p->PeekHeader(fixed), 8, "The fixed part is 8 bytes long");
+    NS_TEST_EXPECT_MSG_EQ(fixed.GetTarget(), Ipv4Address("1.1.1.3"), "trivial");
+    uint8_t data[24];
+    NS_TEST_EXPECT_MSG_EQ(p->CopyData(data, 20), 20, "trivial");
+    Ipv4Address("1.1.1.4").Serialize(data + 20);
+    Ptr<Packet> forwarded = Create<Packet>(data + 8, 16);
+    fixed.SetTxCost(fixed.GetTxCost() + 1);
+    fixed.SetLength(fixed.GetLength() + 4);
+    forwarded->AddHeader(fixed);
+    wdsr::WDsrOptionRreqHeader h3;
+    h3.SetNumberAddress(4);
+    NS_TEST_EXPECT_MSG_EQ(forwarded->RemoveHeader(h3), 24, "One more address is carried");
+    NS_TEST_EXPECT_MSG_EQ(h3.GetId(), 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(h3.GetTxCost(), 5, "The transmission cost is patched");
+    NS_TEST_EXPECT_MSG_EQ(h3.GetNodeAddress(0), Ipv4Address("1.1.1.0"), "trivial");
+    NS_TEST_EXPECT_MSG_EQ(h3.GetNodeAddress(3), Ipv4Address("1.1.1.4"), "Our address is appended");
 }
 
 // -----------------------------------------------------------------------------
@@ -265,6 +312,34 @@ WDsrSRHeaderTest::DoRun()
     h2.SetNumberAddress(3);
     uint32_t bytes = p->RemoveHeader(h2);
     NS_TEST_EXPECT_MSG_EQ(bytes, 16, "Total RREP is 16 bytes long");
+
+    // A forwarding hop reads the route where it is and only rewrites the segments left
+    p = Create<Packet>();
+    p->AddHeader(h);
+    uint8_t data[16];
+    NS_TEST_EXPECT_MSG_EQ(p->CopyData(data, 16), 16, "trivial");
+    Ptr<wdsr::WDsrOptionSR> sr = CreateObject<wdsr::WDsrOptionSR>();
+    std::vector<Ipv4Address> route(nodeList);
+    NS_TEST_EXPECT_MSG_EQ(sr->SearchNextHop(Ipv4Address("1.1.1.1"), data + 4, 3),
+                          sr->SearchNextHop(Ipv4Address("1.1.1.1"), route),
+                          "Same next hop as the deserialized route");
+    NS_TEST_EXPECT_MSG_EQ(sr->SearchNextHop(Ipv4Address("1.1.1.1"), data + 4, 3),
+                          Ipv4Address("1.1.1.2"),
+                          "trivial");
+    NS_TEST_EXPECT_MSG_EQ(sr->SearchNextHop(Ipv4Address("1.1.1.2"), data + 4, 3),
+                          Ipv4Address("1.1.1.2"),
+                          "The destination is its own next hop");
+    NS_TEST_EXPECT_MSG_EQ(sr->SearchNextHop(Ipv4Address("1.1.1.5"), data + 4, 3),
+                          Ipv4Address("0.0.0.0"),
+                          "Not in the route");
+    data[3] = 1;
+    Ptr<Packet> forwarded = Create<Packet>(data, 16);
+    wdsr::WDsrOptionSRHeader h3;
+    h3.SetNumberAddress(3);
+    NS_TEST_EXPECT_MSG_EQ(forwarded->RemoveHeader(h3), 16, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(h3.GetSegmentsLeft(), 1, "The segments left are decremented");
+    NS_TEST_EXPECT_MSG_EQ(h3.GetSalvage(), 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(h3.GetNodeAddress(2), Ipv4Address("1.1.1.2"), "trivial");
 }
 
 // -----------------------------------------------------------------------------
@@ -409,6 +484,53 @@ WDsrAckHeaderTest::DoRun()
     NS_TEST_EXPECT_MSG_EQ(bytes, 12, "Total RREP is 12 bytes long");
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrOptionTableTest
+ * \brief Unit test for the lookup of the WDSR options by option number
+ */
+class WDsrOptionTableTest : public TestCase
+{
+  public:
+    WDsrOptionTableTest();
+    ~WDsrOptionTableTest() override;
+    void DoRun() override;
+};
+
+WDsrOptionTableTest::WDsrOptionTableTest()
+    : TestCase("WDSR option table")
+{
+}
+
+WDsrOptionTableTest::~WDsrOptionTableTest()
+{
+}
+
+void
+WDsrOptionTableTest::DoRun()
+{
+    Ptr<wdsr::WDsrRouting> routing = CreateObject<wdsr::WDsrRouting>();
+    const uint8_t optionNumbers[] = {wdsr::WDsrOptionPad1::OPT_NUMBER,
+                                     wdsr::WDsrOptionPadn::OPT_NUMBER,
+                                     wdsr::WDsrOptionRreq::OPT_NUMBER,
+                                     wdsr::WDsrOptionRrep::OPT_NUMBER,
+                                     wdsr::WDsrOptionSR::OPT_NUMBER,
+                                     wdsr::WDsrOptionRerr::OPT_NUMBER,
+                                     wdsr::WDsrOptionAckReq::OPT_NUMBER,
+                                     wdsr::WDsrOptionAck::OPT_NUMBER};
+    for (uint8_t optionNumber : optionNumbers)
+    {
+        Ptr<wdsr::WDsrOptions> option = routing->GetOption(optionNumber);
+        NS_TEST_ASSERT_MSG_EQ(bool(option), true, "Option " << (uint32_t)optionNumber);
+        NS_TEST_EXPECT_MSG_EQ(option->GetOptionNumber(), optionNumber, "trivial");
+    }
+    NS_TEST_EXPECT_MSG_EQ(bool(routing->GetOption(5)), false, "Unknown option");
+    NS_TEST_EXPECT_MSG_EQ(bool(routing->GetOption(300)), false, "Out of range option");
+}
+
 // -----------------------------------------------------------------------------
 /**
  * \ingroup wdsr-test
@@ -476,6 +598,831 @@ WDsrCacheEntryTest::DoRun()
     NS_TEST_EXPECT_MSG_EQ(rcache->DeleteRoute(Ipv4Address("1.1.1.1")), false, "trivial");
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrPathTest
+ * \brief Unit test for the interned route paths
+ */
+class WDsrPathTest : public TestCase
+{
+  public:
+    WDsrPathTest();
+    ~WDsrPathTest() override;
+    void DoRun() override;
+};
+
+WDsrPathTest::WDsrPathTest()
+    : TestCase("WDSR interned path")
+{
+}
+
+WDsrPathTest::~WDsrPathTest()
+{
+}
+
+void
+WDsrPathTest::DoRun()
+{
+    std::vector<Ipv4Address> ip{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.1"),
+        Ipv4Address("0.0.0.2"),
+    };
+    Ptr<wdsr::WDsrPath> path = wdsr::WDsrPath::Intern(ip);
+    NS_TEST_EXPECT_MSG_EQ(path->GetSize(), 3, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(path->GetAddress(), Ipv4Address("0.0.0.2"), "trivial");
+    NS_TEST_EXPECT_MSG_EQ((path->GetVector() == ip), true, "Path read back in order");
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrPath::Intern(ip), path, "Equal paths are shared");
+
+    wdsr::WDsrRouteCacheEntry entry(ip, Ipv4Address("0.0.0.2"), Seconds(1));
+    NS_TEST_EXPECT_MSG_EQ(entry.GetPath(), path, "The entry holds the interned path");
+    ip.emplace_back("0.0.0.3");
+    entry.SetVector(ip);
+    NS_TEST_EXPECT_MSG_EQ(entry.GetPath()->GetParent(), path, "The prefix is shared");
+    NS_TEST_EXPECT_MSG_EQ(entry.GetVectorSize(), 4, "trivial");
+
+    // A header template is kept per protocol with the path it was made for
+    wdsr::WDsrHeaderTemplate headerTemplate;
+    headerTemplate.protocol = 17;
+    headerTemplate.route = path->GetVector();
+    wdsr::WDsrOptionSRHeader sourceRoute;
+    sourceRoute.SetNodesAddress(headerTemplate.route);
+    sourceRoute.SetSegmentsLeft(1);
+    sourceRoute.SetSalvage(0);
+    headerTemplate.header.SetNextHeader(17);
+    headerTemplate.header.SetMessageType(2);
+    headerTemplate.header.SetPayloadLength(uint16_t(sourceRoute.GetLength()) + 2);
+    headerTemplate.header.AddWDsrOption(sourceRoute);
+    NS_TEST_EXPECT_MSG_EQ((path->GetHeaderTemplate(17) == nullptr), true, "trivial");
+    path->SetHeaderTemplate(headerTemplate);
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrPath::Intern(headerTemplate.route)->GetHeaderTemplate(17),
+                          path->GetHeaderTemplate(17),
+                          "The template is shared with the path");
+    NS_TEST_EXPECT_MSG_EQ((path->GetHeaderTemplate(6) == nullptr), true, "Kept per protocol");
+    NS_TEST_EXPECT_MSG_EQ((entry.GetPath()->GetHeaderTemplate(17) == nullptr),
+                          true,
+                          "A changed route is another path");
+
+    Ptr<Packet> p = Create<Packet>(20);
+    p->AddHeader(path->GetHeaderTemplate(17)->header);
+    NS_TEST_EXPECT_MSG_EQ(p->GetSize(), 20 + 8 + 4 + 4 * 3, "Header prepended");
+    wdsr::WDsrRoutingHeader wdsrRoutingHeader;
+    p->RemoveHeader(wdsrRoutingHeader);
+    wdsr::WDsrOptionSRHeader sourceRouteRead;
+    sourceRouteRead.SetNumberAddress(3);
+    p->RemoveHeader(sourceRouteRead);
+    NS_TEST_EXPECT_MSG_EQ(wdsrRoutingHeader.GetMessageType(), 2, "trivial");
+    NS_TEST_EXPECT_MSG_EQ((sourceRouteRead.GetNodesAddress() == headerTemplate.route),
+                          true,
+                          "Source route read back");
+    NS_TEST_EXPECT_MSG_EQ(sourceRouteRead.GetSegmentsLeft(), 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(p->GetSize(), 20, "Only the payload is left");
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrRouteCacheExpiryTest
+ * \brief Unit test for WDSR path cache expiry
+ */
+class WDsrRouteCacheExpiryTest : public TestCase
+{
+  public:
+    WDsrRouteCacheExpiryTest();
+    ~WDsrRouteCacheExpiryTest() override;
+    void DoRun() override;
+    /// Check the routes after the short lived one has expired
+    void CheckExpired();
+
+    Ptr<wdsr::WDsrRouteCache> m_rcache; ///< route cache
+};
+
+WDsrRouteCacheExpiryTest::WDsrRouteCacheExpiryTest()
+    : TestCase("WDSR route cache expiry")
+{
+}
+
+WDsrRouteCacheExpiryTest::~WDsrRouteCacheExpiryTest()
+{
+}
+
+void
+WDsrRouteCacheExpiryTest::DoRun()
+{
+    m_rcache = CreateObject<wdsr::WDsrRouteCache>();
+    m_rcache->SetCacheType("PathCache");
+    m_rcache->SetCacheTimeout(Seconds(10));
+
+    std::vector<Ipv4Address> ip1{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.1"),
+    };
+    std::vector<Ipv4Address> ip2{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.2"),
+    };
+    wdsr::WDsrRouteCacheEntry entry1(ip1, Ipv4Address("0.0.0.1"), Seconds(1));
+    wdsr::WDsrRouteCacheEntry entry2(ip2, Ipv4Address("0.0.0.2"), Seconds(1));
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->AddRoute(entry1), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->AddRoute(entry2), true, "trivial");
+
+    // Offering the same path again only refreshes the cached entry
+    wdsr::WDsrRouteCacheEntry refresh(ip2, Ipv4Address("0.0.0.2"), Seconds(5));
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->AddRoute(refresh), true, "trivial");
+    wdsr::WDsrRouteCacheEntry found;
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->LookupRoute(Ipv4Address("0.0.0.2"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetExpireTime(), Seconds(5), "Expire time refreshed in place");
+
+    Simulator::Schedule(Seconds(2), &WDsrRouteCacheExpiryTest::CheckExpired, this);
+    Simulator::Run();
+    Simulator::Destroy();
+}
+
+void
+WDsrRouteCacheExpiryTest::CheckExpired()
+{
+    wdsr::WDsrRouteCacheEntry found;
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->LookupRoute(Ipv4Address("0.0.0.1"), found),
+                          false,
+                          "Route must have expired");
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->LookupRoute(Ipv4Address("0.0.0.2"), found),
+                          true,
+                          "Refreshed route must survive");
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->UpdateRouteEntry(Ipv4Address("0.0.0.2")), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->LookupRoute(Ipv4Address("0.0.0.2"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetExpireTime(), Seconds(10), "trivial");
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrRouteCacheSubRouteTest
+ * \brief Unit test for WDSR path cache sub routes
+ */
+class WDsrRouteCacheSubRouteTest : public TestCase
+{
+  public:
+    WDsrRouteCacheSubRouteTest();
+    ~WDsrRouteCacheSubRouteTest() override;
+    void DoRun() override;
+};
+
+WDsrRouteCacheSubRouteTest::WDsrRouteCacheSubRouteTest()
+    : TestCase("WDSR route cache sub route")
+{
+}
+
+WDsrRouteCacheSubRouteTest::~WDsrRouteCacheSubRouteTest()
+{
+}
+
+void
+WDsrRouteCacheSubRouteTest::DoRun()
+{
+    Ptr<wdsr::WDsrRouteCache> rcache = CreateObject<wdsr::WDsrRouteCache>();
+    rcache->SetCacheType("PathCache");
+
+    std::vector<Ipv4Address> ip{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.1"),
+        Ipv4Address("0.0.0.2"),
+        Ipv4Address("0.0.0.3"),
+    };
+    wdsr::WDsrRouteCacheEntry entry(ip, Ipv4Address("0.0.0.3"), Seconds(5));
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute(entry), true, "trivial");
+
+    wdsr::WDsrRouteCacheEntry found;
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.2"), found), true, "Sub route");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 3, "Route cut after the target");
+    NS_TEST_EXPECT_MSG_EQ(found.GetDestination(), Ipv4Address("0.0.0.2"), "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.4"), found), false, "trivial");
+
+    NS_TEST_EXPECT_MSG_EQ(rcache->DeleteRoute(Ipv4Address("0.0.0.3")), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->DeleteRoute(Ipv4Address("0.0.0.2")), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.1"), found),
+                          false,
+                          "No route left through the node");
+
+    std::vector<Ipv4Address> ip2{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.1"),
+        Ipv4Address("0.0.0.4"),
+    };
+    wdsr::WDsrRouteCacheEntry entry2(ip2, Ipv4Address("0.0.0.4"), Seconds(5));
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute(entry), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute(entry2), true, "trivial");
+    rcache->SetSubRoute(false);
+    rcache->DeleteAllRoutesIncludeLink(Ipv4Address("0.0.0.1"),
+                                       Ipv4Address("0.0.0.2"),
+                                       Ipv4Address("0.0.0.0"));
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.3"), found),
+                          false,
+                          "Route over the broken link removed");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.4"), found),
+                          true,
+                          "Route without the broken link kept");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 3, "trivial");
+    Simulator::Destroy();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrRouteCacheSelectionTest
+ * \brief Unit test for WDSR path cache CCMBCR route selection
+ */
+class WDsrRouteCacheSelectionTest : public TestCase
+{
+  public:
+    WDsrRouteCacheSelectionTest();
+    ~WDsrRouteCacheSelectionTest() override;
+    void DoRun() override;
+};
+
+WDsrRouteCacheSelectionTest::WDsrRouteCacheSelectionTest()
+    : TestCase("WDSR route cache CCMBCR selection")
+{
+}
+
+WDsrRouteCacheSelectionTest::~WDsrRouteCacheSelectionTest()
+{
+}
+
+void
+WDsrRouteCacheSelectionTest::DoRun()
+{
+    uint8_t threshold = γ;
+    γ = 40;
+    Ptr<wdsr::WDsrRouteCache> rcache = CreateObject<wdsr::WDsrRouteCache>();
+    rcache->SetCacheType("PathCache");
+    rcache->SetCacheTimeout(Seconds(10));
+
+    std::vector<Ipv4Address> ip1{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.1"),
+        Ipv4Address("0.0.0.9"),
+    };
+    std::vector<Ipv4Address> ip2{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.2"),
+        Ipv4Address("0.0.0.3"),
+        Ipv4Address("0.0.0.9"),
+    };
+    std::vector<Ipv4Address> ip3{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.4"),
+        Ipv4Address("0.0.0.9"),
+    };
+    wdsr::WDsrRouteCacheEntry entry1(ip1, Ipv4Address("0.0.0.9"), Seconds(5));
+    entry1.SetLowestBat(50);
+    entry1.SetTxCost(10);
+    wdsr::WDsrRouteCacheEntry entry2(ip2, Ipv4Address("0.0.0.9"), Seconds(5));
+    entry2.SetLowestBat(60);
+    entry2.SetTxCost(5);
+    wdsr::WDsrRouteCacheEntry entry3(ip3, Ipv4Address("0.0.0.9"), Seconds(5));
+    entry3.SetLowestBat(30);
+    entry3.SetTxCost(2);
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute(entry1), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute(entry2), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute(entry3), true, "trivial");
+
+    wdsr::WDsrRouteCacheEntry found;
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.9"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetTxCost(), 5, "MTPR skips the route below the threshold");
+    NS_TEST_EXPECT_MSG_EQ(rcache->UpdateRouteEntry(Ipv4Address("0.0.0.9")), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.9"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetTxCost(), 5, "Hop count does not override the selection");
+
+    γ = 60;
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.9"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetLowestBat(), 60, "MMBCR once no route is above");
+
+    rcache->SetRoutePolicy("MTPR");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.9"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetTxCost(), 2, "MTPR ignores the battery");
+    rcache->SetRoutePolicy("HopCount");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.9"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 3, "Shortest route");
+    NS_TEST_EXPECT_MSG_EQ(found.GetTxCost(), 10, "First of the shortest routes");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.7"), found), false, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.3"), found), true, "Sub route");
+
+    const wdsr::WDsrRouteCacheStats& stats = rcache->GetStats();
+    NS_TEST_EXPECT_MSG_EQ(stats.m_lookups, 7, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(stats.m_hits, 6, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(stats.m_misses, 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(stats.m_subRouteHits, 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(stats.m_mtprSelections, 2, "The memoized selection is not counted");
+    NS_TEST_EXPECT_MSG_EQ(stats.m_mmbcrSelections, 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(stats.m_filteredRoutes, 1, "One route below the threshold");
+    rcache->ResetStats();
+    NS_TEST_EXPECT_MSG_EQ(rcache->GetStats().m_lookups, 0, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->DeleteRoute(Ipv4Address("0.0.0.9")), true, "trivial");
+    γ = threshold;
+    Simulator::Destroy();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrRouteCacheSnapshotTest
+ * \brief Unit test for WDSR route cache snapshots
+ */
+class WDsrRouteCacheSnapshotTest : public TestCase
+{
+  public:
+    WDsrRouteCacheSnapshotTest();
+    ~WDsrRouteCacheSnapshotTest() override;
+    void DoRun() override;
+};
+
+WDsrRouteCacheSnapshotTest::WDsrRouteCacheSnapshotTest()
+    : TestCase("WDSR route cache snapshot")
+{
+}
+
+WDsrRouteCacheSnapshotTest::~WDsrRouteCacheSnapshotTest()
+{
+}
+
+void
+WDsrRouteCacheSnapshotTest::DoRun()
+{
+    Ptr<wdsr::WDsrRouteCache> rcache = CreateObject<wdsr::WDsrRouteCache>();
+    rcache->SetCacheType("PathCache");
+    rcache->SetCacheTimeout(Seconds(10));
+
+    std::vector<Ipv4Address> ip{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.1"),
+        Ipv4Address("0.0.0.2"),
+    };
+    wdsr::WDsrRouteCacheEntry entry(ip, Ipv4Address("0.0.0.2"), Seconds(5));
+    entry.SetLowestBat(50);
+    entry.SetTxCost(7);
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute(entry), true, "trivial");
+    std::stringstream snapshot;
+    rcache->WriteSnapshot(snapshot, Ipv4Address("0.0.0.0"));
+
+    Ptr<wdsr::WDsrRouteCache> other = CreateObject<wdsr::WDsrRouteCache>();
+    other->SetCacheType("PathCache");
+    other->SetCacheTimeout(Seconds(10));
+    std::istringstream wrongNode(snapshot.str());
+    NS_TEST_EXPECT_MSG_EQ(other->ReadSnapshot(wrongNode, Ipv4Address("0.0.0.1")),
+                          false,
+                          "Snapshot of another node");
+    std::istringstream truncated(snapshot.str().substr(0, snapshot.str().size() - 1));
+    NS_TEST_EXPECT_MSG_EQ(other->ReadSnapshot(truncated, Ipv4Address("0.0.0.0")),
+                          false,
+                          "Truncated snapshot");
+    NS_TEST_EXPECT_MSG_EQ(other->ReadSnapshot(snapshot, Ipv4Address("0.0.0.0")), true, "trivial");
+
+    wdsr::WDsrRouteCacheEntry found;
+    NS_TEST_EXPECT_MSG_EQ(other->LookupRoute(Ipv4Address("0.0.0.2"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 3, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetLowestBat(), 50, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetTxCost(), 7, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetExpireTime(), Seconds(5), "Time left is kept");
+
+    Ptr<wdsr::WDsrRouteCache> restamped = CreateObject<wdsr::WDsrRouteCache>();
+    restamped->SetCacheType("PathCache");
+    restamped->SetCacheTimeout(Seconds(10));
+    std::istringstream again(snapshot.str());
+    NS_TEST_EXPECT_MSG_EQ(restamped->ReadSnapshot(again, Ipv4Address("0.0.0.0"), Seconds(2)),
+                          true,
+                          "trivial");
+    NS_TEST_EXPECT_MSG_EQ(restamped->LookupRoute(Ipv4Address("0.0.0.2"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetExpireTime(), Seconds(2), "The route gets the new lifetime");
+    Simulator::Destroy();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrNeighborTest
+ * \brief Unit test for the WDSR neighbor list of the route cache
+ */
+class WDsrNeighborTest : public TestCase
+{
+  public:
+    WDsrNeighborTest();
+    ~WDsrNeighborTest() override;
+    void DoRun() override;
+    /// Check the neighbors after the short lived one has expired
+    void CheckExpired();
+
+    Ptr<wdsr::WDsrRouteCache> m_rcache; ///< route cache
+};
+
+WDsrNeighborTest::WDsrNeighborTest()
+    : TestCase("WDSR neighbor list")
+{
+}
+
+WDsrNeighborTest::~WDsrNeighborTest()
+{
+}
+
+void
+WDsrNeighborTest::DoRun()
+{
+    m_rcache = CreateObject<wdsr::WDsrRouteCache>();
+    std::vector<Ipv4Address> nodeList{
+        Ipv4Address("0.0.0.1"),
+        Ipv4Address("0.0.0.2"),
+        Ipv4Address("0.0.0.0"),
+    };
+    m_rcache->AddNeighbor(nodeList, Ipv4Address("0.0.0.0"), Seconds(1));
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->IsNeighbor(Ipv4Address("0.0.0.1")), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->IsNeighbor(Ipv4Address("0.0.0.0")),
+                          false,
+                          "The own address is not a neighbor");
+
+    std::vector<Ipv4Address> refresh{Ipv4Address("0.0.0.2")};
+    m_rcache->UpdateNeighbor(refresh, Seconds(5));
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->GetExpireTime(Ipv4Address("0.0.0.2")),
+                          Seconds(5),
+                          "Expire time extended");
+    m_rcache->UpdateNeighbor(refresh, Seconds(3));
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->GetExpireTime(Ipv4Address("0.0.0.2")),
+                          Seconds(5),
+                          "Expire time is never shortened");
+
+    Simulator::Schedule(Seconds(2), &WDsrNeighborTest::CheckExpired, this);
+    Simulator::Run();
+    Simulator::Destroy();
+}
+
+void
+WDsrNeighborTest::CheckExpired()
+{
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->IsNeighbor(Ipv4Address("0.0.0.1")),
+                          false,
+                          "Neighbor must have expired");
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->IsNeighbor(Ipv4Address("0.0.0.2")),
+                          true,
+                          "Refreshed neighbor must survive");
+    NS_TEST_EXPECT_MSG_EQ(m_rcache->GetExpireTime(Ipv4Address("0.0.0.2")), Seconds(3), "trivial");
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrNodeDirectoryTest
+ * \brief Unit test for the WDSR node directory
+ */
+class WDsrNodeDirectoryTest : public TestCase
+{
+  public:
+    WDsrNodeDirectoryTest();
+    ~WDsrNodeDirectoryTest() override;
+    void DoRun() override;
+};
+
+WDsrNodeDirectoryTest::WDsrNodeDirectoryTest()
+    : TestCase("WDSR node directory")
+{
+}
+
+WDsrNodeDirectoryTest::~WDsrNodeDirectoryTest()
+{
+}
+
+void
+WDsrNodeDirectoryTest::DoRun()
+{
+    NodeContainer nodes;
+    nodes.Create(2);
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer devices = simple.Install(nodes);
+    InternetStackHelper internet;
+    internet.Install(nodes);
+    Ipv4AddressHelper address;
+    address.SetBase("10.1.1.0", "255.255.255.0");
+    address.Assign(devices);
+    for (uint32_t i = 0; i < nodes.GetN(); ++i)
+    {
+        wdsr::WDsrNodeDirectory::Update(nodes.Get(i));
+    }
+
+    uint32_t id = nodes.Get(1)->GetId();
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrNodeDirectory::GetId(Ipv4Address("10.1.1.2")), id, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrNodeDirectory::GetAddress(id),
+                          Ipv4Address("10.1.1.2"),
+                          "trivial");
+    NS_TEST_EXPECT_MSG_EQ(
+        wdsr::WDsrNodeDirectory::GetAddress(Mac48Address::ConvertFrom(devices.Get(1)->GetAddress())),
+        Ipv4Address("10.1.1.2"),
+        "trivial");
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrNodeDirectory::GetNode(Ipv4Address("10.1.1.1")),
+                          nodes.Get(0),
+                          "trivial");
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrNodeDirectory::GetId(Ipv4Address("127.0.0.1")),
+                          wdsr::WDsrNodeDirectory::INVALID_ID,
+                          "The loopback address is shared by every node");
+    NS_TEST_EXPECT_MSG_EQ(bool(wdsr::WDsrNodeDirectory::GetNode(Ipv4Address("10.1.1.9"))),
+                          false,
+                          "Unknown address");
+    NS_TEST_EXPECT_MSG_GT(wdsr::WDsrNodeDirectory::GetNIds(), id, "The ids are numbered from 0");
+    NS_TEST_EXPECT_MSG_EQ(bool(wdsr::WDsrNodeDirectory::GetRouting(id)),
+                          false,
+                          "The node does not run WDSR");
+
+    // Once added, the node is indexed again when its addresses change
+    wdsr::WDsrNodeDirectory::Add(nodes.Get(0), nullptr);
+    Ptr<Ipv4> ipv4 = nodes.Get(0)->GetObject<Ipv4>();
+    int32_t interface = ipv4->GetInterfaceForDevice(devices.Get(0));
+    ipv4->AddAddress(interface, Ipv4InterfaceAddress(Ipv4Address("10.1.2.1"), "255.255.255.0"));
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrNodeDirectory::GetNode(Ipv4Address("10.1.2.1")),
+                          nodes.Get(0),
+                          "Added address");
+    ipv4->RemoveAddress(interface, Ipv4Address("10.1.1.1"));
+    NS_TEST_EXPECT_MSG_EQ(bool(wdsr::WDsrNodeDirectory::GetNode(Ipv4Address("10.1.1.1"))),
+                          false,
+                          "Removed address");
+    NS_TEST_EXPECT_MSG_EQ(wdsr::WDsrNodeDirectory::GetAddress(nodes.Get(0)->GetId()),
+                          Ipv4Address("10.1.2.1"),
+                          "The remaining address is the main one");
+    wdsr::WDsrNodeDirectory::Add(nodes.Get(0), nullptr);
+    Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting>(ipv4->GetRoutingProtocol());
+    uint32_t watchers = 0;
+    for (uint32_t i = 0; i < list->GetNRoutingProtocols(); ++i)
+    {
+        int16_t priority;
+        if (DynamicCast<wdsr::WDsrAddressWatcher>(list->GetRoutingProtocol(i, priority)))
+        {
+            watchers++;
+        }
+    }
+    NS_TEST_EXPECT_MSG_EQ(watchers, 1, "The node is watched once");
+    Simulator::Destroy();
+    NS_TEST_EXPECT_MSG_EQ(bool(wdsr::WDsrNodeDirectory::GetNode(Ipv4Address("10.1.1.1"))),
+                          false,
+                          "The directory is emptied with the simulation");
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrEnergyProviderTest
+ * \brief Unit test for the WDSR energy provider
+ */
+class WDsrEnergyProviderTest : public TestCase
+{
+  public:
+    WDsrEnergyProviderTest();
+    ~WDsrEnergyProviderTest() override;
+    void DoRun() override;
+
+  private:
+    /**
+     * Record the depletion of the battery
+     * \param time the time the battery ran out
+     */
+    void Depleted(Time time);
+    /**
+     * Check the battery drained by the idle power
+     * \param battery the battery
+     * \param remainingEnergyJ the expected remaining energy
+     */
+    void CheckRemaining(Ptr<wdsr::WDsrEnergyProvider> battery, double remainingEnergyJ);
+
+    uint32_t m_depletions; ///< Number of depletions
+    Time m_depletedAt;     ///< Time of the last depletion
+};
+
+WDsrEnergyProviderTest::WDsrEnergyProviderTest()
+    : TestCase("WDSR energy provider"),
+      m_depletions(0)
+{
+}
+
+WDsrEnergyProviderTest::~WDsrEnergyProviderTest()
+{
+}
+
+void
+WDsrEnergyProviderTest::DoRun()
+{
+    Ptr<Node> node = CreateObject<Node>();
+    Ptr<wdsr::WDsrEnergyProvider> battery = CreateObject<wdsr::WDsrEnergyProvider>();
+    battery->SetInitialEnergy(200);
+    node->AggregateObject(battery);
+    battery = node->GetObject<wdsr::WDsrEnergyProvider>();
+    NS_TEST_ASSERT_MSG_EQ(bool(battery), true, "The provider is aggregated to the node");
+
+    battery->DecreaseEnergy(100);
+    NS_TEST_EXPECT_MSG_EQ(battery->GetRemainingEnergy(), 100, "trivial");
+    wdsr::WDsrOptionRreqHeader rreq;
+    rreq.SetLowestBat(0x3f);
+    rreq.CalcLowestBat(battery->GetRemainingEnergy(), battery->GetInitialEnergy());
+    NS_TEST_EXPECT_MSG_EQ(rreq.GetLowestBat(), 31, "Half a battery in 63th parts");
+
+    battery->DecreaseEnergy(150);
+    NS_TEST_EXPECT_MSG_EQ(battery->GetRemainingEnergy(), 0, "The battery does not go below 0");
+    NS_TEST_EXPECT_MSG_EQ(battery->IsDepleted(), true, "trivial");
+    battery->SetInitialEnergy(50);
+    NS_TEST_EXPECT_MSG_EQ(battery->GetRemainingEnergy(), 50, "The battery is full again");
+
+    // 2 W idle and 10 J sent at 10 s, the battery runs out at 20 s
+    battery->SetIdlePower(2);
+    battery->TraceConnectWithoutContext(
+        "Depleted",
+        MakeCallback(&WDsrEnergyProviderTest::Depleted, this));
+    Simulator::Schedule(Seconds(10), &WDsrEnergyProviderTest::CheckRemaining, this, battery, 30);
+    Simulator::Schedule(Seconds(10), &wdsr::WDsrEnergyProvider::DecreaseEnergy, battery, 10);
+    Simulator::Schedule(Seconds(15), &WDsrEnergyProviderTest::CheckRemaining, this, battery, 10);
+    Simulator::Run();
+    NS_TEST_EXPECT_MSG_EQ(m_depletions, 1, "The battery runs out once");
+    NS_TEST_EXPECT_MSG_EQ(m_depletedAt, Seconds(20), "trivial");
+    NS_TEST_EXPECT_MSG_EQ(battery->IsDepleted(), true, "trivial");
+    Simulator::Destroy();
+}
+
+void
+WDsrEnergyProviderTest::Depleted(Time time)
+{
+    m_depletions++;
+    m_depletedAt = time;
+}
+
+void
+WDsrEnergyProviderTest::CheckRemaining(Ptr<wdsr::WDsrEnergyProvider> battery,
+                                       double remainingEnergyJ)
+{
+    NS_TEST_EXPECT_MSG_EQ_TOL(battery->GetRemainingEnergy(),
+                              remainingEnergyJ,
+                              1e-9,
+                              "Idle drain at " << Simulator::Now().As(Time::S));
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrLinkCacheTest
+ * \brief Unit test for WDSR link cache best routes
+ */
+class WDsrLinkCacheTest : public TestCase
+{
+  public:
+    WDsrLinkCacheTest();
+    ~WDsrLinkCacheTest() override;
+    void DoRun() override;
+};
+
+WDsrLinkCacheTest::WDsrLinkCacheTest()
+    : TestCase("WDSR link cache")
+{
+}
+
+WDsrLinkCacheTest::~WDsrLinkCacheTest()
+{
+}
+
+void
+WDsrLinkCacheTest::DoRun()
+{
+    Ptr<wdsr::WDsrRouteCache> rcache = CreateObject<wdsr::WDsrRouteCache>();
+    rcache->SetCacheType("LinkCache");
+    rcache->SetCacheTimeout(Seconds(10));
+    rcache->SetInitStability(Seconds(25));
+    rcache->SetMinLifeTime(Seconds(1));
+    rcache->SetStabilityDecrFactor(2);
+    rcache->SetStabilityIncrFactor(4);
+
+    std::vector<Ipv4Address> longRoute{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.1"),
+        Ipv4Address("0.0.0.2"),
+        Ipv4Address("0.0.0.3"),
+        Ipv4Address("0.0.0.4"),
+    };
+    std::vector<Ipv4Address> shortRoute{
+        Ipv4Address("0.0.0.0"),
+        Ipv4Address("0.0.0.5"),
+        Ipv4Address("0.0.0.4"),
+    };
+    wdsr::WDsrRouteCacheEntry found;
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute_Link(longRoute, Ipv4Address("0.0.0.0")),
+                          true,
+                          "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.4"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 5, "Only one route known");
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute_Link(shortRoute, Ipv4Address("0.0.0.0")),
+                          true,
+                          "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.4"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 3, "Shortest route is used");
+
+    rcache->DeleteAllRoutesIncludeLink(Ipv4Address("0.0.0.5"),
+                                       Ipv4Address("0.0.0.4"),
+                                       Ipv4Address("0.0.0.0"));
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.4"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 5, "Falls back to the long route");
+    rcache->DeleteAllRoutesIncludeLink(Ipv4Address("0.0.0.1"),
+                                       Ipv4Address("0.0.0.2"),
+                                       Ipv4Address("0.0.0.0"));
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.4"), found),
+                          false,
+                          "No route left to the destination");
+    NS_TEST_EXPECT_MSG_EQ(rcache->AddRoute_Link(shortRoute, Ipv4Address("0.0.0.0")),
+                          true,
+                          "trivial");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.4"), found),
+                          true,
+                          "The repaired route is found again");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 3, "Route through the re-added link");
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(Ipv4Address("0.0.0.3"), found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 4, "Reached through the destination");
+    Simulator::Destroy();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrLinkCacheEnergyTest
+ * \brief Unit test for the CCMBCR selection of the WDSR link cache
+ */
+class WDsrLinkCacheEnergyTest : public TestCase
+{
+  public:
+    WDsrLinkCacheEnergyTest();
+    ~WDsrLinkCacheEnergyTest() override;
+    void DoRun() override;
+};
+
+WDsrLinkCacheEnergyTest::WDsrLinkCacheEnergyTest()
+    : TestCase("WDSR link cache energy")
+{
+}
+
+WDsrLinkCacheEnergyTest::~WDsrLinkCacheEnergyTest()
+{
+}
+
+void
+WDsrLinkCacheEnergyTest::DoRun()
+{
+    uint8_t threshold = γ;
+    γ = 40;
+    Ptr<wdsr::WDsrRouteCache> rcache = CreateObject<wdsr::WDsrRouteCache>();
+    rcache->SetCacheType("LinkCache");
+    rcache->SetCacheTimeout(Seconds(10));
+    rcache->SetInitStability(Seconds(25));
+    rcache->SetMinLifeTime(Seconds(1));
+
+    Ipv4Address source("0.0.0.0");
+    Ipv4Address dst("0.0.0.9");
+    wdsr::WDsrRouteCacheEntry found;
+    rcache->AddRoute_Link({source, Ipv4Address("0.0.0.1"), dst}, source, 20, 2);
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(dst, found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector().size(), 3, "MMBCR when no route is above threshold");
+    NS_TEST_EXPECT_MSG_EQ((int)found.GetLowestBat(), 20, "Bottleneck battery of the route");
+
+    rcache->AddRoute_Link({source, Ipv4Address("0.0.0.2"), Ipv4Address("0.0.0.3"), dst},
+                          source,
+                          50,
+                          3);
+    rcache->AddRoute_Link({source, Ipv4Address("0.0.0.4"), Ipv4Address("0.0.0.5"), dst},
+                          source,
+                          60,
+                          9);
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(dst, found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector()[1],
+                          Ipv4Address("0.0.0.2"),
+                          "MTPR picks the cheapest route above threshold");
+    NS_TEST_EXPECT_MSG_EQ((int)found.GetTxCost(), 3, "Transmission cost of the route");
+
+    rcache->AddRoute_Link({source, Ipv4Address("0.0.0.2"), Ipv4Address("0.0.0.1")}, source, 5, 2);
+    NS_TEST_EXPECT_MSG_EQ(rcache->LookupRoute(dst, found), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(found.GetVector()[1],
+                          Ipv4Address("0.0.0.4"),
+                          "Drained node is no longer used as relay");
+    γ = threshold;
+    Simulator::Destroy();
+}
+
 // -----------------------------------------------------------------------------
 /**
  * \ingroup wdsr-test
@@ -541,6 +1488,9 @@ WDsrSendBuffTest::DoRun()
     q.Enqueue(e2);
     q.Enqueue(e3);
     NS_TEST_EXPECT_MSG_EQ(q.GetSize(), 2, "trivial");
+    std::vector<Ipv4Address> destinations = q.GetDestinations();
+    NS_TEST_EXPECT_MSG_EQ(destinations.size(), 2, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(destinations.front(), dst1, "The oldest packet is to dst1");
     Ptr<Packet> packet4 = Create<Packet>();
     Ipv4Address dst4 = Ipv4Address("0.0.0.4");
     wdsr::WDsrSendBuffEntry e4(packet4, dst4, Seconds(20));
@@ -585,6 +1535,345 @@ WDsrSendBuffTest::CheckTimeout()
     NS_TEST_EXPECT_MSG_EQ(q.GetSize(), 0, "Must be empty now");
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrSendBuffDestinationTest
+ * \brief Unit test for the per destination index of the send buffer
+ */
+class WDsrSendBuffDestinationTest : public TestCase
+{
+  public:
+    WDsrSendBuffDestinationTest();
+    ~WDsrSendBuffDestinationTest() override;
+    void DoRun() override;
+    /// Check the order of the packets and of the destinations
+    void CheckOrder();
+    /// Check the packets are unique for each destination
+    void CheckUid();
+    /// Buffer a packet later than the first ones
+    void EnqueueLater();
+    /// Check the expired packets are dropped
+    void CheckTimeout();
+    /**
+     * Count a dropped packet
+     * \param packet the dropped packet
+     */
+    void NotifyDrop(Ptr<const Packet> packet);
+
+    wdsr::WDsrSendBuffer m_buffer; ///< send buffer
+    uint32_t m_drops;              ///< number of dropped packets
+};
+
+WDsrSendBuffDestinationTest::WDsrSendBuffDestinationTest()
+    : TestCase("WDSR SendBuff destinations"),
+      m_drops(0)
+{
+}
+
+WDsrSendBuffDestinationTest::~WDsrSendBuffDestinationTest()
+{
+}
+
+void
+WDsrSendBuffDestinationTest::DoRun()
+{
+    CheckOrder();
+    CheckUid();
+
+    m_buffer.SetMaxQueueLen(8);
+    m_buffer.SetSendBufferTimeout(Seconds(10));
+    m_buffer.SetDropCallback(MakeCallback(&WDsrSendBuffDestinationTest::NotifyDrop, this));
+    Ipv4Address dst1("0.0.0.1");
+    wdsr::WDsrSendBuffEntry e1(Create<Packet>(), dst1, Seconds(1));
+    wdsr::WDsrSendBuffEntry e2(Create<Packet>(), dst1, Seconds(1));
+    m_buffer.Enqueue(e1);
+    m_buffer.Enqueue(e2);
+    Simulator::Schedule(Seconds(5), &WDsrSendBuffDestinationTest::EnqueueLater, this);
+    Simulator::Schedule(Seconds(11), &WDsrSendBuffDestinationTest::CheckTimeout, this);
+
+    Simulator::Run();
+    Simulator::Destroy();
+}
+
+void
+WDsrSendBuffDestinationTest::CheckOrder()
+{
+    wdsr::WDsrSendBuffer buffer;
+    buffer.SetMaxQueueLen(8);
+    buffer.SetSendBufferTimeout(Seconds(10));
+    Ipv4Address dst1("0.0.0.1");
+    Ipv4Address dst2("0.0.0.2");
+    std::vector<Ptr<Packet>> packets;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        packets.push_back(Create<Packet>());
+        wdsr::WDsrSendBuffEntry entry(packets.back(), i % 2 == 0 ? dst1 : dst2, Seconds(1));
+        NS_TEST_EXPECT_MSG_EQ(buffer.Enqueue(entry), true, "trivial");
+    }
+    std::vector<Ipv4Address> destinations = buffer.GetDestinations();
+    NS_TEST_EXPECT_MSG_EQ(destinations.size(), 2, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(destinations.front(), dst1, "dst1 got buffered packets first");
+
+    wdsr::WDsrSendBuffEntry entry;
+    for (uint32_t i = 0; i < 6; i += 2)
+    {
+        NS_TEST_EXPECT_MSG_EQ(buffer.Dequeue(dst1, entry), true, "trivial");
+        NS_TEST_EXPECT_MSG_EQ(entry.GetPacket(), packets[i], "The oldest packet comes first");
+    }
+    NS_TEST_EXPECT_MSG_EQ(buffer.Dequeue(dst1, entry), false, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(buffer.Dequeue(dst2, entry), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(entry.GetPacket(), packets[1], "The oldest packet comes first");
+
+    wdsr::WDsrSendBuffEntry again(Create<Packet>(), dst1, Seconds(1));
+    buffer.Enqueue(again);
+    destinations = buffer.GetDestinations();
+    NS_TEST_EXPECT_MSG_EQ(destinations.size(), 2, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(destinations.front(), dst2, "dst1 was emptied in between");
+    buffer.DropPacketWithDst(dst2);
+    destinations = buffer.GetDestinations();
+    NS_TEST_EXPECT_MSG_EQ(destinations.size(), 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(destinations.front(), dst1, "trivial");
+}
+
+void
+WDsrSendBuffDestinationTest::CheckUid()
+{
+    wdsr::WDsrSendBuffer buffer;
+    buffer.SetMaxQueueLen(8);
+    buffer.SetSendBufferTimeout(Seconds(10));
+    Ptr<const Packet> packet = Create<Packet>();
+    wdsr::WDsrSendBuffEntry e1(packet, Ipv4Address("0.0.0.1"), Seconds(1));
+    wdsr::WDsrSendBuffEntry e2(packet, Ipv4Address("0.0.0.2"), Seconds(1));
+    NS_TEST_EXPECT_MSG_EQ(buffer.Enqueue(e1), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(buffer.Enqueue(e1), false, "The packet is already buffered for dst1");
+    NS_TEST_EXPECT_MSG_EQ(buffer.Enqueue(e2), true, "The packet is not buffered for dst2 yet");
+    NS_TEST_EXPECT_MSG_EQ(buffer.GetSize(), 2, "trivial");
+}
+
+void
+WDsrSendBuffDestinationTest::EnqueueLater()
+{
+    wdsr::WDsrSendBuffEntry e3(Create<Packet>(), Ipv4Address("0.0.0.2"), Seconds(1));
+    m_buffer.Enqueue(e3);
+    NS_TEST_EXPECT_MSG_EQ(m_buffer.GetSize(), 3, "Nothing has expired yet");
+}
+
+void
+WDsrSendBuffDestinationTest::CheckTimeout()
+{
+    NS_TEST_EXPECT_MSG_EQ(m_buffer.GetSize(), 1, "Only the packets at the head have expired");
+    NS_TEST_EXPECT_MSG_EQ(m_drops, 2, "One drop for each expired packet");
+    NS_TEST_EXPECT_MSG_EQ(m_buffer.Find(Ipv4Address("0.0.0.1")), false, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_buffer.Find(Ipv4Address("0.0.0.2")), true, "trivial");
+}
+
+void
+WDsrSendBuffDestinationTest::NotifyDrop([[maybe_unused]] Ptr<const Packet> packet)
+{
+    m_drops++;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrSendBuffFlushTest
+ * \brief Unit test for sending the buffered packets when a route is added
+ */
+class WDsrSendBuffFlushTest : public TestCase
+{
+  public:
+    WDsrSendBuffFlushTest();
+    ~WDsrSendBuffFlushTest() override;
+    void DoRun() override;
+    /// Buffer a packet with no route to its destination
+    void SendPacket();
+    /// Add the route to the destination of the packet
+    void AddRoute();
+    /**
+     * Record the first transmission to the destination
+     * \param packet the packet with its IPv4 header
+     * \param ipv4 the IPv4 protocol
+     * \param interface the interface index
+     */
+    void NotifyTx(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+
+    Ptr<wdsr::WDsrRouting> m_routing; ///< routing of the source
+    Ipv4Address m_source;             ///< source address
+    Ipv4Address m_destination;        ///< destination address
+    Time m_sent;                      ///< time of the first transmission to the destination
+};
+
+WDsrSendBuffFlushTest::WDsrSendBuffFlushTest()
+    : TestCase("WDSR SendBuff flush on route"),
+      m_source("10.1.1.1"),
+      m_destination("10.1.1.2"),
+      m_sent(Seconds(-1))
+{
+}
+
+WDsrSendBuffFlushTest::~WDsrSendBuffFlushTest()
+{
+}
+
+void
+WDsrSendBuffFlushTest::DoRun()
+{
+    NodeContainer nodes;
+    nodes.Create(2);
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer devices = simple.Install(nodes);
+    InternetStackHelper internet;
+    internet.Install(nodes);
+    Ipv4AddressHelper address;
+    address.SetBase("10.1.1.0", "255.255.255.0");
+    address.Assign(devices);
+    // Only the source runs WDSR, no route reply can come back
+    WDsrHelper wdsr;
+    wdsr.Set("CacheType", StringValue("PathCache"));
+    WDsrMainHelper wdsrMain;
+    wdsrMain.Install(wdsr, NodeContainer(nodes.Get(0)));
+    m_routing = nodes.Get(0)->GetObject<wdsr::WDsrRouting>();
+    nodes.Get(0)->GetObject<Ipv4L3Protocol>()->TraceConnectWithoutContext(
+        "Tx",
+        MakeCallback(&WDsrSendBuffFlushTest::NotifyTx, this));
+
+    Simulator::Schedule(Seconds(1), &WDsrSendBuffFlushTest::SendPacket, this);
+    Simulator::Schedule(Seconds(2), &WDsrSendBuffFlushTest::AddRoute, this);
+    Simulator::Stop(Seconds(3));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_sent,
+                          Seconds(2),
+                          "The buffered packet is sent when the route is added");
+    m_routing = nullptr;
+    Simulator::Destroy();
+}
+
+void
+WDsrSendBuffFlushTest::SendPacket()
+{
+    m_routing->Send(Create<Packet>(100), m_source, m_destination, 17, nullptr);
+}
+
+void
+WDsrSendBuffFlushTest::AddRoute()
+{
+    std::vector<Ipv4Address> route;
+    route.push_back(m_source);
+    route.push_back(m_destination);
+    wdsr::WDsrRouteCacheEntry entry(route, m_destination, Seconds(30));
+    NS_TEST_EXPECT_MSG_EQ(m_routing->AddRoute(entry), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_sent, Seconds(-1), "The packet is sent out of the route addition");
+}
+
+void
+WDsrSendBuffFlushTest::NotifyTx(Ptr<const Packet> packet,
+                                [[maybe_unused]] Ptr<Ipv4> ipv4,
+                                [[maybe_unused]] uint32_t interface)
+{
+    Ipv4Header header;
+    packet->PeekHeader(header);
+    if (header.GetDestination() == m_destination && m_sent.IsNegative())
+    {
+        m_sent = Simulator::Now();
+    }
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * \ingroup wdsr-test
+ * \ingroup tests
+ *
+ * \class WDsrNetworkQueueTest
+ * \brief Unit test for WDSR network queue
+ */
+class WDsrNetworkQueueTest : public TestCase
+{
+  public:
+    WDsrNetworkQueueTest();
+    ~WDsrNetworkQueueTest() override;
+    void DoRun() override;
+    /// Check timeout function
+    void CheckTimeout();
+
+    Ptr<wdsr::WDsrNetworkQueue> m_queue; ///< network queue
+};
+
+WDsrNetworkQueueTest::WDsrNetworkQueueTest()
+    : TestCase("WDSR network queue")
+{
+}
+
+WDsrNetworkQueueTest::~WDsrNetworkQueueTest()
+{
+}
+
+void
+WDsrNetworkQueueTest::DoRun()
+{
+    m_queue = CreateObject<wdsr::WDsrNetworkQueue>(3, Seconds(10));
+    Ipv4Address source("0.0.0.1");
+    Ipv4Address hop1("0.0.0.2");
+    Ipv4Address hop2("0.0.0.3");
+    Ptr<Packet> packet1 = Create<Packet>();
+    Ptr<Packet> packet2 = Create<Packet>();
+    Ptr<Packet> packet3 = Create<Packet>();
+    wdsr::WDsrNetworkQueueEntry e1(packet1, source, hop1);
+    wdsr::WDsrNetworkQueueEntry e2(packet2, source, hop2);
+    wdsr::WDsrNetworkQueueEntry e3(packet3, source, hop1);
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Enqueue(e1), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Enqueue(e2), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Enqueue(e3), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Enqueue(e1), false, "The queue is full");
+
+    wdsr::WDsrNetworkQueueEntry entry;
+    NS_TEST_EXPECT_MSG_EQ(m_queue->FindPacketWithNexthop(hop2, entry), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(entry.GetPacket(), packet2, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->GetSize(), 2, "The entry taken out is not counted");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Find(hop2), false, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->GetNextHops().size(), 1, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Enqueue(e2), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Dequeue(entry), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(entry.GetPacket(), packet1, "First in, first out");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Dequeue(entry), true, "trivial");
+    NS_TEST_EXPECT_MSG_EQ(entry.GetPacket(), packet3, "The entry taken out is skipped");
+
+    // The next hops take turns to send their quantum
+    Ptr<wdsr::WDsrNetworkQueue> queue = CreateObject<wdsr::WDsrNetworkQueue>(10, Seconds(10));
+    queue->SetQuantum(100);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        wdsr::WDsrNetworkQueueEntry e(Create<Packet>(100), source, hop1);
+        NS_TEST_EXPECT_MSG_EQ(queue->Enqueue(e), true, "trivial");
+    }
+    wdsr::WDsrNetworkQueueEntry e4(Create<Packet>(100), source, hop2);
+    NS_TEST_EXPECT_MSG_EQ(queue->Enqueue(e4), true, "trivial");
+    Ipv4Address order[] = {hop1, hop2, hop1, hop1};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        NS_TEST_EXPECT_MSG_EQ(queue->Dequeue(entry), true, "trivial");
+        NS_TEST_EXPECT_MSG_EQ(entry.GetNextHopAddress(), order[i], "Deficit round robin");
+    }
+    NS_TEST_EXPECT_MSG_EQ(queue->Dequeue(entry), false, "The queue is empty");
+
+    Simulator::Schedule(Seconds(11), &WDsrNetworkQueueTest::CheckTimeout, this);
+    Simulator::Run();
+    Simulator::Destroy();
+}
+
+void
+WDsrNetworkQueueTest::CheckTimeout()
+{
+    NS_TEST_EXPECT_MSG_EQ(m_queue->Find(Ipv4Address("0.0.0.3")), false, "Expired");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->GetSize(), 0, "Must be empty now");
+    NS_TEST_EXPECT_MSG_EQ(m_queue->GetNextHops().empty(), true, "trivial");
+}
+
 // -----------------------------------------------------------------------------
 /**
  * \ingroup wdsr-test
@@ -640,7 +1929,21 @@ class WDsrTestSuite : public TestSuite
         AddTestCase(new WDsrRerrHeaderTest, TestCase::QUICK);
         AddTestCase(new WDsrAckReqHeaderTest, TestCase::QUICK);
         AddTestCase(new WDsrAckHeaderTest, TestCase::QUICK);
+        AddTestCase(new WDsrOptionTableTest, TestCase::QUICK);
         AddTestCase(new WDsrCacheEntryTest, TestCase::QUICK);
+        AddTestCase(new WDsrPathTest, TestCase::QUICK);
+        AddTestCase(new WDsrRouteCacheExpiryTest, TestCase::QUICK);
+        AddTestCase(new WDsrRouteCacheSubRouteTest, TestCase::QUICK);
+        AddTestCase(new WDsrRouteCacheSelectionTest, TestCase::QUICK);
+        AddTestCase(new WDsrRouteCacheSnapshotTest, TestCase::QUICK);
+        AddTestCase(new WDsrNeighborTest, TestCase::QUICK);
+        AddTestCase(new WDsrNodeDirectoryTest, TestCase::QUICK);
+        AddTestCase(new WDsrEnergyProviderTest, TestCase::QUICK);
+        AddTestCase(new WDsrLinkCacheTest, TestCase::QUICK);
+        AddTestCase(new WDsrLinkCacheEnergyTest, TestCase::QUICK);
         AddTestCase(new WDsrSendBuffTest, TestCase::QUICK);
+        AddTestCase(new WDsrSendBuffDestinationTest, TestCase::QUICK);
+        AddTestCase(new WDsrSendBuffFlushTest, TestCase::QUICK);
+        AddTestCase(new WDsrNetworkQueueTest, TestCase::QUICK);
     }
 } g_wdsrTestSuite;
@@ -43,7 +43,9 @@
 #include "ns3/basic-energy-source.h"
 #include "ns3/simple-device-energy-model.h"
 #include "ns3/stats-module.h"
+#include <fstream>
 #include <sstream>
+#include <vector>
 #include "ns3/wifi-radio-energy-model-helper.h"
 #include "ns3/wifi-net-device.h"
 
@@ -62,9 +64,9 @@ uint32_t nWifis = 20;
 bool fixed = 0;
 bool logonce;
 
-double remainingEnergy[100];
-double initialEnergy[100];
-uint32_t packets[100];
+// Batteries and bytes sent of the nodes of the current run
+std::vector<Ptr<wdsr::WDsrEnergyProvider>> batteries;
+std::vector<uint32_t> packets;
 
 // Initializing extern variables (Type should only be cast here)
 uint8_t γ;
@@ -73,51 +75,64 @@ double voltage = 3;
 double eta = 0.785;
 double idleW = voltage*0.575;
 double initialBattery;
-double Oldtime;
+uint32_t alive;
 NetDeviceContainer allDevices;
 Timer logging;
 std::string rate = "1Mbps";
-
-void CalcIdleAll() {
-    double newtime = ns3::Simulator::Now().GetSeconds(); //namespace ns3?
-    for (uint32_t i = 0; i < nWifis; i++){
-        if (remainingEnergy[i] > 0.0){
-            remainingEnergy[i] -= (idleW*(newtime-Oldtime));
-        }
-    }
-    Oldtime = newtime;
+DataRate txRate;
+std::string snapshot;
+double snapshotTime = 10.0;
+std::string policy = "CCMBCR";
+bool cacheStats = false;
+
+// The sinks of the fixed scenario have a bigger battery and are not plotted
+bool IsPlotted(uint32_t i) {
+    return !(fixed && (i == 0 || i == 4));
 }
 
-
 Ptr<GnuplotAggregator> aggregator;
 Ptr<GnuplotAggregator> depletedAggregator;
+// The batteries drain on their own, they are only sampled here for the plots
 void Logger() {
-    CalcIdleAll();
-    uint32_t depleted = nWifis;
+    double now = Simulator::Now().GetSeconds();
     for (uint32_t i = 0; i < nWifis; i++){
-        if (!(fixed && (i == 0 || i == 4))) {
-          //NS_LOG_UNCOND ("node "<<i<<"energy "<<remainingEnergy[i]<<" s "<<Simulator::Now().GetSeconds());
-          aggregator->Write2d(std::to_string(i), Simulator::Now().GetSeconds(), remainingEnergy[i]);
-          if (remainingEnergy[i] <= 0.0) {
-              depleted--;
-              if (allDevices.Get(i)->GetObject<WifiNetDevice>()->GetPhy()->IsStateIdle())
-                  allDevices.Get(i)->GetObject<WifiNetDevice>()->GetPhy()->SetOffMode();
-          }
+        if (IsPlotted(i)) {
+          //NS_LOG_UNCOND ("node "<<i<<"energy "<<batteries[i]->GetRemainingEnergy()<<" s "<<now);
+          aggregator->Write2d(std::to_string(i), now, batteries[i]->GetRemainingEnergy());
         }
     }
-    depletedAggregator->Write2d("Nodes Alive", Simulator::Now().GetSeconds(), depleted);
-    if (depleted <= nWifis-1 && !logonce) {
-        printf("%lf\n", Simulator::Now().GetSeconds());
+    depletedAggregator->Write2d("Nodes Alive", now, alive);
+    logging.Schedule();
+}
+
+// Turn the radio off once it is done with the current frame
+void PhyOff(uint32_t i) {
+    Ptr<WifiPhy> phy = allDevices.Get(i)->GetObject<WifiNetDevice>()->GetPhy();
+    if (phy->IsStateIdle()) {
+        phy->SetOffMode();
+    } else if (!phy->IsStateOff()) {
+        Simulator::Schedule(MilliSeconds(1), &PhyOff, i);
+    }
+}
+
+void depleted(uint32_t i, Time time) {
+    if (!IsPlotted(i)) {
+        return;
+    }
+    alive--;
+    aggregator->Write2d(std::to_string(i), time.GetSeconds(), 0.0);
+    depletedAggregator->Write2d("Nodes Alive", time.GetSeconds(), alive);
+    if (!logonce) {
+        printf("%lf\n", time.GetSeconds());
         logonce = 1;
-        //Simulator::Destroy();
     }
-    logging.Schedule();
+    PhyOff(i);
 }
 
-void txsniff(std::string nodeID, Ptr< const Packet > packet, double txPowerW) {
-    //NS_LOG_UNCOND ("node "<<nodeID<<" time "<<Simulator::Now ().GetSeconds ()<<" power "<<txPowerW<<" size "<<packet->GetSize());
-    remainingEnergy[std::stoi(nodeID)] -= (1/eta)*txPowerW*DataRate(rate).CalculateBytesTxTime(packet->GetSize()).GetSeconds();
-    packets[std::stoi(nodeID)] += packet->GetSize();
+void txsniff(uint32_t i, Ptr< const Packet > packet, double txPowerW) {
+    //NS_LOG_UNCOND ("node "<<i<<" time "<<Simulator::Now ().GetSeconds ()<<" power "<<txPowerW<<" size "<<packet->GetSize());
+    batteries[i]->DecreaseEnergy((1/eta)*txPowerW*txRate.CalculateBytesTxTime(packet->GetSize()).GetSeconds());
+    packets[i] += packet->GetSize();
 }
 
 uint32_t port;
@@ -133,6 +148,45 @@ SetupPacketReceive(Ipv4Address addr, Ptr<Node> node)
     return sink;
 }
 
+// Route cache snapshots, so the sweeps can skip the route discovery transient
+void SaveSnapshot(NodeContainer nodes) {
+    std::ofstream os(snapshot, std::ios::binary);
+    for (uint32_t i = 0; i < nodes.GetN(); i++) {
+        nodes.Get(i)->GetObject<wdsr::WDsrRouting>()->WriteSnapshot(os);
+    }
+    if (!os) {
+        NS_LOG_UNCOND("Failed to save the route cache snapshot " << snapshot);
+    }
+}
+
+// A snapshot that does not match the scenario aborts the run, rather than leave it partly warm
+void LoadSnapshot(NodeContainer nodes) {
+    std::ifstream is(snapshot, std::ios::binary);
+    for (uint32_t i = 0; i < nodes.GetN(); i++) {
+        if (!nodes.Get(i)->GetObject<wdsr::WDsrRouting>()->ReadSnapshot(is)) {
+            NS_FATAL_ERROR("Route cache snapshot " << snapshot << " does not match node " << i);
+        }
+    }
+    if (is.peek() != std::ifstream::traits_type::eof()) {
+        NS_FATAL_ERROR("Route cache snapshot " << snapshot << " has more nodes than the scenario");
+    }
+}
+
+// Route cache counters of every node and of the whole network, on stderr to keep stdout for the plots
+void PrintCacheStats(NodeContainer nodes) {
+    wdsr::WDsrRouteCacheStats total;
+    for (uint32_t i = 0; i < nodes.GetN(); i++) {
+        const wdsr::WDsrRouteCacheStats& stats =
+            nodes.Get(i)->GetObject<wdsr::WDsrRouting>()->GetRouteCache()->GetStats();
+        std::cerr << "cache " << i << " ";
+        stats.Print(std::cerr);
+        std::cerr << std::endl;
+        total += stats;
+    }
+    std::cerr << "cache total ";
+    total.Print(std::cerr);
+    std::cerr << std::endl;
+}
 
 NS_LOG_COMPONENT_DEFINE("WDsrTest");
 
@@ -181,7 +235,7 @@ main(int argc, char* argv[])
     uint32_t seed = 3;
     int runDSR = 0;
     int echo = 0;
-    double logginginterval = 0.01;
+    double logginginterval = 1.0;
     γ = 40;
     α = 6;
 
@@ -207,14 +261,20 @@ main(int argc, char* argv[])
     cmd.AddValue("gamma", "gamma/threshold value, Default: 120", γ);
     cmd.AddValue("alpha", "alpha value (in S), Default: 5", α);
     cmd.AddValue("echo", "EchoServer on/off, Default: 0", echo);
+    cmd.AddValue("policy", "Route selection policy: HopCount, MMBCR, MTPR or CCMBCR, Default: CCMBCR", policy);
+    cmd.AddValue("snapshot", "Route cache snapshot, loaded at start if the file exists, else saved at snapshotTime", snapshot);
+    cmd.AddValue("snapshotTime", "Time the route cache snapshot is saved at (in S), Default: 10", snapshotTime);
+    cmd.AddValue("cacheStats", "Print the route cache counters at the end of the run, Default: 0", cacheStats);
+    cmd.AddValue("logInterval", "Interval the batteries are plotted at (in S), Default: 1", logginginterval);
     cmd.Parse(argc, argv);
+    txRate = DataRate(rate);
 
     if (fixed) {
         nWifis = 9;
         nSinks = 2;
     }
     for (int dsr = 0; dsr <= runDSR; dsr++) { //1 for only WDSR 2 for Compare.
-    Oldtime = 0;
+    alive = nWifis;
     logonce = 0;
 
     /********* Gnuplot ***********/
@@ -308,24 +368,27 @@ main(int argc, char* argv[])
     mobility.Install(adhocNodes);
     /**************************/
 
+    batteries.assign(nWifis, nullptr);
+    packets.assign(nWifis, 0);
     for (uint32_t i = 0; i < allDevices.GetN(); ++i) {
         Ptr<NetDevice> staDevicePtr = allDevices.Get(i);
         Ptr<WifiPhy> wifiPhyPtr = staDevicePtr->GetObject<WifiNetDevice>()->GetPhy();
         if (wifiPhyPtr != NULL) {
             NS_ASSERT(staDevicePtr == adhocNodes.Get(i)->GetDevice(0));
             std::string context = std::to_string(i);
-            wifiPhyPtr->TraceConnect("PhyTxBegin",context, MakeCallback(&txsniff));
+            wifiPhyPtr->TraceConnectWithoutContext("PhyTxBegin", MakeBoundCallback(&txsniff, i));
             if (!(fixed && (i == 0 || i == 4))) {
                 aggregator->Add2dDataset(context, std::string("Node: ") + context);
             }
-            packets[i] = 0;
+            batteries[i] = CreateObject<wdsr::WDsrEnergyProvider>();
             if (fixed && (i==0||i==4)){
-                remainingEnergy[i] = initialBattery*4;
-                initialEnergy[i] = initialBattery*4;
+                batteries[i]->SetInitialEnergy(initialBattery*4);
             } else{
-                remainingEnergy[i] = initialBattery;
-                initialEnergy[i] = initialBattery;
+                batteries[i]->SetInitialEnergy(initialBattery);
             }
+            batteries[i]->SetIdlePower(idleW);
+            batteries[i]->TraceConnectWithoutContext("Depleted", MakeBoundCallback(&depleted, i));
+            adhocNodes.Get(i)->AggregateObject(batteries[i]);
         }
     }
     depletedAggregator->Add2dDataset("Nodes Alive", std::string("Nodes Alive: "));
@@ -341,6 +404,7 @@ main(int argc, char* argv[])
     WDsrMainHelper wdsrMain;
     WDsrHelper wdsr;
     wdsr.Set("CacheType", StringValue("PathCache"));
+    wdsr.Set("RoutePolicy", StringValue(policy));
     internet.Install(adhocNodes);
     dsr ? dsrMain.Install(dsrH, adhocNodes) : wdsrMain.Install(wdsr, adhocNodes);
 
@@ -418,6 +482,14 @@ main(int argc, char* argv[])
     }
 
     Simulator::Stop(Seconds(TotalTime));
+    if (!dsr && !snapshot.empty()) {
+        // Scheduled after WDSR has been started on the nodes
+        if (std::ifstream(snapshot).good()) {
+            Simulator::Schedule(Seconds(0), &LoadSnapshot, adhocNodes);
+        } else {
+            Simulator::Schedule(Seconds(snapshotTime), &SaveSnapshot, adhocNodes);
+        }
+    }
     /******* Animation *******/
 #if 1 //(dis/en)able animation
     AnimationInterface anim(dsr ? "dsr-sim.xml" : "wdsr-sim.xml"); // Mandatory
@@ -436,6 +508,9 @@ main(int argc, char* argv[])
 #endif
     /*************************/
     Simulator::Run();
+    if (!dsr && cacheStats) {
+        PrintCacheStats(adhocNodes);
+    }
     Simulator::Destroy();
     for (int i = 0; i < nWifis; i++)
         fprintf(stderr, "%d %u\n ",i, packets[i]);
@@ -44,6 +44,7 @@
 #include "ns3/simple-device-energy-model.h"
 #include "ns3/stats-module.h"
 #include <sstream>
+#include <vector>
 #include "ns3/wifi-radio-energy-model-helper.h"
 #include "ns3/wifi-net-device.h"
 #include <cstdlib>
@@ -63,9 +64,9 @@ uint32_t nWifis = 20;
 bool fixed = 0;
 bool logonce;
 
-double remainingEnergy[100];
-double initialEnergy[100];
-uint32_t packets[100];
+// Batteries and bytes sent of the nodes of the current run
+std::vector<Ptr<wdsr::WDsrEnergyProvider>> batteries;
+std::vector<uint32_t> packets;
 
 // Initializing extern variables (Type should only be cast here)
 uint8_t γ;
@@ -82,9 +83,7 @@ std::string rate = "1Mbps";
 void CalcIdleAll() {
     double newtime = ns3::Simulator::Now().GetSeconds(); //namespace ns3?
     for (uint32_t i = 0; i < nWifis; i++){
-        if (remainingEnergy[i] > 0.0){
-            remainingEnergy[i] -= (idleW*(newtime-Oldtime));
-        }
+        batteries[i]->DecreaseEnergy(idleW*(newtime-Oldtime));
     }
     Oldtime = newtime;
 }
@@ -97,9 +96,9 @@ void Logger() {
     uint32_t depleted = nWifis;
     for (uint32_t i = 0; i < nWifis; i++){
         if (!(fixed && (i == 0 || i == 4))) {
-          //NS_LOG_UNCOND ("node "<<i<<"energy "<<remainingEnergy[i]<<" s "<<Simulator::Now().GetSeconds());
-          aggregator->Write2d(std::to_string(i), Simulator::Now().GetSeconds(), remainingEnergy[i]);
-          if (remainingEnergy[i] <= 0.0) {
+          //NS_LOG_UNCOND ("node "<<i<<"energy "<<batteries[i]->GetRemainingEnergy()<<" s "<<Simulator::Now().GetSeconds());
+          aggregator->Write2d(std::to_string(i), Simulator::Now().GetSeconds(), batteries[i]->GetRemainingEnergy());
+          if (batteries[i]->IsDepleted()) {
               depleted--;
               if (allDevices.Get(i)->GetObject<WifiNetDevice>()->GetPhy()->IsStateIdle())
                   allDevices.Get(i)->GetObject<WifiNetDevice>()->GetPhy()->SetOffMode();
@@ -117,7 +116,7 @@ void Logger() {
 
 void txsniff(std::string nodeID, Ptr< const Packet > packet, double txPowerW) {
     //NS_LOG_UNCOND ("node "<<nodeID<<" time "<<Simulator::Now ().GetSeconds ()<<" power "<<txPowerW<<" size "<<packet->GetSize());
-    remainingEnergy[std::stoi(nodeID)] -= (1/eta)*txPowerW*DataRate(rate).CalculateBytesTxTime(packet->GetSize()).GetSeconds();
+    batteries[std::stoi(nodeID)]->DecreaseEnergy((1/eta)*txPowerW*DataRate(rate).CalculateBytesTxTime(packet->GetSize()).GetSeconds());
     packets[std::stoi(nodeID)] += packet->GetSize();
 }
 
@@ -309,6 +308,8 @@ main(int argc, char* argv[])
     mobility.Install(adhocNodes);
     /**************************/
 
+    batteries.assign(nWifis, nullptr);
+    packets.assign(nWifis, 0);
     for (uint32_t i = 0; i < allDevices.GetN(); ++i) {
         Ptr<NetDevice> staDevicePtr = allDevices.Get(i);
         Ptr<WifiPhy> wifiPhyPtr = staDevicePtr->GetObject<WifiNetDevice>()->GetPhy();
@@ -319,14 +320,13 @@ main(int argc, char* argv[])
             if (!(fixed && (i == 0 || i == 4))) {
                 aggregator->Add2dDataset(context, std::string("Node: ") + context);
             }
-            packets[i] = 0;
+            batteries[i] = CreateObject<wdsr::WDsrEnergyProvider>();
             if (fixed && (i==0||i==4)){
-                remainingEnergy[i] = initialBattery*4;
-                initialEnergy[i] = initialBattery*4;
+                batteries[i]->SetInitialEnergy(initialBattery*4);
             } else{
-                remainingEnergy[i] = initialBattery;
-                initialEnergy[i] = initialBattery;
+                batteries[i]->SetInitialEnergy(initialBattery);
             }
+            adhocNodes.Get(i)->AggregateObject(batteries[i]);
         }
     }
     depletedAggregator->Add2dDataset("Nodes Alive", std::string("Nodes Alive: "));
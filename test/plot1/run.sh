@@ -2,10 +2,14 @@
   echo "" > timeofdeath.dat
   echo "" > y.dat
   ../../ns3/ns3 run "wdsr-sim --fixed=1"
+  # A warm-up run at gamma 0, where no node is below the threshold, saves the discovered routes
+  # and batteries, so every gamma of the sweep starts from the same state
+  rm -f routes.snap
+  ../../ns3/build/scratch/ns3-dev-wdsr-sim-default --fixed=1 --gamma=0 --alpha=1 --snapshot=routes.snap > /dev/null
 
 for i in {63..0}
 do
-  ../../ns3/build/scratch/ns3-dev-wdsr-sim-default --fixed=1 --gamma="$i" --alpha=1 >> timeofdeath.dat && echo "$i" >> y.dat
+  ../../ns3/build/scratch/ns3-dev-wdsr-sim-default --fixed=1 --gamma="$i" --alpha=1 --snapshot=routes.snap >> timeofdeath.dat && echo "$i" >> y.dat
 done
 paste y.dat timeofdeath.dat > xy.dat
 
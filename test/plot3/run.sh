@@ -2,11 +2,15 @@
   echo "" > timeofdeath.dat
   echo "" > y.dat
   ../../ns3/ns3 run "wdsr-sim"
+  # A warm-up run at the reference alpha saves the discovered routes, every alpha of the sweep
+  # starts from them and gives the loaded routes its own lifetime
+  rm -f routes.snap
+  ../../ns3/build/scratch/ns3-dev-wdsr-sim-default --fixed=1 --gamma=44 --alpha=6 --snapshot=routes.snap > /dev/null
 
 for i in {0..60}
 do
   # echo "$i" >> timeofdeath.dat
-  ../../ns3/build/scratch/ns3-dev-wdsr-sim-default --fixed=1 --gamma=44 --alpha="$i" >> timeofdeath.dat && echo "$i" >> y.dat
+  ../../ns3/build/scratch/ns3-dev-wdsr-sim-default --fixed=1 --gamma=44 --alpha="$i" --snapshot=routes.snap >> timeofdeath.dat && echo "$i" >> y.dat
 done
 paste y.dat timeofdeath.dat > xy.dat
 